@@ -17,6 +17,7 @@ if(WIN32)
 else()
 	find_path(CATCH_INCLUDE_DIR catch.hpp
 		PATHS "/usr/include/"
+		PATH_SUFFIXES catch catch2
 	)
 endif()
 
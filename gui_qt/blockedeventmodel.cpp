@@ -0,0 +1,145 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "blockedeventmodel.hpp"
+#include "evtlog.hpp"
+
+#include <QDateTime>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+	// user names are cached by evtlog::sidcache, shows the SID if the user is unknown
+	std::string username(const std::string& sid){
+		const auto account = evtlog::sid_to_username(sid);
+		return account.first.empty() ? sid : account.first;
+	}
+}
+
+BlockedEventModel::BlockedEventModel(const std::size_t capacity, QObject *parent) :
+	QAbstractTableModel(parent), history(capacity, username)
+{
+}
+
+int BlockedEventModel::rowCount(const QModelIndex& parent) const{
+	return parent.isValid() ? 0 : static_cast<int>(history.size());
+}
+
+int BlockedEventModel::columnCount(const QModelIndex& parent) const{
+	return parent.isValid() ? 0 : columncount;
+}
+
+QVariant BlockedEventModel::data(const QModelIndex& index, int role) const{
+	if(!index.isValid() || index.row() >= rowCount()){
+		return QVariant();
+	}
+	const auto row = static_cast<std::size_t>(index.row());
+	const auto& event = history[row];
+	if(role == Qt::DisplayRole){
+		switch(index.column()){
+			case time: return QDateTime::fromMSecsSinceEpoch(event.time / 1000, Qt::UTC).toLocalTime().toString(Qt::ISODate);
+			case user: return QString::fromStdString(history.username(row));
+			case path: return QString::fromStdString(event.path);
+			case rule: return QString::fromStdString(event.rulepath);
+			default: return QVariant();
+		}
+	}
+	if(role == Qt::ToolTipRole){
+		switch(index.column()){
+			case user: return QString::fromStdString(event.user);
+			case rule: return event.rule.isnil() ? QVariant() : QString::fromStdString(event.rule.to_string());
+			default: return QVariant();
+		}
+	}
+	return QVariant();
+}
+
+QVariant BlockedEventModel::headerData(int section, Qt::Orientation orientation, int role) const{
+	if(orientation != Qt::Horizontal || role != Qt::DisplayRole){
+		return QAbstractTableModel::headerData(section, orientation, role);
+	}
+	switch(section){
+		case time: return tr("Time");
+		case user: return tr("User");
+		case path: return tr("Path");
+		case rule: return tr("Rule");
+		default: return QVariant();
+	}
+}
+
+// the rows of the persistent indexes (selection, current index) are found again through the sequence numbers of their events
+template<class F>
+void BlockedEventModel::relayout(F change){
+	emit layoutAboutToBeChanged();
+	const auto from = persistentIndexList();
+	std::vector<std::uint64_t> sequences;
+	sequences.reserve(static_cast<std::size_t>(from.size()));
+	for(const auto& i : from){
+		sequences.push_back(history.sequence(static_cast<std::size_t>(i.row())));
+	}
+
+	change();
+
+	std::unordered_map<std::uint64_t, int> rows;
+	for(const auto seq : sequences){
+		if(history.visible(seq)){
+			rows.emplace(seq, -1);
+		}
+	}
+	for(std::size_t row = 0; row != history.size() && !rows.empty(); ++row){
+		const auto it = rows.find(history.sequence(row));
+		if(it != rows.end()){
+			it->second = static_cast<int>(row);
+		}
+	}
+	QModelIndexList to;
+	to.reserve(from.size());
+	for(int i = 0; i != from.size(); ++i){
+		const auto it = rows.find(sequences[static_cast<std::size_t>(i)]);
+		to.push_back(it == rows.end() ? QModelIndex() : index(it->second, from.at(i).column()));
+	}
+	changePersistentIndexList(from, to);
+	emit layoutChanged();
+}
+
+void BlockedEventModel::sort(int column, Qt::SortOrder order){
+	static const evtlog::EventHistory::column columns[columncount] = {
+		evtlog::EventHistory::column::time, evtlog::EventHistory::column::user, evtlog::EventHistory::column::path, evtlog::EventHistory::column::rule
+	};
+	if(column < 0 || column >= columncount){
+		return;
+	}
+	relayout([&]{ history.sort(columns[column], order == Qt::AscendingOrder); });
+}
+
+void BlockedEventModel::commit(){
+	if(history.appendsonly()){
+		// the new events go after the visible ones
+		const int before = rowCount();
+		const int after = static_cast<int>(history.stored());
+		if(after > before){
+			beginInsertRows(QModelIndex(), before, after - 1);
+			history.update();
+			endInsertRows();
+		}
+		return;
+	}
+	// new events are merged in any position, and the oldest ones are dropped
+	relayout([this]{ history.update(); });
+}
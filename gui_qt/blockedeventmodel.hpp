@@ -0,0 +1,60 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BLOCKEDEVENTMODEL_HPP
+#define BLOCKEDEVENTMODEL_HPP
+
+// local
+#include "eventhistory.hpp"
+#include "blockedevent.hpp"
+
+// qt
+#include <QAbstractTableModel>
+#include <QString>
+#include <QVariant>
+
+// The last blocked events, for a QTableView
+// Memory is bounded by the capacity of the history, and the text of a cell is created only when the view asks for it (for the visible rows)
+class BlockedEventModel : public QAbstractTableModel
+{
+	Q_OBJECT
+
+public:
+	enum column { time, user, path, rule, columncount };
+
+	explicit BlockedEventModel(const std::size_t capacity, QObject *parent = nullptr);
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+	int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+	QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+	void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+	// slot for a new event (it may contain an old event, swap or assign to reuse its memory), visible after commit
+	evtlog::BlockedEvent& append(){return history.append();}
+	// shows the appended events with one update of the views, persistent indexes keep pointing to the same events
+	void commit();
+
+private:
+	evtlog::EventHistory history;
+
+	// applies a change of the order, keeping the persistent indexes on their events
+	template<class F>
+	void relayout(F change);
+};
+
+#endif // BLOCKEDEVENTMODEL_HPP
@@ -0,0 +1,50 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INSTALLEDRULES_HPP
+#define INSTALLEDRULES_HPP
+
+// local
+#include "policy.hpp"
+#include "policydiff.hpp"
+#include "ruletable.hpp"
+
+// std
+#include <utility>
+
+/// Index of the rules installed on the pc, shared by all sheets of a PolicySheet.
+/// Loaded from the registry the first time it is needed, or when reloaded explicitly;
+/// after a successful apply the sheets update it with the applied plan.
+class InstalledRules {
+public:
+	policy::PolicyDiff& get(){
+		if(!loaded){
+			reload(policy::getLoadedRuleTable(HKEY_LOCAL_MACHINE));
+		}
+		return rules;
+	}
+	void reload(policy::RuleTable table){
+		rules = policy::PolicyDiff(std::move(table));
+		loaded = true;
+	}
+
+private:
+	policy::PolicyDiff rules;
+	bool loaded = false;
+};
+
+#endif // INSTALLEDRULES_HPP
@@ -19,13 +19,48 @@
 #include "ui_policyeventlog.h"
 
 
-#include <QXmlStreamReader>
+#include <QHeaderView>
+#include <QStringList>
+#include <QStandardPaths>
+#include <QDir>
+#include <QDateTime>
+
+#include <utility>
+#include <limits>
 
 PolicyEventLog::PolicyEventLog(QWidget *parent) :
 	SinglePolicySheetInterface(parent),
-	ui(new Ui::PolicyEventLog)
+	ui(new Ui::PolicyEventLog),
+	model(100000) // about a day of a block storm, older events are dropped
 {
 	ui->setupUi(this);
+	ui->label_dropped->hide();
+	ui->tableView->setModel(&model);
+	ui->tableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed); // otherwise the view measures every row
+	ui->tableView->sortByColumn(BlockedEventModel::time, Qt::DescendingOrder);
+	connect(&timer, &QTimer::timeout, this, &PolicyEventLog::drain_events);
+	timer.start(16); // once per frame
+	connect(&hitstimer, &QTimer::timeout, this, &PolicyEventLog::update_hits);
+	hitstimer.start(5000);
+
+	// history of the last day, from the previous sessions
+	const auto dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+	if(!dir.isEmpty() && QDir().mkpath(dir)){
+		try{
+			journal = std::make_unique<evtlog::Journal>(QDir(dir).filePath("events.journal").toStdString());
+			const std::int64_t day = 24LL * 3600 * 1000000;
+			const std::int64_t now = QDateTime::currentMSecsSinceEpoch() * 1000;
+			for(const auto& event : journal->query(now - day, (std::numeric_limits<std::int64_t>::max)())){
+				aggregator.add(event);
+				model.append() = event;
+			}
+			model.commit();
+		} catch(const std::runtime_error&){
+			journal.reset();
+		}
+	}
+	connect(&journaltimer, &QTimer::timeout, this, &PolicyEventLog::flush_journal);
+	journaltimer.start(60000); // events not on disk are delivered again after a restart
 }
 
 PolicyEventLog::~PolicyEventLog()
@@ -33,42 +68,67 @@ PolicyEventLog::~PolicyEventLog()
 	delete ui;
 }
 
-void PolicyEventLog::on_text_updated(QString text){
-	QXmlStreamReader xml(text);
-	QString attemptedpath;
-	QString time;
-	QString GUUID;
-	QString rulepath;
-	QString user;
-	while(!xml.atEnd() && !xml.hasError()){
-		//ui->textEdit->append(xml.name().toString() + " -||- " + xml.text().toString() + "-||-" + xml.tokenString());
-		//xml.readNext();
+void PolicyEventLog::subscribe(){
+	RAII_EVTHANDLE bookmark;
+	const auto after = journal ? journal->bookmark() : 0;
+	if(after != 0){
+		bookmark.reset(EvtCreateBookmark(s2ws(evtlog::bookmark_xml(ws2s(pwsPath), after)).c_str()));
+	}
+	const auto flags = bookmark ? EvtSubscribeStartAfterBookmark : EvtSubscribeStartAtOldestRecord;
+	subscription.hSubscription.reset(EvtSubscribe(nullptr, nullptr, pwsPath, pwsQuery, bookmark.get(), &subscription, QtSubscriptionCallback, flags));
+}
 
-		/**/
-		if(xml.name()=="TimeCreated" && xml.tokenType() == QXmlStreamReader::TokenType::StartElement){
-			time = xml.attributes().value("SystemTime").toString();
-		}
-		if(xml.name()=="AttemptedPath" && xml.tokenType() == QXmlStreamReader::TokenType::StartElement){
-			xml.readNext();
-			attemptedpath = xml.text().toString();
-		}
-		if(xml.name()=="SrpRuleGuid" && xml.tokenType() == QXmlStreamReader::TokenType::StartElement){
-			xml.readNext();
-			GUUID = xml.text().toString();
-		}
-		if(xml.name()=="RulePath" && xml.tokenType() == QXmlStreamReader::TokenType::StartElement){
-			xml.readNext();
-			rulepath = xml.text().toString();
-		}
-		if(xml.name()=="Security" && xml.tokenType() == QXmlStreamReader::TokenType::StartElement){
-			user = xml.attributes().value("UserID").toString();
-			const auto userpath = evtlog::sid_to_username(user.toStdString());
-			if(!userpath.first.empty()){
-				user = QString::fromStdString(userpath.first);
+void PolicyEventLog::flush_journal(){
+	if(!journal){
+		return;
+	}
+	try{
+		journal->flush();
+	} catch(const std::runtime_error&){
+		journal.reset();
+	}
+}
+
+void PolicyEventLog::drain_events(){
+	const std::size_t maxperupdate = 2000; // the rest on the next update, so that the gui stays responsive
+	const auto received = subscription.events.drain([this](evtlog::BlockedEvent& event){
+		aggregator.add(event);
+		if(journal){
+			try{
+				journal->append(event);
+			} catch(const std::runtime_error&){
+				journal.reset();
 			}
 		}
-		xml.readNext();
-		/**/
+		using std::swap;
+		swap(model.append(), event); // the ring gets the memory of the oldest event
+	}, maxperupdate);
+	if(received != 0){
+		model.commit();
+	}
+	const std::size_t totaldropped = subscription.dropped.load();
+	if(totaldropped != dropped){
+		dropped = totaldropped;
+		ui->label_dropped->setText(QString::number(dropped) + tr(" events have been dropped"));
+		ui->label_dropped->setVisible(true);
+	}
+}
+
+void PolicyEventLog::update_hits(){
+	// without new events the window would stay at the last event
+	aggregator.advance(QDateTime::currentMSecsSinceEpoch() * 1000);
+	if(aggregator.total() == 0){
+		ui->label_hits->clear();
+		return;
+	}
+	const std::size_t maxrules = 5;
+	QStringList rules;
+	// only the keys of the most used rules are read, not the whole Safer tree
+	policy::policy_s rule;
+	for(const auto& h : aggregator.top(evtlog::Aggregator::dimension::rule, maxrules)){
+		if(policy::getLoadedRule(HKEY_LOCAL_MACHINE, h.key, rule)){
+			rules.append(QString::fromStdString(rule.pol.ItemData) + " (" + QString::number(h.count) + ")");
+		}
 	}
-	ui->textEdit->append("The access to \"" + attemptedpath +"\" has been limited by "+ user +" on " + time +", with the rule \""+rulepath+"\" (" + GUUID +")");
+	ui->label_hits->setText(tr("Most used rules in the last hour: ") + rules.join(", "));
 }
@@ -19,34 +19,33 @@
 #define POLICYEVENTLOG_HPP
 
 #include "evtlog.hpp"
+#include "blockedevent.hpp"
+#include "spscring.hpp"
 #include "singlepolicysheetinterface.hpp"
+#include "blockedeventmodel.hpp"
+#include "aggregator.hpp"
+#include "journal.hpp"
 
 #include <QWidget>
 #include <QString>
+#include <QTimer>
+
+#include <atomic>
+#include <memory>
 
 namespace Ui {
 	class PolicyEventLog;
 }
 
-class EmptyQObject : public QObject {
-	Q_OBJECT
-public:
-	EmptyQObject(){}
-signals:
-	void updateText(QString str);
-public:
-   void emitMySignal(const QString& text){
-	   emit updateText(text);
-   }
-
-};
-
 const auto pwsPath = L"Application";// L"<channel name goes here>";
 const auto pwsQuery = L"*[System/EventID=866]";//  nullptr;// L"<xpath query goes here>";
 
+// events are parsed on the thread of the subscription, and passed to the gui through a ring, without locks or queued signals
 struct subscriptionQt {
 	const std::size_t check = typeid(*this).hash_code();
-	std::unique_ptr<EmptyQObject> obj;
+	SpscRing<evtlog::BlockedEvent> events{8192};
+	std::atomic<std::size_t> dropped{0}; // events lost because the ring was full
+	evtlog::RenderContext render;
 	RAII_EVTHANDLE hSubscription;
 };
 
@@ -69,8 +68,13 @@ inline DWORD WINAPI QtSubscriptionCallback(const EVT_SUBSCRIBE_NOTIFY_ACTION act
 				break;
 			}
 			case EvtSubscribeActionDeliver: {
-				const auto var = evtlog::get_rendered_content(hEvent);
-				sub->obj->emitMySignal(QString::fromStdString(var));
+				const auto& xml = sub->render.render(hEvent);
+				const auto slot = sub->events.reserve();
+				if(slot == nullptr){
+					++sub->dropped;
+				} else if(evtlog::parse_event(xml, *slot)){
+					sub->events.commit();
+				}
 				break;
 			}
 			default: {
@@ -107,12 +111,25 @@ public:
 	virtual QString getName() const override{return "EventLog";}
 	virtual bool isPcSetting() const override{return true;}
 	subscriptionQt subscription;
+	// subscribes to the events after the last one in the journal, or to all events
+	void subscribe();
 
 private:
 	Ui::PolicyEventLog *ui;
-
-public slots:
-	void on_text_updated(QString text);
+	BlockedEventModel model;
+	evtlog::Aggregator aggregator; // last hour
+	QTimer timer;
+	QTimer hitstimer;
+	std::unique_ptr<evtlog::Journal> journal; // nullptr if it cannot be used
+	QTimer journaltimer;
+	std::size_t dropped = 0;
+
+private slots:
+	// adds the events received since the last call to the model, with one update of the view
+	void drain_events();
+	// shows the rules with most blocks in the last hour
+	void update_hits();
+	void flush_journal();
 };
 
 #endif // POLICYEVENTLOG_HPP
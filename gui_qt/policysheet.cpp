@@ -25,6 +25,7 @@
 #include "policysetting.hpp"
 #include "registry.hpp"
 #include "policy.hpp"
+#include "ruletable.hpp"
 #include "IniParser.hpp"
 #include "qtcommon.hpp"
 
@@ -40,6 +41,9 @@
 #include <cassert>
 #include <algorithm>
 #include <memory>
+#include <vector>
+#include <string>
+#include <utility>
 
 // FIXME: update policy name in tab
 
@@ -67,27 +71,29 @@ PolicySheet::~PolicySheet()
 void PolicySheet::on_pushButton_load_policies_clicked() {
 	// need to load all the policies, create SinglePolicySheets, and add them to the tabWidget
 	try{
-		auto policies = policy::getLoadedRules(HKEY_LOCAL_MACHINE);
-		auto groupedpolicies = policy::groupbyname(std::move(policies));
+		// rules are grouped in the table, policy_s are only created for the groups that are not double-ext
+		auto rules = policy::getLoadedRuleTable(HKEY_LOCAL_MACHINE);
+		auto groupedpolicies = rules.groupbyname();
 
 
-		const auto policiesdoubleext = policy::removedoubleext(groupedpolicies);
+		const auto policiesdoubleext = rules.removedoubleext(groupedpolicies);
 
 		std::vector<SinglePolicySheetInterface*> singlepolicysheets;
 		singlepolicysheets.reserve(groupedpolicies.size() + policiesdoubleext.size());
 
 		for(const auto& v : policiesdoubleext){
-			auto sheet = new SinglePolicySheetDoubleExt(true, v, this);
+			auto sheet = new SinglePolicySheetDoubleExt(true, installed, v, this);
 			singlepolicysheets.push_back(sheet);
 		}
 
 		for(const auto& v : groupedpolicies){
-			auto sheet = new SinglePolicySheet(true, v, this);
+			auto sheet = new SinglePolicySheet(true, installed, rules.to_vector(v), this);
 			singlepolicysheets.push_back(sheet);
 		}
 
 
 		// no error happened during reading and creating the sheets, i can swap the policies (hopefully noexcept)
+		installed.reload(std::move(rules)); // the same rules, indexed once for all applies
 
 		// NOTE: If policy did not change, and I've selected it, I'll remove focus... could make comparison and remove/replace... but can get really complicated
 		// FIXME: using set_diff i could see if two groups are similar  (25% diff?) and perhaps update them
@@ -128,17 +134,16 @@ void PolicySheet::on_pushButton_load_file_clicked() {
 	lastusedpath = QFileInfo(fileNames[0]).path(); // store path for next time
 	// create policies from every config file
 
-	policy::policiesfromini polsfromini;
-	for(const auto& v : fileNames){ // parse every file
-		auto rules =  policy::loadrulesfromini(v.toStdString());
-		polsfromini.policies.insert(polsfromini.policies.end(), rules.policies.begin(), rules.policies.end());
-		polsfromini.doubleextpol.insert(polsfromini.doubleextpol.begin(), rules.doubleextpol.begin(), rules.doubleextpol.end());
-		std::move(rules.settings.begin(), rules.settings.end(), std::back_inserter(polsfromini.settings)); // FIXME: need to move since myoptional is an unique_ptr
+	std::vector<std::string> files;
+	files.reserve(static_cast<std::size_t>(fileNames.size()));
+	for(const auto& v : fileNames){
+		files.push_back(v.toStdString());
 	}
+	const auto polsfromini = policy::loadrulesfromfiles(files); // files are parsed in parallel
 
 	int i = 1; // NOTE: not really unique if open multiple files in different moments
 	for(const auto& v : polsfromini.policies){
-		auto sheet = new SinglePolicySheet(false, v, this);
+		auto sheet = new SinglePolicySheet(false, installed, v, this);
 		const auto name = v.at(0).pol.name;
 		const auto pos = ui->tabWidget->addTab(sheet, !name.empty() ? QString::fromStdString(name) : "Policy " + QString::number(i++));
 		if(name.empty()){
@@ -147,7 +152,7 @@ void PolicySheet::on_pushButton_load_file_clicked() {
 	}
 
 	for(const auto& v : polsfromini.doubleextpol){
-		auto sheet = new SinglePolicySheetDoubleExt(false, v, this);
+		auto sheet = new SinglePolicySheetDoubleExt(false, installed, v, this);
 		const auto name = v.name;
 		const auto pos = ui->tabWidget->addTab(sheet, !name.empty() ? QString::fromStdString(name) : "Policy " + QString::number(i++));
 		if(name.empty()){
@@ -175,11 +180,11 @@ void PolicySheet::on_pushButton_newpolicy_clicked(){
 	}
 	const auto sel = id.textValue();
 	if(sel == options[0]){
-		auto sheet = new SinglePolicySheet(false, this);
+		auto sheet = new SinglePolicySheet(false, installed, this);
 		const auto pos = ui->tabWidget->addTab(sheet, "New Policy");
 		ui->tabWidget->tabBar()->setTabTextColor(pos, Qt::gray);
 	} else if(sel == options[1]){
-		auto sheet = new SinglePolicySheetDoubleExt(false,{}, this);
+		auto sheet = new SinglePolicySheetDoubleExt(false, installed, {}, this);
 		const auto pos = ui->tabWidget->addTab(sheet, "New Policy");
 		ui->tabWidget->tabBar()->setTabTextColor(pos, Qt::gray);
 	} else if(sel == options[2]){
@@ -226,10 +231,7 @@ void PolicySheet::on_tabWidget_tabCloseRequested(const int index){
 void PolicySheet::on_pushButton_loadlog_clicked(){
 	if(evtlog == nullptr){
 		auto sheet = new PolicyEventLog;
-		sheet->subscription.obj = std::make_unique<EmptyQObject>();
-
-		sheet->subscription.hSubscription.reset(EvtSubscribe(nullptr, nullptr, pwsPath, pwsQuery, nullptr, &(sheet->subscription), QtSubscriptionCallback, EvtSubscribeStartAtOldestRecord));
-		QObject::connect(sheet->subscription.obj.get(), &EmptyQObject::updateText, sheet, &PolicyEventLog::on_text_updated);
+		sheet->subscribe();
 
 		evtlog = sheet;
 		ui->tabWidget->addTab(evtlog, evtlog->getName());
@@ -19,6 +19,7 @@
 #define POLICYSHEET_H
 
 // local
+#include "installedrules.hpp"
 
 // windows
 
@@ -65,6 +66,7 @@ private:
 	PolicyEventLog* evtlog = nullptr;
 //	std::unique_ptr<PolicyEventLog> evtlog2 = nullptr;
 	PolicySetting* pcsetting = nullptr;
+	InstalledRules installed; // shared by all sheets, rebuilt only when loading the policies of the pc
 };
 
 #endif // POLICYSHEET_H
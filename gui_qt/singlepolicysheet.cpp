@@ -21,6 +21,8 @@
 
 // local
 #include "policy.hpp"
+#include "policydiff.hpp"
+#include "ruletable.hpp"
 #include "uuid.hpp"
 
 #include "diffdialog.hpp"
@@ -43,6 +45,17 @@ namespace {
 
 	std::vector<policy::policy_s> table_to_rules(const std::string& name, QTableWidget& table){
 		std::vector<policy::policy_s> rules; rules.reserve(table.rowCount());
+		// UUIDs for rows without one, generated all at once
+		std::size_t missing = 0;
+		for(int row = 0; row != table.rowCount(); ++row){
+			const auto theItem3 = table.item(row, 3);
+			if(theItem3 == nullptr || theItem3->text().isEmpty()){
+				++missing;
+			}
+		}
+		const auto newuuids = uid::generatestrings(missing);
+		auto nextuuid = newuuids.begin();
+		const policy::Atom atomname(name); // interned once, not once per row
 		for(int row = 0; row != table.rowCount(); ++row){
 			const auto theItem0 = table.item(row, 0);
 			if(theItem0 == nullptr || theItem0->text().isEmpty()){continue;}
@@ -57,12 +70,12 @@ namespace {
 			const auto theItem3 = table.item(row, 3);
 			auto UUID = (theItem3 != nullptr) ? theItem3->text().toStdString() : "";
 			policy::policy_s p_rule;
-			p_rule.pol.name = name;
+			p_rule.pol.name = atomname;
 			p_rule.pol.Description = Description;
 			p_rule.pol.ItemData = ItemData;
 			p_rule.pol.ItemDataType = registry::regtype::expand_sz;
 			if(UUID.empty()){
-				UUID = uid::to_string(uid::createUUID());
+				UUID = *nextuuid++;
 				table.setItem(row,3,new QTableWidgetItem(QString::fromStdString(UUID)));
 			}
 			p_rule.UUID = UUID;
@@ -94,8 +107,8 @@ namespace {
 	}
 }
 
-SinglePolicySheet::SinglePolicySheet(bool isPcPolicy, const std::vector<policy::policy_s>& policies, QWidget *parent) :
-	SinglePolicySheet(isPcPolicy, parent)
+SinglePolicySheet::SinglePolicySheet(bool isPcPolicy, InstalledRules& installed, const std::vector<policy::policy_s>& policies, QWidget *parent) :
+	SinglePolicySheet(isPcPolicy, installed, parent)
 {
 	if(!policies.empty()){
 		addElements(policies);
@@ -105,10 +118,10 @@ SinglePolicySheet::SinglePolicySheet(bool isPcPolicy, const std::vector<policy::
 
 }
 
-SinglePolicySheet::SinglePolicySheet(bool isPcSetting, QWidget *parent) :
+SinglePolicySheet::SinglePolicySheet(bool isPcSetting, InstalledRules& installed, QWidget *parent) :
 	SinglePolicySheetInterface(parent),
 	ui(new Ui::SinglePolicySheet),
-	m_isPcSetting(isPcSetting)
+	m_isPcSetting(isPcSetting), installed(installed)
 {
 	ui->setupUi(this);
 	assert(ui->tableWidget->columnCount() == 4); // Rule, Description, SecurityLevel, (hidden) UUID
@@ -154,56 +167,43 @@ void SinglePolicySheet::on_pushButton_apply_clicked() {
 		const auto name = ui->lineEdit_policy_name->text().toStdString();
 
 		// get all elements from the tables and generate list<policy> (and create UUID if not present)
-		auto rules = table_to_rules(name, *(ui->tableWidget));
-
-		// get policies in the pc
-		auto policies = policy::getLoadedRules(HKEY_LOCAL_MACHINE);
-
-		// remove policies with different names -- FIXME if name is empty
-		policies.erase(std::remove_if(policies.begin(), policies.end(), [&name](const policy::policy_s& p){
-			return p.pol.name != name;
-		}), policies.end());
-
-		auto& policygroupfrompc = policies;
-
-		const policy::Compare_policy_s comp;
-		// sort (need for applying diff)
-		std::sort(rules.begin(), rules.end(), comp);
-		std::sort(policygroupfrompc.begin(), policygroupfrompc.end(), comp);
-
-
-		// apply diff
-		std::vector<policy::policy_s> toadd;
-		std::set_difference(rules.begin(), rules.end(), policygroupfrompc.begin(), policygroupfrompc.end(),
-							std::back_inserter(toadd), comp);
+		const auto rules = table_to_rules(name, *(ui->tableWidget));
 
-		std::vector<policy::policy_s> toremove;
-		std::set_difference(policygroupfrompc.begin(), policygroupfrompc.end(), rules.begin(), rules.end(),
-							std::back_inserter(toremove), comp);
+		// policies in the pc, only the rules with the same name are compared
+		auto& index = installed.get();
+		const auto plan = index.diff(rules, name);
 
-		if(toadd.empty() && toremove.empty()){
+		if(plan.empty()){
 			QMessageBox::information(nullptr, tr("Info"), tr("There are no changes to apply."));
 			return;
 		}
 
+		const auto describe = [&name](const policy::policy_s& v){
+			return name + " | " + v.pol.ItemData + " | " + v.pol.Description + " | " + policy::to_string(v.sec);
+		};
 
 		policy::PolicyManager p;
+		p.Execute(plan);
 		DiffDialog d("Single Policy diff");
 
-		if(!toremove.empty()){
+		if(!plan.toremove.empty() || !plan.tomodify.empty()){
 			d.addTextTobeRemoved();
-			for(const auto& v : toremove){
-				p.RemovePolicy(v.sec, v.UUID);
-				d.addTextTobeRemoved(name + " | " + v.pol.ItemData + " | " + v.pol.Description + " | " + policy::to_string(v.sec) );
+			for(const auto& v : plan.toremove){
+				d.addTextTobeRemoved(describe(v));
+			}
+			for(const auto& v : plan.tomodify){
+				d.addTextTobeRemoved(describe(v.from));
 			}
 			d.addPlaintext("\n");
 		}
 
-		if(!toadd.empty()){
+		if(!plan.toadd.empty() || !plan.tomodify.empty()){
 			d.addTextToBeAdded();
-			for(const auto& v : toadd){
-				p.SetPolicy(v.pol, v.sec, v.UUID);
-				d.addTextToBeAdded(name + " | " + v.pol.ItemData + " | " + v.pol.Description + " | " + policy::to_string(v.sec) );
+			for(const auto& v : plan.tomodify){
+				d.addTextToBeAdded(describe(v.to));
+			}
+			for(const auto& v : plan.toadd){
+				d.addTextToBeAdded(describe(v));
 			}
 		}
 
@@ -214,7 +214,9 @@ void SinglePolicySheet::on_pushButton_apply_clicked() {
 
 		if(!p.Apply()){
 			QMessageBox::warning(nullptr, tr("Warning"), tr("Unable to apply policies."));
+			return;
 		}
+		index.update(plan);
 	} catch(const std::runtime_error& err){
 		show_warning(err);
 	}
@@ -21,6 +21,7 @@
 // local
 #include "policy.hpp"
 #include "singlepolicysheetinterface.hpp"
+#include "installedrules.hpp"
 
 // windows
 
@@ -41,8 +42,8 @@ class SinglePolicySheet final : public SinglePolicySheetInterface
 	Q_OBJECT
 
 public:
-	explicit SinglePolicySheet(bool isPcSetting, const std::vector<policy::policy_s>& policies, QWidget *parent = nullptr);
-	explicit SinglePolicySheet(bool isPcSetting, QWidget *parent = nullptr);
+	explicit SinglePolicySheet(bool isPcSetting, InstalledRules& installed, const std::vector<policy::policy_s>& policies, QWidget *parent = nullptr);
+	explicit SinglePolicySheet(bool isPcSetting, InstalledRules& installed, QWidget *parent = nullptr);
 	virtual ~SinglePolicySheet();
 
 	virtual QString getName() const override;
@@ -58,6 +59,7 @@ private slots:
 private:
 	Ui::SinglePolicySheet *ui;
 	bool m_isPcSetting;
+	InstalledRules& installed; // owned by the PolicySheet
 };
 
 #endif // SINGLEPOLICYSHEET_H
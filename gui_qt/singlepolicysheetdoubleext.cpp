@@ -21,6 +21,7 @@
 
 // local
 #include "policy.hpp"
+#include "policydiff.hpp"
 #include "uuid.hpp"
 #include "common.hpp"
 #include "diffdialog.hpp"
@@ -37,9 +38,18 @@
 #include <algorithm>
 #include <iterator>
 #include <fstream>
+#include <vector>
 
 namespace {
 
+	// like policy::CompareByRule, for rules and patterns
+	struct ByRule {
+		static const std::string& text(const std::string& s) { return s; }
+		static const std::string& text(const policy::policy_s& p) { return p.pol.ItemData; }
+		template<class T1, class T2>
+		bool operator()(const T1& l, const T2& r) const { return text(r) < text(l); }
+	};
+
 	policy::doubleext to_rules(const std::string& name, const std::string& description, const QTextEdit& ted1, const QTextEdit& ted2){
 		policy::doubleext d;
 		d.name = name;
@@ -64,10 +74,10 @@ namespace {
 	}
 }
 
-SinglePolicySheetDoubleExt::SinglePolicySheetDoubleExt(bool isPcSetting, const policy::doubleext& policies, QWidget *parent) :
+SinglePolicySheetDoubleExt::SinglePolicySheetDoubleExt(bool isPcSetting, InstalledRules& installed, const policy::doubleext& policies, QWidget *parent) :
 	SinglePolicySheetInterface(parent),
 	ui(new Ui::SinglePolicySheetDoubleExt),
-	m_isPcSetting(isPcSetting), description(policies.description)
+	m_isPcSetting(isPcSetting), installed(installed), description(policies.description)
 {
 	ui->setupUi(this);
 	ui->lineEdit_policy_name->setText(QString::fromStdString(policies.name));
@@ -91,24 +101,21 @@ void SinglePolicySheetDoubleExt::on_pushButton_apply_clicked() {
 		const auto doublerules = to_rules(ui->lineEdit_policy_name->text().toStdString(), this->description, *(ui->textEdit_ext1), *(ui->textEdit_ext1));
 		auto exts = combineext(doublerules.ext1, doublerules.ext2);
 
-		// get policies in the pc
-		auto policies = policy::getLoadedRules(HKEY_LOCAL_MACHINE);
+		// get policies in the pc with the same name, sorted like CompareByRule (need for applying diff)
+		auto& index = installed.get();
+		const policy::Atom name(doublerules.name);
+		const policy::Atom description(doublerules.description);
+		auto policygroupfrompc = index.group(name);
 
-		// remove policies with different names, description, and securitylevel
-		policies.erase(std::remove_if(policies.begin(), policies.end(),
-					   [&doublerules](const policy::policy_s p){
-			return p.pol.name != doublerules.name || p.pol.Description != doublerules.description || p.sec != doublerules.sec;
-		}),
-		policies.end()
-		);
+		// remove policies with different description and securitylevel
+		policygroupfrompc.erase(std::remove_if(policygroupfrompc.begin(), policygroupfrompc.end(), [&](const policy::policy_s& v){
+			return v.pol.Description != description || v.sec != doublerules.sec;
+		}), policygroupfrompc.end());
 		// FIXME: check that these policies are from the same group! (use smatch), separate them in groups
 
-		auto& policygroupfrompc = policies;
-
-		const policy::CompareByRule comp;
-		// sort (need for applying diff)
-		std::sort(exts.begin(), exts.end(), comp);
+		const ByRule comp;
 		std::sort(policygroupfrompc.begin(), policygroupfrompc.end(), comp);
+		std::sort(exts.begin(), exts.end(), comp);
 
 
 		// apply diff
@@ -116,23 +123,20 @@ void SinglePolicySheetDoubleExt::on_pushButton_apply_clicked() {
 		std::set_difference(exts.begin(), exts.end(), policygroupfrompc.begin(), policygroupfrompc.end(),
 							std::back_inserter(toadd), comp);
 
-
-		std::vector<policy::policy_s> toremove;
+		policy::changeplan plan;
 		std::set_difference(policygroupfrompc.begin(), policygroupfrompc.end(), exts.begin(), exts.end(),
-							std::back_inserter(toremove), comp);
+							std::back_inserter(plan.toremove), comp);
 
-		if(toadd.empty() && toremove.empty()){
+		if(toadd.empty() && plan.toremove.empty()){
 			QMessageBox::information(nullptr, tr("Info"), tr("There are no changes to apply."));
 			return;
 		}
 
 
-		policy::PolicyManager p;
 		DiffDialog diff("DoubleExtension diff");
-		if(!toremove.empty()){
+		if(!plan.toremove.empty()){
 			diff.addTextTobeRemoved();
-			for(const auto& v : toremove){
-				p.RemovePolicy(v.sec, v.UUID);
+			for(const auto& v : plan.toremove){
 				diff.addTextTobeRemoved(v.pol.name + " | " + v.pol.ItemData + " | " + v.pol.Description + " | " + policy::to_string(v.sec) );
 			}
 			diff.addPlaintext("\n");
@@ -140,16 +144,23 @@ void SinglePolicySheetDoubleExt::on_pushButton_apply_clicked() {
 
 		if(!toadd.empty()){
 			diff.addTextToBeAdded();
-			for(const auto& v : toadd){
-				policy::policy_rule rule;
-				rule.name = doublerules.name;
-				rule.ItemData = v;
-				rule.Description = doublerules.description;
-				p.SetPolicy( rule, doublerules.sec);
-				diff.addTextToBeAdded(rule.name + " | " + rule.ItemData + " | " + rule.Description + " | " + policy::to_string(doublerules.sec) );
+			// the UUIDs are needed for keeping the installed rules in sync after applying
+			const auto uuids = uid::generatestrings(toadd.size());
+			plan.toadd.resize(toadd.size());
+			for(std::size_t i = 0; i != toadd.size(); ++i){
+				auto& rule = plan.toadd[i];
+				rule.pol.name = name;
+				rule.pol.ItemData = toadd[i];
+				rule.pol.Description = description;
+				rule.sec = doublerules.sec;
+				rule.UUID = uuids[i];
+				diff.addTextToBeAdded(rule.pol.name + " | " + rule.pol.ItemData + " | " + rule.pol.Description + " | " + policy::to_string(doublerules.sec) );
 			}
 		}
 
+		policy::PolicyManager p;
+		p.Execute(plan); // all keys are written with the same Paths handle
+
 		const auto res = diff.exec();
 		if(res != QDialog::Accepted){
 			return;
@@ -157,7 +168,9 @@ void SinglePolicySheetDoubleExt::on_pushButton_apply_clicked() {
 
 		if(!p.Apply()){
 			QMessageBox::warning(nullptr, "Warning", "Unable to apply policies.");
+			return;
 		}
+		index.update(plan);
 	} catch(const std::runtime_error& err){
 		show_warning(err);
 	}
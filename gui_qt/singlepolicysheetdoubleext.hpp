@@ -21,6 +21,7 @@
 // local
 #include "policy.hpp"
 #include "singlepolicysheetinterface.hpp"
+#include "installedrules.hpp"
 
 // windows
 
@@ -40,7 +41,7 @@ class SinglePolicySheetDoubleExt final : public SinglePolicySheetInterface
 	Q_OBJECT
 
 public:
-	explicit SinglePolicySheetDoubleExt(bool isPcSetting, const policy::doubleext& policies, QWidget *parent = nullptr);
+	explicit SinglePolicySheetDoubleExt(bool isPcSetting, InstalledRules& installed, const policy::doubleext& policies, QWidget *parent = nullptr);
 	virtual ~SinglePolicySheetDoubleExt();
 
 	virtual QString getName() const override;
@@ -53,6 +54,7 @@ private slots:
 private:
 	Ui::SinglePolicySheetDoubleExt *ui;
 	bool m_isPcSetting;
+	InstalledRules& installed; // owned by the PolicySheet
 	std::string description; // FIXME: should add a lineedit or something like that
 };
 
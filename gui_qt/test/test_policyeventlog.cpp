@@ -34,9 +34,6 @@ TEST_CASE("TestPolicyEventLog1", "[qt][policy][event][hide]"){
 	CREATE_FAKE_APPLICATION_WITH_NO_ARGS(a);
 
 	PolicyEventLog pel;
-	pel.subscription.obj = std::make_unique<EmptyQObject>();
-	QObject::connect(pel.subscription.obj.get(), &EmptyQObject::updateText, &pel, &PolicyEventLog::on_text_updated);
-
 	pel.subscription.hSubscription.reset(EvtSubscribe(nullptr, nullptr, pwsPath, pwsQuery, nullptr, &(pel.subscription), QtSubscriptionCallback, EvtSubscribeStartAtOldestRecord));
 
 	pel.show();
@@ -40,14 +40,16 @@ TEST_CASE("TestSinglePolicySheet1", "[qt][policy][sheet][single][hide]"){
 		p1.sec = policy::securitylevel::Disallowed;
 		pols.push_back(p1);
 	}
-	SinglePolicySheet pol(false, pols);
+	InstalledRules installed;
+	SinglePolicySheet pol(false, installed, pols);
 	pol.show();
 	a.exec();
 }
 
 TEST_CASE("TestSinglePolicySheet2", "[qt][policy][sheet][single][hide]"){
 	CREATE_FAKE_APPLICATION_WITH_NO_ARGS(a);
-	SinglePolicySheet pol(false, {});
+	InstalledRules installed;
+	SinglePolicySheet pol(false, installed, {});
 	pol.show();
 	a.exec();
 }
@@ -59,7 +61,8 @@ TEST_CASE("TestSinglePolicySheet3", "[qt][policy][sheet][single][hide]"){
 	p1.pol.ItemData = "*.doc.exe";
 	p1.pol.Description = "Description of " + p1.pol.name;
 	p1.sec = policy::securitylevel::Unrestricted;
-	SinglePolicySheet pol(true, {p1});
+	InstalledRules installed;
+	SinglePolicySheet pol(true, installed, {p1});
 	pol.show();
 	a.exec();
 }
@@ -36,7 +36,8 @@ TEST_CASE("TestSinglePolicySheetDoubleExt1", "[qt][policy][sheet][single][double
 	de.name = "TestPolicy1";
 	de.description = "Description of " + de.name;
 	de.sec = policy::securitylevel::Unrestricted;
-	SinglePolicySheetDoubleExt pol(false, de);
+	InstalledRules installed;
+	SinglePolicySheetDoubleExt pol(false, installed, de);
 	pol.show();
 	app.exec();
 }
@@ -50,7 +51,8 @@ TEST_CASE("TestSinglePolicySheetDoubleExt3", "[qt][policy][sheet][single][double
 	de.name = "TestPolicy1";
 	de.description = "Description of " + de.name;
 	de.sec = policy::securitylevel::Unrestricted;
-	SinglePolicySheetDoubleExt pol(true, de);
+	InstalledRules installed;
+	SinglePolicySheetDoubleExt pol(true, installed, de);
 	pol.show();
 	app.exec();
 }
@@ -16,6 +16,7 @@
 */
 
 #include "IniParser.hpp"
+#include "initokenizer.hpp"
 
 #include <cctype>
 #include <iostream>
@@ -23,6 +24,7 @@
 #include <cassert>
 #include <algorithm>
 #include <stdexcept>
+#include <cstring>
 
 
 namespace iniparser {
@@ -161,4 +163,174 @@ namespace iniparser {
 		return content.at(section).count(property) > 0;
 	}
 
+
+	namespace {
+		bool isspace_(const char c) {
+			return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v';
+		}
+
+		strview trim(strview s) {
+			const char* b = s.begin();
+			const char* e = s.end();
+			while (b != e && isspace_(*b)) {
+				++b;
+			}
+			while (e != b && isspace_(*(e - 1))) {
+				--e;
+			}
+			return strview(b, static_cast<std::size_t>(e - b));
+		}
+
+		constexpr std::size_t npos = static_cast<std::size_t>(-1);
+	}
+
+	MappedIniParser::MappedIniParser(const std::string& iniFile) : file(iniFile) {
+		const char* const data = file.data();
+		const std::size_t size = file.size();
+
+		// all delimiters are found in a single pass, lines are then processed by looking only at their tokens
+		std::vector<std::size_t> tokens;
+		tokens.reserve(size / 8);
+		tokenize(data, size, tokens);
+		const auto ntokens = tokens.size();
+
+		std::vector<strview> sectionnames;
+		strview currentsection;
+		bool hasunnamedsection = false;
+		bool inmultiline = false;
+		std::size_t t = 0; // first token of the current line
+		for (std::size_t pos = 0; pos < size; ) {
+			auto tl = t;
+			while (tl != ntokens && data[tokens[tl]] != '\n') {
+				++tl;
+			}
+			const std::size_t e = (tl != ntokens) ? tokens[tl] : size;
+			std::size_t b = pos;
+			std::size_t k = t; // tokens of the line are [k, tl)
+			pos = e + 1;
+			t = (tl != ntokens) ? tl + 1 : tl;
+
+			if (inmultiline) { // look for "*/"
+				while (k != tl && !(data[tokens[k]] == '/' && tokens[k] > b && data[tokens[k] - 1] == '*')) {
+					++k;
+				}
+				if (k == tl) {
+					continue;
+				}
+				inmultiline = false;
+				b = tokens[k] + 1;
+				++k;
+			}
+			std::size_t comment = e;
+			auto kc = k;
+			for (; kc != tl; ++kc) {
+				const auto o = tokens[kc];
+				if (data[o] == ';' || data[o] == '#' || (data[o] == '/' && o + 1 != e && (data[o + 1] == '/' || data[o + 1] == '*'))) {
+					comment = o;
+					break;
+				}
+			}
+			if (comment != e && data[comment] == '/' && data[comment + 1] == '*') {
+				inmultiline = true;
+				for (auto kk = kc + 1; kk != tl; ++kk) {
+					const auto o = tokens[kk];
+					if (data[o] == '/' && o >= comment + 3 && data[o - 1] == '*') {
+						inmultiline = false;
+						break;
+					}
+				}
+			}
+			const auto line = trim(strview(data + b, comment - b));
+			if (line.empty()) {
+				continue;
+			}
+
+			if (line[0] == '[' && line[line.size() - 1] == ']') {
+				currentsection = trim(line.substr(1, line.size() - 2));
+				sectionnames.push_back(currentsection);
+				continue;
+			}
+			auto ks = k;
+			while (ks != kc && data[tokens[ks]] != '=') {
+				++ks;
+			}
+			if (ks == kc) {
+				continue;
+			}
+			const auto sep = tokens[ks];
+			const auto property = trim(strview(line.data(), static_cast<std::size_t>(data + sep - line.data())));
+			auto value = trim(strview(data + sep + 1, static_cast<std::size_t>(line.end() - (data + sep + 1))));
+			std::size_t escbeg = npos;
+			std::size_t escend = npos;
+			for (auto kq = ks + 1; kq != kc; ++kq) {
+				if (data[tokens[kq]] == '"') {
+					escend = tokens[kq];
+					if (escbeg == npos) {
+						escbeg = escend;
+					}
+				}
+			}
+			if (escbeg != escend) {
+				value = strview(data + escbeg + 1, escend - (escbeg + 1));
+			}
+			if (currentsection.empty() && !hasunnamedsection) { // properties before the first section are in the unnamed section
+				sectionnames.push_back(currentsection);
+				hasunnamedsection = true;
+			}
+			table.push_back({ currentsection, property, value });
+		}
+
+		// stable, so that the first occurrence of a property is kept
+		std::stable_sort(table.begin(), table.end(), [](const entry& a, const entry& b) {
+			const auto res = a.section.compare(b.section);
+			return res < 0 || (res == 0 && a.property < b.property);
+		});
+		table.erase(std::unique(table.begin(), table.end(), [](const entry& a, const entry& b) {
+			return a.section == b.section && a.property == b.property;
+		}), table.end());
+
+		std::sort(sectionnames.begin(), sectionnames.end());
+		sectionnames.erase(std::unique(sectionnames.begin(), sectionnames.end()), sectionnames.end());
+		sectiontable.reserve(sectionnames.size());
+		auto it = table.begin();
+		for (const auto& name : sectionnames) {
+			const auto first = std::lower_bound(it, table.end(), name, [](const entry& a, const strview n) { return a.section < n; });
+			it = std::upper_bound(first, table.end(), name, [](const strview n, const entry& a) { return n < a.section; });
+			sectiontable.push_back({ name, static_cast<std::size_t>(first - table.begin()), static_cast<std::size_t>(it - first) });
+		}
+	}
+
+	const MappedIniParser::sectionentry* MappedIniParser::FindSection(const strview section) const {
+		const auto it = std::lower_bound(sectiontable.begin(), sectiontable.end(), section, [](const sectionentry& a, const strview n) { return a.name < n; });
+		return (it != sectiontable.end() && it->name == section) ? &*it : nullptr;
+	}
+
+	const MappedIniParser::entry* MappedIniParser::FindProperty(const sectionentry& section, const strview property) const {
+		const auto first = table.begin() + static_cast<std::ptrdiff_t>(section.first);
+		const auto last = first + static_cast<std::ptrdiff_t>(section.count);
+		const auto it = std::lower_bound(first, last, property, [](const entry& a, const strview p) { return a.property < p; });
+		return (it != last && it->property == property) ? &*it : nullptr;
+	}
+
+	const MappedIniParser::entry* MappedIniParser::FindProperty(const strview section, const strview property) const {
+		const auto s = FindSection(section);
+		return s == nullptr ? nullptr : FindProperty(*s, property);
+	}
+
+	strview MappedIniParser::GetValue(const strview section, const strview property) const {
+		const auto s = FindSection(section);
+		if (s == nullptr) {
+			throw std::runtime_error("Section \"" + section.to_string() + "\" not found");
+		}
+		const auto p = FindProperty(*s, property);
+		if (p == nullptr) {
+			throw std::runtime_error("Property \"" + property.to_string() + "\"not found");
+		}
+		return p->value;
+	}
+
+	strview MappedIniParser::GetValue(const strview section, const strview property, const strview defaultValue) const {
+		const auto p = FindProperty(section, property);
+		return p == nullptr ? defaultValue : p->value;
+	}
 }
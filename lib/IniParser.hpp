@@ -18,9 +18,13 @@
 #ifndef INIPARSER_HPP
 #define INIPARSER_HPP
 
+#include "mappedfile.hpp"
+
 #include <map>
 #include <string>
 #include <vector>
+#include <cstring>
+#include <cstddef>
 
 
 //FIXME: copied from old project, should polish it, remove multiline comments and so on
@@ -76,5 +80,86 @@ namespace iniparser {
 
 		std::pair<property, value> getPropVal(std::string &line, std::string::size_type sep);
 	};
+
+	/// non-owning reference to a sequence of characters, like std::string_view (not available in C++14)
+	class strview {
+		const char* ptr = nullptr;
+		std::size_t len = 0;
+	public:
+		strview() = default;
+		strview(const char* data, const std::size_t size) : ptr(data), len(size) {}
+		strview(const char* str) : ptr(str), len(std::strlen(str)) {}
+		strview(const std::string& str) : ptr(str.data()), len(str.size()) {}
+
+		const char* data() const { return ptr; }
+		std::size_t size() const { return len; }
+		bool empty() const { return len == 0; }
+		const char* begin() const { return ptr; }
+		const char* end() const { return ptr + len; }
+		char operator[](const std::size_t i) const { return ptr[i]; }
+
+		strview substr(const std::size_t pos, const std::size_t count) const { return strview(ptr + pos, count); }
+		std::string to_string() const { return std::string(ptr, len); }
+
+		int compare(const strview other) const {
+			const auto res = (len == 0 || other.len == 0) ? 0 : std::memcmp(ptr, other.ptr, len < other.len ? len : other.len);
+			if (res != 0) {
+				return res;
+			}
+			return len < other.len ? -1 : (len == other.len ? 0 : 1);
+		}
+	};
+	inline bool operator==(const strview a, const strview b) { return a.size() == b.size() && a.compare(b) == 0; }
+	inline bool operator!=(const strview a, const strview b) { return !(a == b); }
+	inline bool operator<(const strview a, const strview b) { return a.compare(b) < 0; }
+
+	/// Alternate parser for big files:
+	/// - the file is mapped in memory, and sections, properties and values are views into the mapping (no copies)
+	/// - all properties are stored in a single table sorted by section and property, lookups are binary searches
+	///
+	/// The format is the same of IniParser, with some differences since the lines are never modified:
+	/// - only leading and trailing spaces are removed, spaces inside names and values are preserved
+	/// - text after the end of a multiline comment (on the same line) is ignored if the comment started on the same line
+	/// If a property appears more than once in a section, the first one is used (like IniParser).
+	///
+	/// The object owns the mapping, the views are valid as long as the object exists (even if moved)
+	class MappedIniParser {
+	public:
+		struct entry {
+			strview section;
+			strview property;
+			strview value;
+		};
+		struct sectionentry {
+			strview name;
+			std::size_t first; // index in entries
+			std::size_t count;
+		};
+
+		/// throws std::runtime_error if the file cannot be read
+		explicit MappedIniParser(const std::string& iniFile);
+
+		/// sorted by name, also sections without properties are listed
+		const std::vector<sectionentry>& sections() const { return sectiontable; }
+		/// sorted by section and property
+		const std::vector<entry>& entries() const { return table; }
+
+		/// nullptr if not found
+		const sectionentry* FindSection(const strview section) const;
+		const entry* FindProperty(const sectionentry& section, const strview property) const;
+		const entry* FindProperty(const strview section, const strview property) const;
+
+		bool HasSection(const strview section) const { return FindSection(section) != nullptr; }
+		bool HasProperty(const strview section, const strview property) const { return FindProperty(section, property) != nullptr; }
+
+		/// throws std::runtime_error if not found
+		strview GetValue(const strview section, const strview property) const;
+		strview GetValue(const strview section, const strview property, const strview defaultValue) const;
+
+	private:
+		MappedFile file;
+		std::vector<entry> table;
+		std::vector<sectionentry> sectiontable;
+	};
 }
 #endif // INIPARSER_HPP
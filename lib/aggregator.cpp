@@ -0,0 +1,239 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "aggregator.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <limits>
+
+namespace evtlog {
+
+	namespace {
+		// FNV-1a with a final mix, the sketches derive their rows from the two halves
+		std::uint64_t hash(const char* data, const std::size_t size) {
+			std::uint64_t h = 14695981039346656037ULL;
+			for (std::size_t i = 0; i != size; ++i) {
+				h ^= static_cast<unsigned char>(data[i]);
+				h *= 1099511628211ULL;
+			}
+			h ^= h >> 33;
+			h *= 0xff51afd7ed558ccdULL;
+			h ^= h >> 33;
+			return h;
+		}
+
+		char fold(const char c) {
+			return c == '/' ? '\\' : ((c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c);
+		}
+
+		std::size_t index(const Aggregator::dimension d) {
+			return static_cast<std::size_t>(d);
+		}
+	}
+
+	CountMinSketch::CountMinSketch(const std::size_t width_, const std::size_t depth_) : width(width_), depth(depth_), counters(width_ * depth_) {
+		if (width == 0 || depth == 0) {
+			throw std::runtime_error("empty sketch");
+		}
+	}
+
+	void CountMinSketch::add(const std::uint64_t h, const std::uint32_t count) {
+		const auto h1 = static_cast<std::uint32_t>(h);
+		const auto h2 = static_cast<std::uint32_t>(h >> 32) | 1u;
+		for (std::size_t row = 0; row != depth; ++row) {
+			auto& c = counters[row * width + (h1 + row * h2) % width];
+			c = (c > (std::numeric_limits<std::uint32_t>::max)() - count) ? (std::numeric_limits<std::uint32_t>::max)() : c + count;
+		}
+	}
+
+	std::uint32_t CountMinSketch::estimate(const std::uint64_t h) const {
+		const auto h1 = static_cast<std::uint32_t>(h);
+		const auto h2 = static_cast<std::uint32_t>(h >> 32) | 1u;
+		auto toreturn = (std::numeric_limits<std::uint32_t>::max)();
+		for (std::size_t row = 0; row != depth; ++row) {
+			toreturn = (std::min)(toreturn, counters[row * width + (h1 + row * h2) % width]);
+		}
+		return toreturn;
+	}
+
+	void CountMinSketch::clear() {
+		std::fill(counters.begin(), counters.end(), 0u);
+	}
+
+	void SpaceSaving::add(const char* key, const std::size_t size, const std::uint64_t h) {
+		for (auto& i : items) {
+			if (i.hash == h && i.key.size() == size && i.key.compare(0, size, key, size) == 0) {
+				++i.count;
+				return;
+			}
+		}
+		if (items.size() < k) {
+			items.push_back({ std::string(key, size), h, 1 });
+			return;
+		}
+		// the new key takes the place of the least frequent one, and inherits its count as possible error
+		auto& min = *std::min_element(items.begin(), items.end(), [](const item& l, const item& r){ return l.count < r.count; });
+		min.key.assign(key, size);
+		min.hash = h;
+		++min.count;
+	}
+
+	Aggregator::Aggregator(const std::int64_t bucketmicroseconds, const std::size_t buckets, const std::size_t width, const std::size_t depth, const std::size_t topk)
+		: bucketsize(bucketmicroseconds), window(buckets) {
+		if (bucketmicroseconds <= 0 || buckets == 0 || topk == 0) {
+			throw std::runtime_error("invalid aggregator settings");
+		}
+		for (auto& b : window) {
+			b.sketches.assign(dimensions, CountMinSketch(width, depth));
+			b.hitters.assign(dimensions, SpaceSaving(topk));
+		}
+	}
+
+	std::string Aggregator::normalize(const dimension d, const std::string& key) {
+		std::string toreturn = key;
+		if (d == dimension::path) {
+			std::transform(toreturn.begin(), toreturn.end(), toreturn.begin(), fold);
+			while (toreturn.size() > 1 && toreturn.back() == '\\') {
+				toreturn.pop_back();
+			}
+		} else if (d == dimension::rule) {
+			uid::BinaryUUID u;
+			if (uid::BinaryUUID::parse(key.data(), key.size(), u)) {
+				toreturn = u.to_string();
+			}
+		}
+		return toreturn;
+	}
+
+	void Aggregator::count(bucket& b, const dimension d, const char* key, const std::size_t size, const bool candidate) {
+		const auto h = hash(key, size);
+		b.sketches[index(d)].add(h);
+		if (candidate) {
+			b.hitters[index(d)].add(key, size, h);
+		}
+	}
+
+	void Aggregator::advance(const std::int64_t now) {
+		latest = (std::max)(latest, bucketof(now));
+		for (auto& b : window) {
+			if (b.index >= 0 && !inwindow(b)) {
+				b.index = -1; // cleared by add when reused
+				b.events = 0;
+			}
+		}
+	}
+
+	void Aggregator::add(const BlockedEvent& e) {
+		const auto i = bucketof(e.time);
+		if (latest >= 0 && i <= latest - static_cast<std::int64_t>(window.size())) {
+			return; // older than the window
+		}
+		auto& b = window[static_cast<std::size_t>(((i % static_cast<std::int64_t>(window.size())) + static_cast<std::int64_t>(window.size())) % static_cast<std::int64_t>(window.size()))];
+		if (b.index != i) {
+			b.index = i;
+			b.events = 0;
+			for (auto& s : b.sketches) {
+				s.clear();
+			}
+			for (auto& h : b.hitters) {
+				h.clear();
+			}
+		}
+		latest = (std::max)(latest, i);
+		++b.events;
+
+		if (!e.rule.isnil()) {
+			char rule[uid::BinaryUUID::stringsize];
+			e.rule.format(rule);
+			count(b, dimension::rule, rule, sizeof(rule), true);
+		}
+		if (!e.user.empty()) {
+			count(b, dimension::user, e.user.data(), e.user.size(), true);
+		}
+		// every parent directory, only the directory of the file is a candidate heavy hitter
+		buffer.resize(e.path.size());
+		std::transform(e.path.begin(), e.path.end(), buffer.begin(), fold);
+		const auto last = buffer.find_last_of('\\');
+		if (last == std::string::npos) {
+			return;
+		}
+		for (auto sep = buffer.find('\\'); sep != std::string::npos && sep <= last; sep = buffer.find('\\', sep + 1)) {
+			if (sep == 0 || buffer[sep - 1] == '\\') { // "\\" of "\\\\server\\share" is not a directory
+				continue;
+			}
+			count(b, dimension::path, buffer.data(), sep, sep == last);
+		}
+	}
+
+	std::uint64_t Aggregator::total() const {
+		std::uint64_t toreturn = 0;
+		for (const auto& b : window) {
+			if (inwindow(b)) {
+				toreturn += b.events;
+			}
+		}
+		return toreturn;
+	}
+
+	std::uint64_t Aggregator::estimate(const dimension d, const std::string& key) const {
+		const auto k = normalize(d, key);
+		const auto h = hash(k.data(), k.size());
+		std::uint64_t toreturn = 0;
+		for (const auto& b : window) {
+			if (inwindow(b)) {
+				toreturn += b.sketches[index(d)].estimate(h);
+			}
+		}
+		return toreturn;
+	}
+
+	std::vector<Aggregator::hitter> Aggregator::top(const dimension d, const std::size_t n) const {
+		std::unordered_map<std::string, std::uint64_t> candidates;
+		for (const auto& b : window) {
+			if (inwindow(b)) {
+				for (const auto& i : b.hitters[index(d)].candidates()) {
+					candidates.emplace(i.key, 0);
+				}
+			}
+		}
+		std::vector<hitter> toreturn;
+		toreturn.reserve(candidates.size());
+		for (const auto& c : candidates) {
+			toreturn.push_back({ c.first, estimate(d, c.first) });
+		}
+		std::sort(toreturn.begin(), toreturn.end(), [](const hitter& l, const hitter& r){ return l.count != r.count ? l.count > r.count : l.key < r.key; });
+		if (toreturn.size() > n) {
+			toreturn.resize(n);
+		}
+		return toreturn;
+	}
+
+	std::vector<Aggregator::rulehits> Aggregator::hits(const std::vector<policy::policy_s>& rules) const {
+		std::vector<rulehits> toreturn;
+		toreturn.reserve(rules.size());
+		for (const auto& r : rules) {
+			toreturn.push_back({ r, estimate(dimension::rule, r.UUID) });
+		}
+		std::stable_sort(toreturn.begin(), toreturn.end(), [](const rulehits& l, const rulehits& r){ return l.count > r.count; });
+		return toreturn;
+	}
+}
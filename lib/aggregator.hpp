@@ -0,0 +1,117 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// local
+#include "blockedevent.hpp"
+#include "policy.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace evtlog {
+
+	/// Approximate counters in fixed memory: estimate never underestimates, and overestimates by at most 2/width of the total with high probability
+	class CountMinSketch {
+	public:
+		CountMinSketch(const std::size_t width, const std::size_t depth);
+		void add(const std::uint64_t hash, const std::uint32_t count = 1);
+		std::uint32_t estimate(const std::uint64_t hash) const;
+		void clear();
+	private:
+		std::size_t width;
+		std::size_t depth;
+		std::vector<std::uint32_t> counters; // depth rows of width counters
+	};
+
+	/// The keys seen most often (Space-Saving algorithm): with k counters every key seen more than total/k times is found
+	class SpaceSaving {
+	public:
+		struct item {
+			std::string key;
+			std::uint64_t hash;
+			std::uint64_t count;
+		};
+		explicit SpaceSaving(const std::size_t k_) : k(k_) { items.reserve(k); }
+		void add(const char* key, const std::size_t size, const std::uint64_t hash);
+		const std::vector<item>& candidates() const { return items; }
+		void clear() { items.clear(); }
+	private:
+		std::size_t k;
+		std::vector<item> items;
+	};
+
+	/// Counts blocked events per rule, per user, and per directory, over a sliding window of time, in bounded memory
+	///
+	/// The window is made of buckets (by default 60 buckets of a minute), each bucket has a count-min sketch and a Space-Saving summary per dimension.
+	/// When the events move to a new bucket the oldest bucket is cleared, so memory does not depend on the number of events or of distinct keys.
+	/// Time is the time of the events, so replayed events are aggregated like live ones. Events older than the window are ignored.
+	/// Without new events the window does not move: advance moves it to the current time, so that old events stop being counted.
+	/// Not thread safe.
+	class Aggregator {
+	public:
+		enum class dimension { rule, user, path };
+		struct hitter {
+			std::string key;
+			std::uint64_t count;
+		};
+		struct rulehits {
+			policy::policy_s rule;
+			std::uint64_t count;
+		};
+
+		explicit Aggregator(const std::int64_t bucketmicroseconds = 60 * 1000000LL, const std::size_t buckets = 60,
+			const std::size_t width = 1024, const std::size_t depth = 4, const std::size_t topk = 32);
+
+		void add(const BlockedEvent& e);
+		/// moves the end of the window to now (microseconds, like the time of the events), if it is later; older buckets are dropped
+		void advance(const std::int64_t now);
+
+		/// events in the window
+		std::uint64_t total() const;
+		/// events in the window for key: the rule GUID, the SID, or a directory (every parent directory of the blocked file is counted)
+		std::uint64_t estimate(const dimension d, const std::string& key) const;
+		/// (at most) n keys with most events in the window, most frequent first
+		std::vector<hitter> top(const dimension d, const std::size_t n) const;
+		/// events in the window for each rule (for example of getLoadedRules), matched by UUID, most frequent first
+		std::vector<rulehits> hits(const std::vector<policy::policy_s>& rules) const;
+
+		/// key of a directory or of a rule, as used by estimate
+		static std::string normalize(const dimension d, const std::string& key);
+
+	private:
+		static constexpr std::size_t dimensions = 3;
+		struct bucket {
+			std::int64_t index = -1; // time / bucketsize, -1 if unused
+			std::uint64_t events = 0;
+			std::vector<CountMinSketch> sketches;
+			std::vector<SpaceSaving> hitters;
+		};
+		std::int64_t bucketsize;
+		std::int64_t latest = -1; // index of the most recent bucket
+		std::vector<bucket> window;
+		std::string buffer;       // reused for normalizing paths
+
+		std::int64_t bucketof(const std::int64_t time) const { return (time >= 0 ? time : time - bucketsize + 1) / bucketsize; }
+		bool inwindow(const bucket& b) const { return b.index >= 0 && b.index > latest - static_cast<std::int64_t>(window.size()); }
+		void count(bucket& b, const dimension d, const char* key, const std::size_t size, const bool candidate);
+	};
+}
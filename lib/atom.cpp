@@ -0,0 +1,49 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "atom.hpp"
+
+// std
+#include <string>
+#include <unordered_set>
+#include <mutex>
+
+namespace policy {
+
+	const std::string* SymbolTable::intern(const std::string& s) {
+		if (s.empty()) {
+			return emptystring();
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		return &*strings.insert(s).first; // elements of an unordered_set are never moved
+	}
+
+	std::size_t SymbolTable::size() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return strings.size();
+	}
+
+	SymbolTable& SymbolTable::global() {
+		static SymbolTable table;
+		return table;
+	}
+
+	const std::string* SymbolTable::emptystring() {
+		static const std::string empty;
+		return &empty;
+	}
+}
@@ -0,0 +1,100 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// std
+#include <string>
+#include <unordered_set>
+#include <mutex>
+#include <ostream>
+#include <functional>
+#include <cstddef>
+
+namespace policy {
+
+	/// Stores every distinct string once, the returned pointers are valid as long as the table exists
+	/// Thread safe, since rules are loaded in parallel (see loadrulesfromfiles)
+	class SymbolTable {
+	public:
+		const std::string* intern(const std::string& s);
+		std::size_t size() const;
+
+		/// table used by Atom, strings are never removed from it: every distinct name and description seen by the process
+		/// (rules on the machine, imported files, edits in the GUI) stays in memory until the process exits
+		static SymbolTable& global();
+		/// shared by all tables, so that a default constructed Atom does not need to look it up
+		static const std::string* emptystring();
+
+	private:
+		mutable std::mutex mutex;
+		std::unordered_set<std::string> strings;
+	};
+
+	/// Interned string, used for names and descriptions of rules, which are the same for all rules of a group
+	/// - creating an Atom from a string takes a lock on the global table, when many rules share a value create the Atom once and copy it
+	/// - interned strings are never freed, so it is not meant for values that are different for most rules (like ItemData)
+	/// - copies and equality comparisons are O(1), since equal strings are stored only once
+	/// - it converts implicitly from and to std::string, so it can be used where a std::string was used before
+	/// - the order is the one of std::string
+	class Atom {
+		const std::string* str_; // never nullptr
+	public:
+		Atom() : str_(SymbolTable::emptystring()) {}
+		Atom(const std::string& s) : str_(SymbolTable::global().intern(s)) {}
+		Atom(const char* s) : Atom(std::string(s)) {}
+
+		const std::string& str() const { return *str_; }
+		operator const std::string&() const { return *str_; }
+
+		const char* c_str() const { return str_->c_str(); }
+		const char* data() const { return str_->data(); }
+		std::size_t size() const { return str_->size(); }
+		bool empty() const { return str_->empty(); }
+
+		friend bool operator==(const Atom& lhs, const Atom& rhs) { return lhs.str_ == rhs.str_; }
+		friend bool operator!=(const Atom& lhs, const Atom& rhs) { return lhs.str_ != rhs.str_; }
+		friend bool operator<(const Atom& lhs, const Atom& rhs) { return lhs.str_ != rhs.str_ && *lhs.str_ < *rhs.str_; }
+
+		friend bool operator==(const Atom& lhs, const std::string& rhs) { return *lhs.str_ == rhs; }
+		friend bool operator==(const std::string& lhs, const Atom& rhs) { return lhs == *rhs.str_; }
+		friend bool operator==(const Atom& lhs, const char* rhs) { return *lhs.str_ == rhs; }
+		friend bool operator==(const char* lhs, const Atom& rhs) { return lhs == *rhs.str_; }
+		friend bool operator!=(const Atom& lhs, const std::string& rhs) { return !(lhs == rhs); }
+		friend bool operator!=(const std::string& lhs, const Atom& rhs) { return !(lhs == rhs); }
+		friend bool operator!=(const Atom& lhs, const char* rhs) { return !(lhs == rhs); }
+		friend bool operator!=(const char* lhs, const Atom& rhs) { return !(lhs == rhs); }
+
+		friend std::string operator+(const Atom& lhs, const Atom& rhs) { return *lhs.str_ + *rhs.str_; }
+		friend std::string operator+(const Atom& lhs, const std::string& rhs) { return *lhs.str_ + rhs; }
+		friend std::string operator+(const std::string& lhs, const Atom& rhs) { return lhs + *rhs.str_; }
+		friend std::string operator+(const Atom& lhs, const char* rhs) { return *lhs.str_ + rhs; }
+		friend std::string operator+(const char* lhs, const Atom& rhs) { return lhs + *rhs.str_; }
+
+		friend std::ostream& operator<<(std::ostream& os, const Atom& a) { return os << *a.str_; }
+
+		/// hash of the address, equal atoms have the same address
+		std::size_t hash() const { return std::hash<const std::string*>()(str_); }
+	};
+}
+
+namespace std {
+	template<>
+	struct hash<policy::Atom> {
+		std::size_t operator()(const policy::Atom& a) const { return a.hash(); }
+	};
+}
@@ -0,0 +1,368 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "blockedevent.hpp"
+
+// std
+#include <string>
+#include <cstdint>
+
+// cstd
+#include <cstring>
+
+namespace evtlog {
+
+	namespace {
+		enum class field { none, record, path, rulepath, rule };
+
+		struct range {
+			const char* b;
+			const char* e;
+			std::size_t size() const { return static_cast<std::size_t>(e - b); }
+		};
+
+		template<std::size_t N>
+		bool equals(const range& r, const char(&s)[N]) {
+			return r.size() == N - 1 && std::memcmp(r.b, s, N - 1) == 0;
+		}
+
+		bool isspace(const char c) {
+			return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+		}
+
+		range trim(range r) {
+			while (r.b != r.e && isspace(*r.b)) {
+				++r.b;
+			}
+			while (r.e != r.b && isspace(r.e[-1])) {
+				--r.e;
+			}
+			return r;
+		}
+
+		const char* find(const char* b, const char* e, const char* what, const std::size_t size) {
+			for (; static_cast<std::size_t>(e - b) >= size; ++b) {
+				if (std::memcmp(b, what, size) == 0) {
+					return b;
+				}
+			}
+			return nullptr;
+		}
+
+		// value of the attribute name, attrs is the part of the tag after the element name
+		template<std::size_t N>
+		bool attribute(const range& attrs, const char(&name)[N], range& value) {
+			const char* it = attrs.b;
+			while (true) {
+				while (it != attrs.e && isspace(*it)) {
+					++it;
+				}
+				const char* const namebegin = it;
+				while (it != attrs.e && *it != '=' && !isspace(*it)) {
+					++it;
+				}
+				const range attrname{ namebegin, it };
+				while (it != attrs.e && isspace(*it)) {
+					++it;
+				}
+				if (it == attrs.e || *it != '=') {
+					return false;
+				}
+				++it;
+				while (it != attrs.e && isspace(*it)) {
+					++it;
+				}
+				if (it == attrs.e || (*it != '\'' && *it != '"')) {
+					return false;
+				}
+				const char quote = *it++;
+				const auto last = static_cast<const char*>(std::memchr(it, quote, static_cast<std::size_t>(attrs.e - it)));
+				if (last == nullptr) {
+					return false;
+				}
+				if (equals(attrname, name)) {
+					value = { it, last };
+					return true;
+				}
+				it = last + 1;
+			}
+		}
+
+		void appendutf8(std::string& out, const std::uint32_t cp) {
+			if (cp < 0x80) {
+				out.push_back(static_cast<char>(cp));
+			} else if (cp < 0x800) {
+				out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+				out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+			} else if (cp < 0x10000) {
+				out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+				out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+			} else {
+				out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+				out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+			}
+		}
+
+		// replaces the predefined and numeric entities, unknown entities are copied as they are
+		void decode(const range& r, std::string& out) {
+			out.clear();
+			const char* it = r.b;
+			while (it != r.e) {
+				const auto amp = static_cast<const char*>(std::memchr(it, '&', static_cast<std::size_t>(r.e - it)));
+				if (amp == nullptr) {
+					out.append(it, r.e);
+					return;
+				}
+				out.append(it, amp);
+				const auto semicolon = static_cast<const char*>(std::memchr(amp, ';', static_cast<std::size_t>(r.e - amp)));
+				if (semicolon == nullptr) {
+					out.append(amp, r.e);
+					return;
+				}
+				const range entity{ amp + 1, semicolon };
+				if (equals(entity, "amp")) {
+					out.push_back('&');
+				} else if (equals(entity, "lt")) {
+					out.push_back('<');
+				} else if (equals(entity, "gt")) {
+					out.push_back('>');
+				} else if (equals(entity, "quot")) {
+					out.push_back('"');
+				} else if (equals(entity, "apos")) {
+					out.push_back('\'');
+				} else if (entity.size() > 1 && entity.b[0] == '#') {
+					const bool hex = entity.b[1] == 'x';
+					std::uint32_t cp = 0;
+					bool valid = entity.size() > (hex ? 2u : 1u);
+					for (const char* d = entity.b + (hex ? 2 : 1); d != entity.e && valid; ++d) {
+						const auto c = static_cast<unsigned char>(*d);
+						std::uint32_t digit;
+						if (c >= '0' && c <= '9') {
+							digit = c - '0';
+						} else if (hex && (c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+							digit = (c | 0x20u) - 'a' + 10;
+						} else {
+							valid = false;
+							break;
+						}
+						cp = cp * (hex ? 16u : 10u) + digit;
+						valid = cp <= 0x10FFFF;
+					}
+					if (valid) {
+						appendutf8(out, cp);
+					} else {
+						out.append(amp, semicolon + 1);
+					}
+				} else {
+					out.append(amp, semicolon + 1);
+				}
+				it = semicolon + 1;
+			}
+		}
+
+		bool digits(const char*& it, const char* e, const std::size_t n, int& value) {
+			if (static_cast<std::size_t>(e - it) < n) {
+				return false;
+			}
+			value = 0;
+			for (std::size_t i = 0; i != n; ++i, ++it) {
+				if (*it < '0' || *it > '9') {
+					return false;
+				}
+				value = value * 10 + (*it - '0');
+			}
+			return true;
+		}
+
+		// days since 1970-01-01 of a date of the proleptic gregorian calendar
+		std::int64_t days_from_civil(int y, const int m, const int d) {
+			y -= m <= 2;
+			const int era = (y >= 0 ? y : y - 399) / 400;
+			const int yoe = y - era * 400;
+			const int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+			const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+			return static_cast<std::int64_t>(era) * 146097 + doe - 719468;
+		}
+
+		// "2016-11-02T18:20:07.517000000Z", the fraction is optional
+		bool parse_time(const range& r, std::int64_t& out) {
+			const char* it = r.b;
+			int year, month, day, hour, minute, second;
+			if (!digits(it, r.e, 4, year) || it == r.e || *it++ != '-' ||
+				!digits(it, r.e, 2, month) || it == r.e || *it++ != '-' ||
+				!digits(it, r.e, 2, day) || it == r.e || *it++ != 'T' ||
+				!digits(it, r.e, 2, hour) || it == r.e || *it++ != ':' ||
+				!digits(it, r.e, 2, minute) || it == r.e || *it++ != ':' ||
+				!digits(it, r.e, 2, second)) {
+				return false;
+			}
+			if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+				return false;
+			}
+			std::int64_t micro = 0;
+			if (it != r.e && *it == '.') {
+				++it;
+				int n = 0;
+				for (; it != r.e && *it >= '0' && *it <= '9'; ++it, ++n) {
+					if (n < 6) {
+						micro = micro * 10 + (*it - '0');
+					}
+				}
+				for (; n < 6; ++n) {
+					micro *= 10;
+				}
+			}
+			if (it != r.e && *it == 'Z') {
+				++it;
+			}
+			if (it != r.e) {
+				return false;
+			}
+			const auto seconds = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+			out = seconds * 1000000 + micro;
+			return true;
+		}
+
+		field fieldname(const range& name) {
+			if (equals(name, "EventRecordID")) {
+				return field::record;
+			} else if (equals(name, "AttemptedPath")) {
+				return field::path;
+			} else if (equals(name, "RulePath")) {
+				return field::rulepath;
+			} else if (equals(name, "SrpRuleGuid")) {
+				return field::rule;
+			}
+			return field::none;
+		}
+
+		void settext(const field f, const range& text, BlockedEvent& out) {
+			switch (f) {
+				case field::record: {
+					const auto r = trim(text);
+					std::uint64_t value = 0;
+					for (const char* it = r.b; it != r.e && *it >= '0' && *it <= '9'; ++it) {
+						value = value * 10 + static_cast<std::uint64_t>(*it - '0');
+					}
+					out.record = value;
+					break;
+				}
+				case field::path: {
+					decode(text, out.path);
+					break;
+				}
+				case field::rulepath: {
+					decode(text, out.rulepath);
+					break;
+				}
+				case field::rule: {
+					const auto r = trim(text);
+					if (!uid::BinaryUUID::parse(r.b, r.size(), out.rule)) {
+						out.rule = uid::BinaryUUID();
+					}
+					break;
+				}
+				case field::none:
+				default: {
+					break;
+				}
+			}
+		}
+	}
+
+	bool parse_event(const char* xml, const std::size_t size, BlockedEvent& out) {
+		out.time = 0;
+		out.record = 0;
+		out.user.clear();
+		out.path.clear();
+		out.rulepath.clear();
+		out.rule = uid::BinaryUUID();
+
+		const char* it = xml;
+		const char* const end = xml + size;
+		field current = field::none; // field whose value is the text before the next tag
+		while (true) {
+			const auto lt = static_cast<const char*>(std::memchr(it, '<', static_cast<std::size_t>(end - it)));
+			if (lt == nullptr) {
+				return false; // </Event> not found
+			}
+			settext(current, { it, lt }, out);
+			current = field::none;
+			it = lt + 1;
+			if (it == end) {
+				return false;
+			}
+			if (*it == '?' || *it == '!') { // processing instruction, comment, doctype
+				const bool comment = end - it >= 3 && it[1] == '-' && it[2] == '-';
+				const auto last = comment ? find(it + 3, end, "-->", 3) : static_cast<const char*>(std::memchr(it, '>', static_cast<std::size_t>(end - it)));
+				if (last == nullptr) {
+					return false;
+				}
+				it = last + (comment ? 3 : 1);
+				continue;
+			}
+			const bool closing = *it == '/';
+			if (closing) {
+				++it;
+			}
+			const char* const namebegin = it;
+			while (it != end && !isspace(*it) && *it != '>' && *it != '/') {
+				++it;
+			}
+			range name{ namebegin, it };
+			if (const auto colon = static_cast<const char*>(std::memchr(name.b, ':', name.size()))) {
+				name.b = colon + 1;
+			}
+			const auto gt = static_cast<const char*>(std::memchr(it, '>', static_cast<std::size_t>(end - it)));
+			if (gt == nullptr || name.size() == 0) {
+				return false;
+			}
+			const bool empty = gt[-1] == '/';
+			const range attrs{ it, empty ? gt - 1 : gt };
+			it = gt + 1;
+
+			if (closing) {
+				if (equals(name, "Event")) {
+					return true;
+				}
+				continue;
+			}
+			range value;
+			if (equals(name, "TimeCreated")) {
+				if (attribute(attrs, "SystemTime", value) && !parse_time(trim(value), out.time)) {
+					out.time = 0;
+				}
+			} else if (equals(name, "Security")) {
+				if (attribute(attrs, "UserID", value)) {
+					decode(value, out.user);
+				}
+			} else if (equals(name, "Data")) {
+				if (attribute(attrs, "Name", value)) {
+					current = fieldname(value);
+				}
+			} else {
+				current = fieldname(name);
+			}
+			if (empty) {
+				current = field::none;
+			}
+		}
+	}
+}
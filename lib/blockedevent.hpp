@@ -0,0 +1,49 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// local
+#include "uuid.hpp"
+
+// std
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace evtlog {
+
+	/// The fields of an event 866 (execution blocked by a software restriction policy) that soup cares about
+	struct BlockedEvent {
+		std::int64_t time = 0;     // System/TimeCreated, microseconds since 1970-01-01 UTC
+		std::uint64_t record = 0;  // System/EventRecordID
+		std::string user;          // System/Security/@UserID, the SID
+		std::string path;          // path of the blocked file
+		std::string rulepath;      // ItemData of the rule
+		uid::BinaryUUID rule;      // GUID of the rule, nil if unknown
+	};
+
+	/// Parses the rendered XML of an event 866 in a single pass, without building a DOM and without allocating:
+	/// the strings of out are reused, so when the same object is used for many events memory is only allocated for the longest one.
+	///
+	/// The data of the event can be in elements (<AttemptedPath>, <SrpRuleGuid>, <RulePath>) or in <Data Name='AttemptedPath'> form.
+	/// Missing fields are left empty, returns false if the XML is truncated or malformed.
+	bool parse_event(const char* xml, const std::size_t size, BlockedEvent& out);
+	inline bool parse_event(const std::string& xml, BlockedEvent& out) {
+		return parse_event(xml.data(), xml.size(), out);
+	}
+}
@@ -17,9 +17,8 @@
 
 #pragma once
 
-// windows
-#include <Windows.h>
-#include <winnls.h>
+// local
+#include "utf.hpp"
 
 // std
 #include <string>
@@ -65,10 +64,6 @@ bool implies(const T1& t1, const T2& t2) {
 	return (!(t1) || (t2));
 }
 
-#if defined(NONLS)
-#error "need NLS for CP_UTF8 and MB_ERR_INVALID_CHARS"
-#endif
-
 inline std::string trim(std::string s){
 	s.erase(0, s.find_first_not_of(" \t\n\r\f\v"));
 	s.erase(s.find_last_not_of(" \t\n\r\f\v") + 1);
@@ -86,48 +81,17 @@ inline std::string removedel(std::string s) {
 	return s;
 }
 
-/// possible alternative: http://www.cplusplus.com/reference/codecvt/codecvt_utf8_utf16/
+/// conversion is done in a single pass, the buffer is sized for the worst case and resized afterwards
+/// use utf::to_wide/utf::to_utf8 directly for reusing a buffer between conversions
 inline std::wstring s2ws(const std::string& s) {
-	if (s.empty()) {
-		return L"";
-	}
-	constexpr auto flag = MB_ERR_INVALID_CHARS; // alternative to MB_ERR_INVALID_CHARS is 0
-	// https://msdn.microsoft.com/en-us/library/windows/desktop/dd319072%28v=vs.85%29.aspx
-	if (s.length() > (static_cast<size_t>((std::numeric_limits<int>::max)()))) {
-		throw std::runtime_error("string " + s + " is too long");
-	}
-	int len = MultiByteToWideChar(CP_UTF8, flag, s.c_str(), static_cast<int>(s.length()), nullptr, 0);
-	if (len <= 0) {
-		throw std::runtime_error("error when converting" + s + "to wstring");
-	}
-	std::wstring buf = std::wstring(static_cast<size_t>(len), '\0');
-	len = MultiByteToWideChar(CP_UTF8, flag, s.c_str(), static_cast<int>(s.length()), &buf[0], len);
-	if (len <= 0) {
-		throw std::runtime_error("error when converting" + s + "to wstring");
-	}
-	buf.resize(static_cast<size_t>(len));
+	std::wstring buf;
+	utf::to_wide(s.data(), s.size(), buf);
 	return buf;
 }
 
 inline std::string ws2s(const std::wstring& s) {
-	if (s.empty()) {
-		return "";
-	}
-	if (s.length() > (static_cast<size_t>((std::numeric_limits<int>::max)()))) {
-		throw std::runtime_error("string is too long");
-	}
-	constexpr auto flag = WC_ERR_INVALID_CHARS; // alternative to WC_ERR_INVALID_CHARS is 0
-	// https://msdn.microsoft.com/en-us/library/windows/desktop/dd374130%28v=vs.85%29.aspx
-	int len = WideCharToMultiByte(CP_UTF8, flag, s.c_str(), static_cast<int>(s.length()), nullptr, 0, nullptr, nullptr);
-	if (len <= 0) {
-		throw std::runtime_error("error when converting to string");
-	}
-	std::string buf(static_cast<size_t>(len), '\0');
-	len = WideCharToMultiByte(CP_UTF8, flag, s.c_str(), static_cast<int>(s.length()), &buf[0], len, nullptr, nullptr);
-	if (len <= 0) {
-		throw std::runtime_error("error when converting to string");
-	}
-	buf.resize(static_cast<size_t>(len));
+	std::string buf;
+	utf::to_utf8(s.data(), s.size(), buf);
 	return buf;
 }
 
@@ -219,17 +183,63 @@ inline std::pair<bool, std::string> matchwithoptionalnumber(const std::string& s
 	return{ true, substr };
 }
 
+/// lazy version of combineext: generates "*.e1.e2" for every pair, in the same order, one at a time
+/// the pattern is written in a buffer reused for every pair, so the memory does not depend on the number of pairs
+/// usage: for (combineextgenerator gen(ext1, ext2); gen.next(); ) { use(gen.current()); }
+class combineextgenerator {
+	const std::vector<std::string>* ext1;
+	const std::vector<std::string>* ext2;
+	std::size_t i1 = 0;
+	std::size_t i2 = 0;
+	std::size_t prefixsize = 0; // size of "*.e1." in buffer
+	std::string buffer;
+public:
+	combineextgenerator(const std::vector<std::string>& ext1_, const std::vector<std::string>& ext2_) : ext1(&ext1_), ext2(&ext2_) {}
+	// the generator refers to the vectors, they must outlive it
+	combineextgenerator(std::vector<std::string>&&, const std::vector<std::string>&) = delete;
+	combineextgenerator(const std::vector<std::string>&, std::vector<std::string>&&) = delete;
+
+	/// returns false when all pairs have been generated, otherwise current() is the next pattern
+	bool next() {
+		if (i1 == ext1->size() || ext2->empty()) {
+			return false;
+		}
+		if (i2 == 0) { // the prefix changes only with e1
+			const auto& e1 = (*ext1)[i1];
+			assert(!e1.empty() && e1.at(0) != '.');
+			buffer.assign("*.");
+			buffer += e1;
+			buffer += '.';
+			prefixsize = buffer.size();
+		}
+		const auto& e2 = (*ext2)[i2];
+		assert(!e2.empty() && e2.at(0) != '.');
+		buffer.resize(prefixsize);
+		buffer += e2;
+		if (++i2 == ext2->size()) {
+			i2 = 0;
+			++i1;
+		}
+		return true;
+	}
+
+	const std::string& current() const {
+		return buffer;
+	}
+
+	std::size_t size() const {
+		return ext1->size() * ext2->size();
+	}
+};
+
 inline std::vector<std::string> combineext(const std::vector<std::string>& ext1, const std::vector<std::string>& ext2) {
 	assert(!ext1.empty());
 	assert(!ext2.empty());
 	std::vector<std::string> doubleext;
-	doubleext.reserve(ext1.size()*ext2.size());
-	for (const auto& e1 : ext1) {
-		assert(e1.at(0) != '.');
-		for (const auto& e2 : ext2) {
-			assert(e2.at(0) != '.');
-			doubleext.emplace_back("*." + e1 + "." + e2);
-		}
+	combineextgenerator gen(ext1, ext2);
+	doubleext.reserve(gen.size());
+	while (gen.next()) {
+		doubleext.push_back(gen.current());
 	}
 	return doubleext;
 }
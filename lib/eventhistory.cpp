@@ -0,0 +1,139 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "eventhistory.hpp"
+
+// std
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+namespace evtlog {
+
+	namespace {
+		// -1, 0, 1
+		template<class T>
+		int compare(const T& l, const T& r) {
+			return l < r ? -1 : (r < l ? 1 : 0);
+		}
+	}
+
+	EventHistory::EventHistory(const std::size_t capacity, resolver names_) : slots(capacity), resolve(std::move(names_)) {
+		if (capacity == 0) {
+			throw std::runtime_error("history without capacity");
+		}
+		if (resolve) {
+			names.resize(capacity);
+		}
+		order.reserve(capacity);
+		buffer.reserve(capacity);
+	}
+
+	BlockedEvent& EventHistory::append() {
+		return slots[slot(next++)];
+	}
+
+	bool EventHistory::less(const std::uint64_t l, const std::uint64_t r) const {
+		const auto& el = slots[slot(l)];
+		const auto& er = slots[slot(r)];
+		int res = 0;
+		switch (sortcolumn) {
+			case column::time: {
+				res = compare(el.time, er.time);
+				break;
+			}
+			case column::user: {
+				res = names.empty() ? el.user.compare(er.user) : names[slot(l)].compare(names[slot(r)]);
+				break;
+			}
+			case column::path: {
+				res = el.path.compare(er.path);
+				break;
+			}
+			case column::rule: {
+				res = el.rulepath.compare(er.rulepath);
+				if (res == 0) {
+					res = compare(el.rule, er.rule);
+				}
+				break;
+			}
+			default: {
+				break;
+			}
+		}
+		if (res == 0) {
+			res = compare(l, r);
+		}
+		return sortascending ? res < 0 : res > 0;
+	}
+
+	void EventHistory::update() {
+		const std::uint64_t first = next > slots.size() ? next - slots.size() : 0;
+		if (merged < first) { // everything visible has been overwritten
+			order.clear();
+			merged = first;
+		} else {
+			order.erase(std::remove_if(order.begin(), order.end(), [first](const std::uint64_t seq){ return seq < first; }), order.end());
+		}
+		const auto oldsize = order.size();
+		for (auto seq = merged; seq != next; ++seq) {
+			order.push_back(seq);
+			if (resolve) {
+				names[slot(seq)] = resolve(slots[slot(seq)].user);
+			}
+		}
+		merged = next;
+
+		const auto cmp = [this](const std::uint64_t l, const std::uint64_t r){ return less(l, r); };
+		const auto middle = order.begin() + static_cast<std::ptrdiff_t>(oldsize);
+		std::sort(middle, order.end(), cmp);
+		if (oldsize == 0 || middle == order.end() || !cmp(*middle, *(middle - 1))) {
+			return; // already in order, the common case when sorting by time
+		}
+		buffer.clear();
+		std::merge(order.begin(), middle, middle, order.end(), std::back_inserter(buffer), cmp);
+		order.swap(buffer);
+	}
+
+	bool EventHistory::appendsonly() const {
+		// the visible events are merged - order.size() ... merged - 1
+		if (next > slots.size() && next - slots.size() > merged - order.size()) {
+			return false; // some visible event has been overwritten
+		}
+		if (order.empty()) {
+			return true;
+		}
+		if (sortcolumn == column::user && resolve) {
+			return false; // the names of the new events are not resolved yet
+		}
+		for (auto seq = merged; seq != next; ++seq) {
+			if (less(seq, order.back())) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void EventHistory::sort(const column c, const bool ascending) {
+		update();
+		sortcolumn = c;
+		sortascending = ascending;
+		std::sort(order.begin(), order.end(), [this](const std::uint64_t l, const std::uint64_t r){ return less(l, r); });
+	}
+}
@@ -0,0 +1,84 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// local
+#include "blockedevent.hpp"
+
+// std
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace evtlog {
+
+	/// The last events received, in a fixed number of slots, so that memory does not grow even if the history is kept for days
+	///
+	/// Events are shown in a sorted order: new events are appended in the slot of the oldest event (reusing its memory),
+	/// and update merges them in the order, without sorting everything again.
+	class EventHistory {
+	public:
+		enum class column { time, user, path, rule };
+		/// name shown for the SID of an event
+		using resolver = std::function<std::string(const std::string& sid)>;
+
+		/// without resolver the user is shown (and sorted) by SID, otherwise it is resolved once per event, when it is merged
+		explicit EventHistory(const std::size_t capacity, resolver names = nullptr);
+
+		/// slot for a new event, if the history is full it contains the oldest event
+		/// the event is not visible (and the oldest event is still visible, with the new data) until update is called
+		BlockedEvent& append();
+		/// removes overwritten events from the order, and merges the appended ones
+		void update();
+		/// true if update only adds rows after the visible ones, without removing or moving them
+		bool appendsonly() const;
+
+		/// sorts by the column (and by arrival for equal values)
+		void sort(const column c, const bool ascending);
+
+		/// number of visible events
+		std::size_t size() const { return order.size(); }
+		/// number of events after the next update
+		std::size_t stored() const { return static_cast<std::size_t>(next < slots.size() ? next : slots.size()); }
+		std::size_t capacity() const { return slots.size(); }
+		/// row in the current order
+		const BlockedEvent& operator[](const std::size_t row) const { return slots[slot(order[row])]; }
+		/// user of the event in the row, as given by the resolver
+		const std::string& username(const std::size_t row) const { return names.empty() ? (*this)[row].user : names[slot(order[row])]; }
+		/// identifies the event in the row, until it is overwritten
+		std::uint64_t sequence(const std::size_t row) const { return order[row]; }
+		/// true if the event has not been overwritten, and it is visible
+		bool visible(const std::uint64_t seq) const { return seq < merged && seq + slots.size() >= next; }
+
+	private:
+		std::vector<BlockedEvent> slots;
+		resolver resolve;
+		std::vector<std::string> names;  // resolved user of every slot, empty without resolver
+		std::uint64_t next = 0;          // sequence number of the next event, event n is in slots[n % capacity]
+		std::uint64_t merged = 0;        // events before this one are in order
+		std::vector<std::uint64_t> order;
+		std::vector<std::uint64_t> buffer; // reused by update
+		column sortcolumn = column::time;
+		bool sortascending = true;
+
+		std::size_t slot(const std::uint64_t seq) const { return static_cast<std::size_t>(seq % slots.size()); }
+		bool less(const std::uint64_t l, const std::uint64_t r) const;
+	};
+}
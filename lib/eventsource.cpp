@@ -0,0 +1,96 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "eventsource.hpp"
+
+// std
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+// cstd
+#include <cstring>
+
+namespace evtlog {
+
+	namespace {
+		const char starttag[] = "<Event";
+		const char endtag[] = "</Event>";
+
+		const char* search(const char* begin, const char* end, const char* what, const std::size_t size) {
+			const auto it = std::search(begin, end, what, what + size);
+			return it == end ? nullptr : it;
+		}
+	}
+
+	ReplaySource::ReplaySource(const std::string& filename, const double eventspersecond, const std::size_t passes_)
+		: file(filename), rate(eventspersecond), passes(passes_) {
+		if (eventspersecond < 0) {
+			throw std::runtime_error("invalid rate");
+		}
+		const char* const begin = file.data();
+		const char* const end = begin + file.size();
+		const char* it = begin;
+		while (it != end) {
+			auto start = search(it, end, starttag, sizeof(starttag) - 1);
+			// skip <EventData>, <EventID>, <Events>, ...
+			while (start != nullptr && start + sizeof(starttag) - 1 != end && start[sizeof(starttag) - 1] != '>' && start[sizeof(starttag) - 1] != ' ') {
+				start = search(start + 1, end, starttag, sizeof(starttag) - 1);
+			}
+			if (start == nullptr) {
+				break;
+			}
+			const auto last = search(start, end, endtag, sizeof(endtag) - 1);
+			if (last == nullptr) {
+				throw std::runtime_error("truncated event in " + filename);
+			}
+			it = last + sizeof(endtag) - 1;
+			events.push_back({ static_cast<std::size_t>(start - begin), static_cast<std::size_t>(it - start) });
+		}
+	}
+
+	std::size_t ReplaySource::run(const callback& cb) {
+		using clock = std::chrono::steady_clock;
+		const details::clearonexit clear{ stopped };
+		if (events.empty()) {
+			return 0;
+		}
+		const auto start = clock::now();
+		const std::chrono::duration<double> interval(rate > 0 ? 1 / rate : 0);
+		const auto mingap = std::chrono::milliseconds(1); // sleeping for less is not precise, better to deliver a small burst
+
+		std::size_t delivered = 0;
+		for (std::size_t pass = 0; passes == 0 || pass != passes; ++pass) {
+			for (const auto& e : events) {
+				if (stopped) {
+					return delivered;
+				}
+				if (rate > 0) {
+					const auto due = start + std::chrono::duration_cast<clock::duration>(interval * static_cast<double>(delivered));
+					if (due - clock::now() >= mingap) {
+						std::this_thread::sleep_until(due);
+					}
+				}
+				cb(file.data() + e.offset, e.size);
+				++delivered;
+			}
+		}
+		return delivered;
+	}
+}
@@ -0,0 +1,84 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// local
+#include "mappedfile.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <cstddef>
+
+namespace evtlog {
+
+	/// Something that delivers rendered events (the XML of the event, UTF-8 encoded), like the windows event log
+	class EventSource {
+	public:
+		/// the data is only valid during the call
+		using callback = std::function<void(const char* xml, std::size_t size)>;
+
+		virtual ~EventSource() = default;
+
+		/// delivers events to cb until the source is exhausted or stop is called, returns the number of delivered events
+		/// exceptions thrown by cb are propagated
+		virtual std::size_t run(const callback& cb) = 0;
+		/// can be called from another thread (or from cb), run returns as soon as possible
+		/// if run has not started yet, the next run returns immediately; the stop is consumed when run returns
+		virtual void stop() = 0;
+	};
+
+	namespace details {
+		/// clears the stop flag when run returns (or throws), a stop that arrived before run is not lost
+		struct clearonexit {
+			std::atomic<bool>& flag;
+			~clearonexit() { flag = false; }
+		};
+	}
+
+	/// Replays events recorded in a file, like the output of
+	///   wevtutil qe Application /q:"*[System/EventID=866]"
+	/// Every <Event> element of the file is an event, whatever is between them is ignored.
+	///
+	/// The file is mapped in memory and events are passed without copying them, so the source can deliver millions of events per second.
+	/// With a rate events are spaced evenly, and when the consumer is too slow the replay does not wait and tries to catch up.
+	class ReplaySource final : public EventSource {
+	public:
+		/// eventspersecond == 0 means as fast as possible, passes == 0 means until stop is called
+		explicit ReplaySource(const std::string& filename, const double eventspersecond = 0, const std::size_t passes = 1);
+
+		std::size_t run(const callback& cb) override;
+		void stop() override { stopped = true; }
+
+		/// number of recorded events
+		std::size_t size() const { return events.size(); }
+
+	private:
+		struct eventref {
+			std::size_t offset;
+			std::size_t size;
+		};
+		MappedFile file;
+		std::vector<eventref> events;
+		double rate;
+		std::size_t passes;
+		std::atomic<bool> stopped{ false };
+	};
+}
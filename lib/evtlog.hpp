@@ -22,6 +22,10 @@
 #include "common.hpp"
 #include "IniParser.hpp"
 #include "win_handles.hpp"
+#include "eventsource.hpp"
+#include "utf.hpp"
+#include "sidcache.hpp"
+#include "journal.hpp"
 
 // windows
 #include <Windows.h>
@@ -45,6 +49,10 @@
 #include <type_traits>
 #include <typeinfo>
 #include <typeindex>      // std::type_index
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <atomic>
 
 /*
 	https://msdn.microsoft.com/en-us/library/windows/desktop/aa385577(v=vs.85).aspx
@@ -66,64 +74,99 @@
 
 namespace evtlog{
 
-	// return empty string if unable to get username
-	inline std::pair<std::string , std::string> sid_to_username(const std::string& sid_){
-		PSID psid={};
-		if(ConvertStringSidToSidW(s2ws(sid_).c_str(), &psid)==0){
-			return{};
+	/// SidResolver that asks windows
+	class Win32SidResolver final : public SidResolver {
+	public:
+		bool lookup_account(const std::string& sid_, account& out) override {
+			PSID psid = nullptr;
+			if(ConvertStringSidToSidW(s2ws(sid_).c_str(), &psid) == 0){
+				return false;
+			}
+			const RAII_LOCALMEM sid(psid);
+			DWORD size = 0;
+			DWORD size2 = 0;
+			SID_NAME_USE usename;
+			LookupAccountSidW(nullptr, psid, nullptr, &size, nullptr, &size2, &usename);
+			if(GetLastError() != ERROR_INSUFFICIENT_BUFFER){
+				return false;
+			}
+			std::wstring name(size, L'\0');
+			std::wstring name2(size2, L'\0');
+			if(LookupAccountSidW(nullptr, psid, &name.at(0), &size, &name2.at(0), &size2, &usename) == 0){
+				return false;
+			}
+			name.resize(size);
+			name2.resize(size2);
+			out = { ws2s(name), ws2s(name2) };
+			return true;
 		}
-		const size_t MAX_NAME_LENGTH = 256; // FIXME: handle error if name is not long enough(?)
-		std::wstring name(MAX_NAME_LENGTH, L'\1');
-		DWORD size = static_cast<DWORD>(name.size());
-		std::wstring name2(MAX_NAME_LENGTH, L'\1');
-		DWORD size2 = static_cast<DWORD>(name2.size());
-		SID_NAME_USE usename;
-		if(LookupAccountSidW(nullptr, psid, &name.at(0), &size, &name2.at(0), &size2, &usename ) == 0){
-			return{};
+
+		bool lookup_home(const std::string& ssid, std::string& out) override {
+			//HKEY_LOCAL_MACHINE\SOFTWARE\Microsoft\Windows NT\CurrentVersion\ProfileList\S-1-5-21-13210259-1748602183-1043662369-1001
+			// -> ProfileImagePath
+			try{
+				auto reg = registry::OpenKey(HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\ProfileList\\" + ssid);
+				out = registry::QueryString(reg.get(), "ProfileImagePath");
+				return true;
+			} catch(const std::runtime_error&){
+				return false;
+			}
 		}
-		name.resize(size);
-		name2.resize(size2);
-		const auto nametoreturn = ws2s(name).c_str();
-		const auto nametoreturn2 = ws2s(name2).c_str();
-		return{ nametoreturn, nametoreturn2 };
+	};
+
+	/// cache shared by sid_to_username and getuser_home
+	inline SidCache& sidcache(){
+		static Win32SidResolver resolver;
+		static SidCache cache(resolver);
+		return cache;
 	}
 
-	inline std::string getuser_home(const std::string& ssid){
-		//HKEY_LOCAL_MACHINE\SOFTWARE\Microsoft\Windows NT\CurrentVersion\ProfileList\S-1-5-21-13210259-1748602183-1043662369-1001
-		// -> ProfileImagePath
-		try{
-			auto reg = registry::OpenKey(HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\ProfileList\\" + ssid);
-			return registry::QueryString(reg.get(), "ProfileImagePath");
-		} catch(const std::runtime_error&){
-			return "";
-		}
+	// return empty string if unable to get username
+	inline std::pair<std::string , std::string> sid_to_username(const std::string& sid_){
+		return sidcache().username(sid_);
 	}
-	// gets size for saving XML data, inclusive one or more trailing '\0'
-	inline size_t getRequiredSize_XML(const EVT_HANDLE hEvent) {
-		DWORD dwBufferUsed = 0;
-		if (EvtRender(nullptr, hEvent, EvtRenderEventXml, 0, nullptr, &dwBufferUsed, nullptr)) {
-			return 0;
-		}
-		DWORD status = GetLastError();
-		if (ERROR_INSUFFICIENT_BUFFER != status) {
-			throw std::runtime_error("unexpected error while querying size for message:" + std::to_string(status));
-		}
-		return dwBufferUsed / 2;
+
+	inline std::string getuser_home(const std::string& ssid){
+		return sidcache().home(ssid);
 	}
 
+	/// Renders events as XML, reusing the same buffers for all events (of a subscription)
+	/// Rendering is tried with the current buffer, which grows only when an event does not fit, so most events need a single EvtRender call.
+	class RenderContext {
+	public:
+		/// the returned string is valid until the next call
+		const std::string& render(const EVT_HANDLE hEvent) {
+			if (buffer.empty()) {
+				buffer.resize(4096);
+			}
+			DWORD dwBufferUsed = 0;
+			DWORD dwPropertyCount = 0;
+			if (!EvtRender(nullptr, hEvent, EvtRenderEventXml, static_cast<DWORD>(buffer.size() * sizeof(wchar_t)), buffer.data(), &dwBufferUsed, &dwPropertyCount)) {
+				const DWORD status = GetLastError();
+				if (ERROR_INSUFFICIENT_BUFFER != status) {
+					throw std::runtime_error("unexpected error while querying message:" + std::to_string(status));
+				}
+				buffer.resize((std::max)(dwBufferUsed / sizeof(wchar_t) + 1, 2 * buffer.size()));
+				if (!EvtRender(nullptr, hEvent, EvtRenderEventXml, static_cast<DWORD>(buffer.size() * sizeof(wchar_t)), buffer.data(), &dwBufferUsed, &dwPropertyCount)) {
+					throw std::runtime_error("unexpected error while querying message:" + std::to_string(GetLastError()));
+				}
+			}
+			std::size_t size = dwBufferUsed / sizeof(wchar_t);
+			while (size != 0 && buffer[size - 1] == L'\0') {
+				--size;
+			}
+			utf::to_utf8(buffer.data(), size, out);
+			return out;
+		}
+	private:
+		std::vector<wchar_t> buffer;
+		std::string out;
+	};
 
 	inline std::string get_rendered_content(const EVT_HANDLE hEvent)
 	{
-		DWORD dwBufferUsed = 0;
-		std::wstring renderedContent(getRequiredSize_XML(hEvent), L'\0');
-
-		if (!EvtRender(nullptr, hEvent, EvtRenderEventXml, static_cast<DWORD>(renderedContent.size()) * sizeof(wchar_t), &renderedContent.at(0), &dwBufferUsed, nullptr)) {
-			const DWORD status = GetLastError(); assert(ERROR_INSUFFICIENT_BUFFER != status);
-			throw std::runtime_error("unexpected error while querying message:" + std::to_string(status));
-		}
-		std::string toreturn = ws2s(renderedContent);
-		toreturn.erase(toreturn.find_last_not_of('\0') + 1);
-		return toreturn;
+		RenderContext context;
+		return context.render(hEvent);
 	}
 
 	// fixme: make subscription part as static function, and callback with template parameter where to pass static function and handle exception/deregistration(?)
@@ -178,6 +221,85 @@ namespace evtlog{
 
 	static_assert(std::is_same<decltype(&SubscriptionCallback), EVT_SUBSCRIBE_CALLBACK>::value, "not same type");
 
+	/// Live events of a channel, delivered by EvtSubscribe
+	/// run blocks until stop is called, events are delivered on a thread of the event log service
+	class SubscriptionSource final : public EventSource {
+	public:
+		/// with afterrecord (for example Journal::bookmark) the subscription starts after that record, and flags are ignored
+		explicit SubscriptionSource(std::wstring path_ = L"Application", std::wstring query_ = L"*[System/EventID=866]", const DWORD flags_ = EvtSubscribeToFutureEvents,
+			const std::uint64_t afterrecord_ = 0)
+			: path(std::move(path_)), query(std::move(query_)), flags(flags_), afterrecord(afterrecord_) {}
+
+		std::size_t run(const callback& cb_) override {
+			std::unique_lock<std::mutex> lock(mutex);
+			const details::clearonexit clear{ stopped }; // after hSubscription has been closed, deliver checks the flag
+			if (stopped) {
+				return 0;
+			}
+			cb = &cb_;
+			delivered = 0;
+			error = nullptr;
+			RAII_EVTHANDLE bookmark;
+			if (afterrecord != 0) {
+				bookmark.reset(EvtCreateBookmark(s2ws(bookmark_xml(ws2s(path), afterrecord)).c_str()));
+				if (!bookmark) {
+					throw std::runtime_error("unable to create bookmark: " + std::to_string(GetLastError()));
+				}
+			}
+			RAII_EVTHANDLE hSubscription(EvtSubscribe(nullptr, nullptr, path.c_str(), query.c_str(), bookmark.get(), this, &SubscriptionSource::deliver,
+				bookmark ? EvtSubscribeStartAfterBookmark : flags));
+			if (!hSubscription) {
+				throw std::runtime_error("unable to subscribe to the event log: " + std::to_string(GetLastError()));
+			}
+			cv.wait(lock, [this]{ return stopped.load(); });
+			lock.unlock();
+			hSubscription.reset(); // waits for the callback currently running
+			if (error) {
+				std::rethrow_exception(error);
+			}
+			return delivered;
+		}
+
+		void stop() override {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopped = true;
+			}
+			cv.notify_all();
+		}
+
+	private:
+		std::wstring path;
+		std::wstring query;
+		DWORD flags;
+		std::uint64_t afterrecord;
+		const callback* cb = nullptr;
+		std::size_t delivered = 0;
+		std::exception_ptr error;
+		RenderContext context;
+		std::atomic<bool> stopped{ false };
+		std::mutex mutex;
+		std::condition_variable cv;
+
+		static DWORD WINAPI deliver(const EVT_SUBSCRIBE_NOTIFY_ACTION action, const PVOID pContext, const EVT_HANDLE hEvent) {
+			assert(pContext != nullptr);
+			const auto self = reinterpret_cast<SubscriptionSource*>(pContext);
+			if (action != EvtSubscribeActionDeliver || self->stopped) {
+				return ERROR_SUCCESS;
+			}
+			try {
+				const auto& xml = self->context.render(hEvent);
+				(*self->cb)(xml.data(), xml.size());
+				++self->delivered;
+				return ERROR_SUCCESS;
+			} catch (...) {
+				self->error = std::current_exception();
+				self->stop();
+				return ERROR_INVALID_DATA;
+			}
+		}
+	};
+
 
 
 	inline void test()
@@ -0,0 +1,175 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "initokenizer.hpp"
+
+// std
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INITOKENIZER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// avx2 is enabled only for the function that uses it, the cpu is checked at runtime
+#if defined(INITOKENIZER_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define INITOKENIZER_AVX2 1
+#define INITOKENIZER_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(INITOKENIZER_SSE2) && defined(_MSC_VER)
+#define INITOKENIZER_AVX2 1
+#define INITOKENIZER_TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace iniparser {
+
+	namespace {
+		const char tokenchars[] = { '\n', '=', '[', ']', '"', ';', '#', '/' };
+
+		struct tokentable {
+			bool istoken[256] = {};
+			tokentable() {
+				for (const auto c : tokenchars) {
+					istoken[static_cast<unsigned char>(c)] = true;
+				}
+			}
+		};
+
+		void tokenize_scalar(const char* data, const std::size_t begin, const std::size_t size, std::vector<std::size_t>& tokens) {
+			static const tokentable table;
+			for (std::size_t i = begin; i != size; ++i) {
+				if (table.istoken[static_cast<unsigned char>(data[i])]) {
+					tokens.push_back(i);
+				}
+			}
+		}
+
+		inline unsigned countzeros(const std::uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return static_cast<unsigned>(index);
+#else
+			return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+		}
+
+		inline void pushmask(std::uint32_t mask, const std::size_t offset, std::vector<std::size_t>& tokens) {
+			while (mask != 0) {
+				tokens.push_back(offset + countzeros(mask));
+				mask &= mask - 1; // clear lowest bit
+			}
+		}
+
+#if defined(INITOKENIZER_SSE2)
+		std::size_t tokenize_sse2(const char* data, const std::size_t size, std::vector<std::size_t>& tokens) {
+			__m128i needles[sizeof(tokenchars)];
+			for (std::size_t j = 0; j != sizeof(tokenchars); ++j) {
+				needles[j] = _mm_set1_epi8(tokenchars[j]);
+			}
+			std::size_t i = 0;
+			for (; i + 16 <= size; i += 16) {
+				const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				__m128i match = _mm_cmpeq_epi8(chunk, needles[0]);
+				for (std::size_t j = 1; j != sizeof(tokenchars); ++j) {
+					match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, needles[j]));
+				}
+				pushmask(static_cast<std::uint32_t>(_mm_movemask_epi8(match)), i, tokens);
+			}
+			return i;
+		}
+#endif
+
+#if defined(INITOKENIZER_AVX2)
+		INITOKENIZER_TARGET_AVX2
+		std::size_t tokenize_avx2(const char* data, const std::size_t size, std::vector<std::size_t>& tokens) {
+			__m256i needles[sizeof(tokenchars)];
+			for (std::size_t j = 0; j != sizeof(tokenchars); ++j) {
+				needles[j] = _mm256_set1_epi8(tokenchars[j]);
+			}
+			std::size_t i = 0;
+			for (; i + 32 <= size; i += 32) {
+				const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				__m256i match = _mm256_cmpeq_epi8(chunk, needles[0]);
+				for (std::size_t j = 1; j != sizeof(tokenchars); ++j) {
+					match = _mm256_or_si256(match, _mm256_cmpeq_epi8(chunk, needles[j]));
+				}
+				pushmask(static_cast<std::uint32_t>(_mm256_movemask_epi8(match)), i, tokens);
+			}
+			return i;
+		}
+
+		bool cpusupportsavx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) {
+				return false;
+			}
+			__cpuid(info, 1);
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx = (info[2] & (1 << 28)) != 0;
+			if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) { // os saves ymm registers
+				return false;
+			}
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") != 0;
+#endif
+		}
+#endif
+	}
+
+	simdlevel detectsimdlevel() {
+#if defined(INITOKENIZER_AVX2)
+		static const bool avx2 = cpusupportsavx2();
+		if (avx2) {
+			return simdlevel::avx2;
+		}
+#endif
+#if defined(INITOKENIZER_SSE2)
+		return simdlevel::sse2;
+#else
+		return simdlevel::scalar;
+#endif
+	}
+
+	void tokenize(const char* data, const std::size_t size, std::vector<std::size_t>& tokens, simdlevel level) {
+		const auto best = detectsimdlevel();
+		if (static_cast<int>(level) > static_cast<int>(best)) {
+			level = best;
+		}
+		std::size_t done = 0;
+		switch (level) {
+#if defined(INITOKENIZER_AVX2)
+			case simdlevel::avx2: done = tokenize_avx2(data, size, tokens); break;
+#endif
+#if defined(INITOKENIZER_SSE2)
+			case simdlevel::sse2: done = tokenize_sse2(data, size, tokens); break;
+#endif
+			case simdlevel::scalar:
+			default: break;
+		}
+		tokenize_scalar(data, done, size, tokens); // remaining bytes
+	}
+}
@@ -0,0 +1,37 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// std
+#include <vector>
+#include <cstddef>
+
+namespace iniparser {
+
+	/// instruction set used by tokenize
+	enum class simdlevel { scalar, sse2, avx2 };
+
+	/// best level supported by the compiler and the cpu, detected once
+	simdlevel detectsimdlevel();
+
+	/// Finds, in a single pass over the buffer, the offsets of all characters that are relevant for the ini syntax:
+	/// '\n', '=', '[', ']', '"', ';', '#' and '/' (a comment starts with "//" or "/*", and a multiline comment ends with "*/").
+	/// The character of a token is data[offset], offsets are appended to tokens in increasing order.
+	/// 16 (sse2) or 32 (avx2) bytes are classified at once, requesting an unsupported level falls back to the best supported one
+	void tokenize(const char* data, const std::size_t size, std::vector<std::size_t>& tokens, simdlevel level = detectsimdlevel());
+}
@@ -0,0 +1,426 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "journal.hpp"
+#if defined(_WIN32)
+#include "common.hpp"
+#endif
+
+// std
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+
+namespace evtlog {
+
+	namespace {
+		const std::uint32_t magic = 0x314A5553; // "SUJ1"
+
+		void put32(char* out, const std::uint32_t v) {
+			for (int i = 0; i != 4; ++i) {
+				out[i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+			}
+		}
+		void put64(char* out, const std::uint64_t v) {
+			for (int i = 0; i != 8; ++i) {
+				out[i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+			}
+		}
+		std::uint32_t get32(const char* in) {
+			std::uint32_t v = 0;
+			for (int i = 3; i >= 0; --i) {
+				v = (v << 8) | static_cast<unsigned char>(in[i]);
+			}
+			return v;
+		}
+		std::uint64_t get64(const char* in) {
+			std::uint64_t v = 0;
+			for (int i = 7; i >= 0; --i) {
+				v = (v << 8) | static_cast<unsigned char>(in[i]);
+			}
+			return v;
+		}
+
+		void putvarint(std::string& out, std::uint64_t v) {
+			while (v >= 0x80) {
+				out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+				v >>= 7;
+			}
+			out.push_back(static_cast<char>(v));
+		}
+		std::uint64_t zigzag(const std::int64_t v) {
+			return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+		}
+		std::int64_t unzigzag(const std::uint64_t v) {
+			return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+		}
+		void putstring(std::string& out, const std::string& s) {
+			putvarint(out, s.size());
+			out.append(s);
+		}
+
+		// reads from a decoded payload, throws if the data is not valid
+		struct reader {
+			const char* it;
+			const char* end;
+
+			std::uint64_t varint() {
+				std::uint64_t v = 0;
+				for (int shift = 0; shift < 64; shift += 7) {
+					if (it == end) {
+						throw std::runtime_error("corrupted journal");
+					}
+					const auto byte = static_cast<unsigned char>(*it++);
+					v |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+					if ((byte & 0x80) == 0) {
+						return v;
+					}
+				}
+				throw std::runtime_error("corrupted journal");
+			}
+			std::size_t size(const std::size_t max) {
+				const auto v = varint();
+				if (v > max) {
+					throw std::runtime_error("corrupted journal");
+				}
+				return static_cast<std::size_t>(v);
+			}
+			// position in a table with count entries
+			std::size_t index(const std::size_t count) {
+				const auto v = varint();
+				if (v >= count) {
+					throw std::runtime_error("corrupted journal");
+				}
+				return static_cast<std::size_t>(v);
+			}
+			void bytes(const std::size_t n, std::string& out) {
+				if (static_cast<std::size_t>(end - it) < n) {
+					throw std::runtime_error("corrupted journal");
+				}
+				out.append(it, n);
+				it += n;
+			}
+		};
+
+		std::uint32_t checksum(const std::string& data) {
+			std::uint32_t h = 2166136261u;
+			for (const char c : data) {
+				h ^= static_cast<unsigned char>(c);
+				h *= 16777619u;
+			}
+			return h;
+		}
+
+		void bloombits(const uid::BinaryUUID& rule, std::size_t (&bits)[3]) {
+			std::uint64_t h = 14695981039346656037ULL;
+			for (std::size_t i = 0; i != 16; ++i) {
+				h ^= rule.data()[i];
+				h *= 1099511628211ULL;
+			}
+			for (auto& b : bits) {
+				b = static_cast<std::size_t>(h & 0xFF);
+				h >>= 8;
+			}
+		}
+
+		void open(std::fstream& file, const std::string& filename, const std::ios::openmode mode) {
+#if defined(_WIN32)
+			file.open(s2ws(filename), mode); // the narrow version would use the ansi codepage
+#else
+			file.open(filename, mode);
+#endif
+		}
+
+		// index of s in the table, adds it if missing
+		std::size_t lookup(std::unordered_map<std::string, std::size_t>& table, std::vector<const std::string*>& values, const std::string& s) {
+			const auto it = table.emplace(s, values.size());
+			if (it.second) {
+				values.push_back(&it.first->first);
+			}
+			return it.first->second;
+		}
+
+		std::size_t commonprefix(const std::string& l, const std::string& r) {
+			const auto n = (std::min)(l.size(), r.size());
+			std::size_t i = 0;
+			while (i != n && l[i] == r[i]) {
+				++i;
+			}
+			return i;
+		}
+	}
+
+	Journal::Journal(const std::string& filename, const std::size_t blockevents_) : blockevents(blockevents_) {
+		if (blockevents == 0) {
+			throw std::runtime_error("invalid block size");
+		}
+		open(file, filename, std::ios::in | std::ios::out | std::ios::binary);
+		if (!file.is_open()) { // does not exist yet
+			file.clear();
+			open(file, filename, std::ios::out | std::ios::binary);
+			file.close();
+			open(file, filename, std::ios::in | std::ios::out | std::ios::binary);
+		}
+		if (!file.is_open()) {
+			throw std::runtime_error("unable to open journal " + filename);
+		}
+		load();
+		pending.reserve(blockevents);
+	}
+
+	Journal::~Journal() {
+		try {
+			flush();
+		} catch (...) {
+		}
+	}
+
+	void Journal::load() {
+		char raw[headersize];
+		while (true) {
+			file.clear();
+			file.seekg(static_cast<std::streamoff>(end));
+			if (!file.read(raw, headersize) || get32(raw) != magic) {
+				break;
+			}
+			header h;
+			h.count = get32(raw + 4);
+			h.payloadsize = get32(raw + 8);
+			h.checksum = get32(raw + 12);
+			h.mintime = static_cast<std::int64_t>(get64(raw + 16));
+			h.maxtime = static_cast<std::int64_t>(get64(raw + 24));
+			h.lastrecord = get64(raw + 32);
+			for (std::size_t i = 0; i != 4; ++i) {
+				h.bloom[i] = get64(raw + 40 + 8 * i);
+			}
+			buffer.resize(h.payloadsize);
+			if (h.payloadsize != 0 && !file.read(&buffer[0], static_cast<std::streamsize>(h.payloadsize))) {
+				break;
+			}
+			if (checksum(buffer) != h.checksum) {
+				break;
+			}
+			index.push_back({ end + headersize, h });
+			end += headersize + h.payloadsize;
+			if (h.lastrecord != 0) {
+				lastrecord = h.lastrecord;
+			}
+			lasttime = (std::max)(lasttime, h.maxtime);
+		}
+		file.clear();
+	}
+
+	bool Journal::append(const BlockedEvent& e) {
+		if (e.record != 0) {
+			if (previous != 0 ? e.record == previous : (e.record <= lastrecord && e.time <= lasttime)) {
+				return false;
+			}
+			previous = e.record;
+		}
+		pending.push_back(e);
+		if (pending.size() == blockevents) {
+			flush();
+		}
+		return true;
+	}
+
+	void Journal::flush() {
+		if (pending.empty()) {
+			return;
+		}
+		header h;
+		h.count = static_cast<std::uint32_t>(pending.size());
+		h.mintime = (std::numeric_limits<std::int64_t>::max)();
+		h.maxtime = (std::numeric_limits<std::int64_t>::min)();
+
+		// tables of the distinct values
+		std::unordered_map<std::string, std::size_t> strings;
+		std::vector<const std::string*> stringvalues;
+		std::vector<uid::BinaryUUID> rules;
+		std::vector<std::size_t> userids;
+		std::vector<std::size_t> rulepathids;
+		std::vector<std::size_t> ruleids;
+		userids.reserve(pending.size());
+		rulepathids.reserve(pending.size());
+		ruleids.reserve(pending.size());
+		for (const auto& e : pending) {
+			h.mintime = (std::min)(h.mintime, e.time);
+			h.maxtime = (std::max)(h.maxtime, e.time);
+			if (e.record != 0) {
+				h.lastrecord = e.record; // of the last event, lower than the others after a reset of the channel
+			}
+			userids.push_back(lookup(strings, stringvalues, e.user));
+			rulepathids.push_back(lookup(strings, stringvalues, e.rulepath));
+			if (e.rule.isnil()) {
+				ruleids.push_back(0);
+				continue;
+			}
+			auto it = std::find(rules.begin(), rules.end(), e.rule);
+			if (it == rules.end()) {
+				rules.push_back(e.rule);
+				it = rules.end() - 1;
+				std::size_t bits[3];
+				bloombits(e.rule, bits);
+				for (const auto b : bits) {
+					h.bloom[b / 64] |= std::uint64_t(1) << (b % 64);
+				}
+			}
+			ruleids.push_back(static_cast<std::size_t>(it - rules.begin()) + 1);
+		}
+
+		buffer.clear();
+		putvarint(buffer, stringvalues.size());
+		for (const auto s : stringvalues) {
+			putstring(buffer, *s);
+		}
+		putvarint(buffer, rules.size());
+		for (const auto& r : rules) {
+			buffer.append(reinterpret_cast<const char*>(r.data()), 16);
+		}
+		std::int64_t time = h.mintime;
+		std::uint64_t record = 0;
+		const std::string* previouspath = nullptr;
+		for (std::size_t i = 0; i != pending.size(); ++i) {
+			const auto& e = pending[i];
+			putvarint(buffer, zigzag(e.time - time));
+			putvarint(buffer, zigzag(static_cast<std::int64_t>(e.record - record)));
+			time = e.time;
+			record = e.record;
+			putvarint(buffer, userids[i]);
+			putvarint(buffer, rulepathids[i]);
+			putvarint(buffer, ruleids[i]);
+			const auto prefix = previouspath == nullptr ? 0 : commonprefix(*previouspath, e.path);
+			putvarint(buffer, prefix);
+			putvarint(buffer, e.path.size() - prefix);
+			buffer.append(e.path, prefix, std::string::npos);
+			previouspath = &e.path;
+		}
+		if (buffer.size() > (std::numeric_limits<std::uint32_t>::max)()) {
+			throw std::runtime_error("journal block too big");
+		}
+		h.payloadsize = static_cast<std::uint32_t>(buffer.size());
+		h.checksum = checksum(buffer);
+
+		char raw[headersize];
+		put32(raw, magic);
+		put32(raw + 4, h.count);
+		put32(raw + 8, h.payloadsize);
+		put32(raw + 12, h.checksum);
+		put64(raw + 16, static_cast<std::uint64_t>(h.mintime));
+		put64(raw + 24, static_cast<std::uint64_t>(h.maxtime));
+		put64(raw + 32, h.lastrecord);
+		for (std::size_t i = 0; i != 4; ++i) {
+			put64(raw + 40 + 8 * i, h.bloom[i]);
+		}
+		file.clear();
+		file.seekp(static_cast<std::streamoff>(end));
+		file.write(raw, headersize);
+		file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+		file.flush();
+		if (!file) {
+			file.clear();
+			throw std::runtime_error("error while writing journal");
+		}
+		index.push_back({ end + headersize, h });
+		end += headersize + h.payloadsize;
+		if (h.lastrecord != 0) {
+			lastrecord = h.lastrecord;
+		}
+		lasttime = (std::max)(lasttime, h.maxtime);
+		pending.clear();
+	}
+
+	std::vector<BlockedEvent> Journal::query(const std::int64_t from, const std::int64_t to, const uid::BinaryUUID& rule) {
+		const bool anyrule = rule.isnil();
+		std::size_t bits[3];
+		bloombits(rule, bits);
+		const auto matches = [&](const BlockedEvent& e){ return e.time >= from && e.time < to && (anyrule || e.rule == rule); };
+
+		std::vector<BlockedEvent> toreturn;
+		lastblocksread = 0;
+		std::vector<std::string> strings;
+		std::vector<uid::BinaryUUID> rules;
+		for (const auto& b : index) {
+			if (b.h.maxtime < from || b.h.mintime >= to) {
+				continue;
+			}
+			if (!anyrule && !std::all_of(std::begin(bits), std::end(bits), [&](const std::size_t bit){ return (b.h.bloom[bit / 64] >> (bit % 64)) & 1; })) {
+				continue;
+			}
+			++lastblocksread;
+			buffer.resize(b.h.payloadsize);
+			file.clear();
+			file.seekg(static_cast<std::streamoff>(b.offset));
+			if (b.h.payloadsize != 0 && !file.read(&buffer[0], static_cast<std::streamsize>(b.h.payloadsize))) {
+				file.clear();
+				throw std::runtime_error("error while reading journal");
+			}
+			reader r{ buffer.data(), buffer.data() + buffer.size() };
+			strings.resize(r.size(b.h.payloadsize));
+			for (auto& s : strings) {
+				s.clear();
+				r.bytes(r.size(b.h.payloadsize), s);
+			}
+			rules.resize(r.size(static_cast<std::size_t>(r.end - r.it) / 16));
+			for (auto& u : rules) {
+				u = uid::BinaryUUID::from_bytes(reinterpret_cast<const std::uint8_t*>(r.it));
+				r.it += 16;
+			}
+			BlockedEvent e;
+			std::int64_t time = b.h.mintime;
+			std::uint64_t record = 0;
+			for (std::uint32_t i = 0; i != b.h.count; ++i) {
+				time += unzigzag(r.varint());
+				record += static_cast<std::uint64_t>(unzigzag(r.varint()));
+				e.time = time;
+				e.record = record;
+				e.user = strings[r.index(strings.size())];
+				e.rulepath = strings[r.index(strings.size())];
+				const auto ruleid = r.size(rules.size());
+				e.rule = ruleid == 0 ? uid::BinaryUUID() : rules[ruleid - 1];
+				const auto prefix = r.size(e.path.size());
+				e.path.resize(prefix);
+				r.bytes(r.size(b.h.payloadsize), e.path);
+				if (matches(e)) {
+					toreturn.push_back(e);
+				}
+			}
+		}
+		for (const auto& e : pending) {
+			if (matches(e)) {
+				toreturn.push_back(e);
+			}
+		}
+		return toreturn;
+	}
+
+	std::size_t Journal::size() const {
+		std::size_t toreturn = pending.size();
+		for (const auto& b : index) {
+			toreturn += b.h.count;
+		}
+		return toreturn;
+	}
+
+	std::string bookmark_xml(const std::string& channel, const std::uint64_t record) {
+		return "<BookmarkList><Bookmark Channel='" + channel + "' RecordId='" + std::to_string(record) + "' IsCurrent='true'/></BookmarkList>";
+	}
+}
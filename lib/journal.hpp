@@ -0,0 +1,105 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// local
+#include "blockedevent.hpp"
+#include "uuid.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <fstream>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+namespace evtlog {
+
+	/// Append-only file of blocked events, so that the history survives a restart
+	///
+	/// Events are written in blocks of blockevents events. Every block is compressed on its own: times and record ids as deltas (varint),
+	/// users and rule paths through a table of the distinct values of the block, and every path as the part that differs from the previous path.
+	/// Every block starts with a header with its time range, the last record id, and a bloom filter of its rules.
+	/// Only the headers are read when opening the journal, and a query reads only the blocks whose header matches.
+	///
+	/// A block that is not complete (for example if the program has been killed while writing) is ignored, and overwritten by the next block.
+	/// The record id of the last event on disk is the bookmark: after a restart the events up to it do not need to be read again.
+	/// Record ids start again from 1 when the channel is cleared or wraps around, so a record id lower than the previous one is accepted
+	/// as a new event, and the bookmark follows the last event, not the biggest record id.
+	class Journal {
+	public:
+		/// opens or creates the journal, throws std::runtime_error if the file cannot be used
+		explicit Journal(const std::string& filename, const std::size_t blockevents = 1024);
+		/// writes the pending events, errors are ignored
+		~Journal();
+		Journal(const Journal&) = delete;
+		Journal& operator=(const Journal&) = delete;
+
+		/// returns false if the event has already been added:
+		/// - in this run, its record id is the one of the previous event (a lower record id is a reset of the channel)
+		/// - as first event of this run, its record id is not after the bookmark and it is not newer than the events on disk
+		bool append(const BlockedEvent& e);
+		/// writes the pending events as a block
+		void flush();
+
+		/// record id of the last event on disk, 0 if none
+		std::uint64_t bookmark() const { return lastrecord; }
+		/// events (also the pending ones) with from <= time < to, and with the rule (nil for all rules), in the order they have been added
+		std::vector<BlockedEvent> query(const std::int64_t from, const std::int64_t to, const uid::BinaryUUID& rule = uid::BinaryUUID());
+
+		/// events on disk and pending
+		std::size_t size() const;
+		std::size_t blocks() const { return index.size(); }
+		/// blocks read from disk by the last query
+		std::size_t blocksread() const { return lastblocksread; }
+
+		static constexpr std::size_t headersize = 72;
+
+	private:
+		struct header {
+			std::uint32_t count = 0;
+			std::uint32_t payloadsize = 0;
+			std::uint32_t checksum = 0;
+			std::int64_t mintime = 0;
+			std::int64_t maxtime = 0;
+			std::uint64_t lastrecord = 0;
+			std::uint64_t bloom[4] = {};
+		};
+		struct blockinfo {
+			std::uint64_t offset; // of the payload
+			header h;
+		};
+
+		std::fstream file;
+		std::size_t blockevents;
+		std::uint64_t end = 0;             // where the next block is written
+		std::uint64_t lastrecord = 0;      // of the last event on disk
+		std::int64_t lasttime = (std::numeric_limits<std::int64_t>::min)(); // of the newest event on disk
+		std::uint64_t previous = 0;        // record id of the previous event appended in this run, 0 if none
+		std::vector<blockinfo> index;
+		std::vector<BlockedEvent> pending;
+		std::string buffer;                // reused for encoding and decoding
+		std::size_t lastblocksread = 0;
+
+		void load();
+	};
+
+	/// XML of a bookmark of the windows event log (for EvtCreateBookmark), for subscribing to the events after record
+	std::string bookmark_xml(const std::string& channel, const std::uint64_t record);
+}
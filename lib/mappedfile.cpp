@@ -0,0 +1,126 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mappedfile.hpp"
+
+#if defined(_WIN32)
+// local
+#include "common.hpp"
+#include "win_handles.hpp"
+
+// windows
+#include <Windows.h>
+#else
+// posix
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// std
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <utility>
+
+// cstd
+#include <cassert>
+
+#if defined(_WIN32)
+MappedFile::MappedFile(const std::string& filename) {
+	RAII_HANDLE file(::CreateFileW(s2ws(filename).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr));
+	if (file.get() == INVALID_HANDLE_VALUE) {
+		file.release(); // nothing to close
+		throw std::runtime_error("error while opening file");
+	}
+	LARGE_INTEGER size;
+	if (::GetFileSizeEx(file.get(), &size) == 0) {
+		throw std::runtime_error("error while reading file size");
+	}
+	if (size.QuadPart == 0) {
+		return;
+	}
+	if (static_cast<unsigned long long>(size.QuadPart) > (std::numeric_limits<std::size_t>::max)()) {
+		throw std::runtime_error("file too big to be mapped");
+	}
+	const RAII_HANDLE mapping(::CreateFileMappingW(file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+	if (!mapping) {
+		throw std::runtime_error("error while mapping file");
+	}
+	const auto view = ::MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		throw std::runtime_error("error while mapping file");
+	}
+	// the view keeps the mapping alive, handles can be closed
+	ptr = static_cast<const char*>(view);
+	len = static_cast<std::size_t>(size.QuadPart);
+}
+
+void MappedFile::unmap() noexcept {
+	if (ptr != nullptr) {
+		const auto res = ::UnmapViewOfFile(ptr); (void)res; assert(res != 0);
+	}
+}
+#else
+MappedFile::MappedFile(const std::string& filename) {
+	const int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("error while opening file");
+	}
+	struct stat st;
+	if (::fstat(fd, &st) != 0) {
+		::close(fd);
+		throw std::runtime_error("error while reading file size");
+	}
+	if (st.st_size == 0) {
+		::close(fd);
+		return;
+	}
+	void* view = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping stays valid
+	if (view == MAP_FAILED) {
+		throw std::runtime_error("error while mapping file");
+	}
+	ptr = static_cast<const char*>(view);
+	len = static_cast<std::size_t>(st.st_size);
+}
+
+void MappedFile::unmap() noexcept {
+	if (ptr != nullptr) {
+		const auto res = ::munmap(const_cast<char*>(ptr), len); (void)res; assert(res == 0);
+	}
+}
+#endif
+
+MappedFile::~MappedFile() {
+	unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : ptr(other.ptr), len(other.len) {
+	other.ptr = nullptr;
+	other.len = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		unmap();
+		ptr = std::exchange(other.ptr, nullptr);
+		len = std::exchange(other.len, 0);
+	}
+	return *this;
+}
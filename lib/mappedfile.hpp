@@ -0,0 +1,46 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// std
+#include <string>
+#include <cstddef>
+
+/// Read-only view of a whole file mapped in memory
+/// The content does not move when the object is moved, so pointers to the data stay valid as long as one object owns the mapping
+class MappedFile {
+public:
+	/// throws std::runtime_error if the file cannot be opened or mapped
+	explicit MappedFile(const std::string& filename);
+	~MappedFile();
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/// nullptr for empty files
+	const char* data() const { return ptr; }
+	std::size_t size() const { return len; }
+
+private:
+	const char* ptr = nullptr;
+	std::size_t len = 0;
+
+	void unmap() noexcept;
+};
@@ -0,0 +1,608 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "memoryhive.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <limits>
+#include <cstring>
+#include <cassert>
+
+namespace registry {
+
+	namespace {
+
+		struct rootkey {
+			HKEY hk;
+			const wchar_t* name;
+		};
+		const std::array<rootkey, 5> rootkeys = { {
+			{ HKEY_CLASSES_ROOT,   L"HKEY_CLASSES_ROOT" },
+			{ HKEY_CURRENT_USER,   L"HKEY_CURRENT_USER" },
+			{ HKEY_LOCAL_MACHINE,  L"HKEY_LOCAL_MACHINE" },
+			{ HKEY_USERS,          L"HKEY_USERS" },
+			{ HKEY_CURRENT_CONFIG, L"HKEY_CURRENT_CONFIG" },
+		} };
+
+		constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+		std::size_t rootindex(const HKEY hk) {
+			for (std::size_t i = 0; i != rootkeys.size(); ++i) {
+				if (rootkeys[i].hk == hk) {
+					return i;
+				}
+			}
+			return npos;
+		}
+
+		std::size_t rootindex(const std::wstring& name) {
+			for (std::size_t i = 0; i != rootkeys.size(); ++i) {
+				if (name == rootkeys[i].name) {
+					return i;
+				}
+			}
+			return npos;
+		}
+
+		// the registry is case insensitive, only ascii characters are folded
+		std::wstring fold(std::wstring s) {
+			for (auto& c : s) {
+				if (c >= L'a' && c <= L'z') {
+					c = static_cast<wchar_t>(c - L'a' + L'A');
+				}
+			}
+			return s;
+		}
+
+		// empty elements (for example a trailing '\') are ignored
+		std::vector<std::wstring> split(const std::wstring& subkey) {
+			std::vector<std::wstring> toreturn;
+			std::wstring::size_type begin = 0;
+			while (begin <= subkey.size()) {
+				auto end = subkey.find(L'\\', begin);
+				if (end == std::wstring::npos) {
+					end = subkey.size();
+				}
+				if (end != begin) {
+					toreturn.emplace_back(subkey, begin, end - begin);
+				}
+				begin = end + 1;
+			}
+			return toreturn;
+		}
+
+		// handles are indexes in the handle table, predefined keys have far greater values
+		HKEY to_hkey(const std::size_t index) {
+			return reinterpret_cast<HKEY>(static_cast<ULONG_PTR>(index + 1));
+		}
+		std::size_t from_hkey(const HKEY hk) {
+			return static_cast<std::size_t>(reinterpret_cast<ULONG_PTR>(hk)) - 1;
+		}
+		HANDLE to_handle(const std::size_t index) {
+			return reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(index + 1));
+		}
+		std::size_t from_handle(const HANDLE h) {
+			return static_cast<std::size_t>(reinterpret_cast<ULONG_PTR>(h)) - 1;
+		}
+	}
+
+	MemoryHive::MemoryHive() {
+		hive.keys.reserve(rootkeys.size());
+		for (const auto& v : rootkeys) {
+			hive.keys.push_back(keyentry{ v.name, fold(v.name), npos, {}, {}, false });
+		}
+	}
+
+	std::size_t MemoryHive::findchild(const store& st, const std::size_t parent, const std::wstring& foldedname) {
+		const auto& subkeys = st.keys[parent].subkeys;
+		const auto it = std::lower_bound(subkeys.begin(), subkeys.end(), foldedname, [&st](const std::size_t k, const std::wstring& name) {
+			return st.keys[k].foldedname < name;
+		});
+		if (it != subkeys.end() && st.keys[*it].foldedname == foldedname) {
+			return *it;
+		}
+		return npos;
+	}
+
+	std::size_t MemoryHive::findpath(const store& st, std::size_t from, const std::vector<std::wstring>& path) {
+		for (const auto& v : path) {
+			from = findchild(st, from, fold(v));
+			if (from == npos) {
+				return npos;
+			}
+		}
+		return from;
+	}
+
+	std::size_t MemoryHive::createpath(store& st, std::size_t from, const std::vector<std::wstring>& path) {
+		for (const auto& v : path) {
+			auto foldedname = fold(v);
+			const auto child = findchild(st, from, foldedname);
+			if (child != npos) {
+				from = child;
+				continue;
+			}
+			const auto newkey = st.keys.size();
+			st.keys.push_back(keyentry{ v, std::move(foldedname), from, {}, {}, false });
+			auto& subkeys = st.keys[from].subkeys;
+			const auto pos = std::lower_bound(subkeys.begin(), subkeys.end(), st.keys[newkey].foldedname, [&st](const std::size_t k, const std::wstring& name) {
+				return st.keys[k].foldedname < name;
+			});
+			subkeys.insert(pos, newkey);
+			from = newkey;
+		}
+		return from;
+	}
+
+	void MemoryHive::clearkey(store& st, const std::size_t key) {
+		std::vector<std::size_t> toremove;
+		toremove.swap(st.keys[key].subkeys);
+		while (!toremove.empty()) {
+			const auto k = toremove.back();
+			toremove.pop_back();
+			auto& entry = st.keys[k];
+			entry.deleted = true;
+			entry.values.clear();
+			toremove.insert(toremove.end(), entry.subkeys.begin(), entry.subkeys.end());
+			entry.subkeys.clear();
+		}
+		st.keys[key].values.clear();
+	}
+
+	void MemoryHive::removekey(store& st, const std::size_t key) {
+		assert(st.keys[key].parent != npos && "root keys cannot be removed");
+		clearkey(st, key);
+		auto& subkeys = st.keys[st.keys[key].parent].subkeys;
+		subkeys.erase(std::find(subkeys.begin(), subkeys.end(), key));
+		st.keys[key].deleted = true;
+	}
+
+	std::vector<std::wstring> MemoryHive::pathof(const store& st, std::size_t key) {
+		std::vector<std::wstring> toreturn;
+		for (; key != npos; key = st.keys[key].parent) {
+			toreturn.push_back(st.keys[key].name);
+		}
+		std::reverse(toreturn.begin(), toreturn.end());
+		return toreturn;
+	}
+
+	void MemoryHive::setvalue(keyentry& k, const std::wstring& valuename, const DWORD type, const BYTE* data, const DWORD size) {
+		auto foldedname = fold(valuename);
+		const auto it = std::find_if(k.values.begin(), k.values.end(), [&foldedname](const valueentry& v) {return v.foldedname == foldedname; });
+		std::vector<BYTE> buffer(data, data + size);
+		if (it != k.values.end()) {
+			it->type = type;
+			it->data = std::move(buffer);
+			return;
+		}
+		k.values.push_back(valueentry{ valuename, std::move(foldedname), type, std::move(buffer) });
+	}
+
+	bool MemoryHive::removevalue(keyentry& k, const std::wstring& valuename) {
+		const auto foldedname = fold(valuename);
+		const auto it = std::find_if(k.values.begin(), k.values.end(), [&foldedname](const valueentry& v) {return v.foldedname == foldedname; });
+		if (it == k.values.end()) {
+			return false;
+		}
+		k.values.erase(it);
+		return true;
+	}
+
+	LONG MemoryHive::ensurecopy(const std::size_t trans) {
+		auto& t = transactions[trans];
+		if (t.st != transactionentry::state::active) {
+			return ERROR_TRANSACTION_NOT_ACTIVE;
+		}
+		if (!t.hascopy) {
+			t.copy = hive;
+			t.hascopy = true;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	MemoryHive::resolved MemoryHive::resolve(const HKEY hk, const bool forwriting) {
+		resolved r{ ERROR_SUCCESS, &hive, rootindex(hk), notransaction };
+		if (r.key == npos) {
+			const auto index = from_hkey(hk);
+			if (hk == nullptr || index >= handles.size() || !handles[index].inuse) {
+				r.res = ERROR_INVALID_HANDLE;
+				return r;
+			}
+			r.key = handles[index].key;
+			r.trans = handles[index].trans;
+		}
+		if (r.trans != notransaction) {
+			auto& t = transactions[r.trans];
+			if (t.st != transactionentry::state::active) {
+				r.res = ERROR_TRANSACTION_NOT_ACTIVE;
+				return r;
+			}
+			if (forwriting) {
+				r.res = ensurecopy(r.trans);
+			}
+			if (t.hascopy) {
+				r.st = &t.copy;
+			}
+		}
+		if (r.key >= r.st->keys.size()) { // created outside of the transaction, after the copy
+			r.res = ERROR_INVALID_HANDLE;
+		} else if (r.st->keys[r.key].deleted) {
+			r.res = ERROR_KEY_DELETED;
+		}
+		return r;
+	}
+
+	HKEY MemoryHive::newhandle(const std::size_t key, const std::size_t trans) {
+		const handleentry entry{ key, trans, true };
+		if (!freehandles.empty()) {
+			const auto index = freehandles.back();
+			freehandles.pop_back();
+			handles[index] = entry;
+			return to_hkey(index);
+		}
+		handles.push_back(entry);
+		return to_hkey(handles.size() - 1);
+	}
+
+	void MemoryHive::record(const resolved& r, const operation op, const std::wstring& name, const DWORD type, const BYTE* data, const DWORD size) {
+		if (r.trans == notransaction) {
+			return;
+		}
+		transactions[r.trans].log.push_back(logentry{ op, pathof(*r.st, r.key), name, type, std::vector<BYTE>(data, data + size) });
+	}
+
+	void MemoryHive::replay(const logentry& entry) {
+		assert(!entry.path.empty());
+		const auto root = rootindex(entry.path.at(0));
+		assert(root != npos);
+		const std::vector<std::wstring> path(entry.path.begin() + 1, entry.path.end());
+		switch (entry.op) {
+			case operation::createkey: {
+				createpath(hive, root, path);
+				return;
+			}
+			case operation::setvalue: {
+				const auto key = createpath(hive, root, path);
+				setvalue(hive.keys[key], entry.name, entry.type, entry.data.data(), static_cast<DWORD>(entry.data.size()));
+				return;
+			}
+			case operation::deletevalue: {
+				const auto key = findpath(hive, root, path);
+				if (key != npos) {
+					removevalue(hive.keys[key], entry.name);
+				}
+				return;
+			}
+			case operation::deletekey: {
+				const auto key = findpath(hive, root, path);
+				if (key != npos && key != root) {
+					removekey(hive, key);
+				}
+				return;
+			}
+			case operation::clearkey: {
+				const auto key = findpath(hive, root, path);
+				if (key != npos) {
+					clearkey(hive, key);
+				}
+				return;
+			}
+			default: {
+				assert(false && "missing enum");
+				return;
+			}
+		}
+	}
+
+	LONG MemoryHive::OpenKeyEx(const HKEY hk, const std::wstring& subkey, const DWORD, const REGSAM, HKEY* result) {
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto r = resolve(hk, false);
+		if (r.res != ERROR_SUCCESS) {
+			return r.res;
+		}
+		const auto key = findpath(*r.st, r.key, split(subkey));
+		if (key == npos) {
+			return ERROR_FILE_NOT_FOUND;
+		}
+		*result = newhandle(key, r.trans);
+		return ERROR_SUCCESS;
+	}
+
+	LONG MemoryHive::CreateKeyEx(const HKEY hk, const std::wstring& subkey, const DWORD, const REGSAM, const HANDLE transaction, HKEY* result) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto r = resolve(hk, true);
+		if (r.res != ERROR_SUCCESS) {
+			return r.res;
+		}
+		if (transaction != nullptr) {
+			const auto trans = from_handle(transaction);
+			if (trans >= transactions.size() || (r.trans != notransaction && r.trans != trans)) {
+				return ERROR_INVALID_PARAMETER;
+			}
+			const auto res = ensurecopy(trans);
+			if (res != ERROR_SUCCESS) {
+				return res;
+			}
+			r.st = &transactions[trans].copy;
+			r.trans = trans;
+			if (r.key >= r.st->keys.size() || r.st->keys[r.key].deleted) {
+				return ERROR_INVALID_HANDLE;
+			}
+		}
+		r.key = createpath(*r.st, r.key, split(subkey));
+		record(r, operation::createkey);
+		*result = newhandle(r.key, r.trans);
+		return ERROR_SUCCESS;
+	}
+
+	LONG MemoryHive::CloseKey(const HKEY hk) noexcept {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (rootindex(hk) != npos) {
+			return ERROR_SUCCESS;
+		}
+		const auto index = from_hkey(hk);
+		if (hk == nullptr || index >= handles.size() || !handles[index].inuse) {
+			return ERROR_INVALID_HANDLE;
+		}
+		handles[index].inuse = false;
+		freehandles.push_back(index);
+		return ERROR_SUCCESS;
+	}
+
+	LONG MemoryHive::SetValueEx(const HKEY hk, const std::wstring& valuename, const DWORD type, const BYTE* data, const DWORD size) {
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto r = resolve(hk, true);
+		if (r.res != ERROR_SUCCESS) {
+			return r.res;
+		}
+		setvalue(r.st->keys[r.key], valuename, type, data, size);
+		record(r, operation::setvalue, valuename, type, data, size);
+		return ERROR_SUCCESS;
+	}
+
+	LONG MemoryHive::QueryValueEx(const HKEY hk, const std::wstring& valuename, DWORD* type, BYTE* data, DWORD* size) {
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto r = resolve(hk, false);
+		if (r.res != ERROR_SUCCESS) {
+			return r.res;
+		}
+		const auto& values = r.st->keys[r.key].values;
+		const auto foldedname = fold(valuename);
+		const auto it = std::find_if(values.begin(), values.end(), [&foldedname](const valueentry& v) {return v.foldedname == foldedname; });
+		if (it == values.end()) {
+			return ERROR_FILE_NOT_FOUND;
+		}
+		if (type != nullptr) {
+			*type = it->type;
+		}
+		const auto datasize = static_cast<DWORD>(it->data.size());
+		if (data == nullptr) {
+			if (size != nullptr) {
+				*size = datasize;
+			}
+			return ERROR_SUCCESS;
+		}
+		if (size == nullptr) {
+			return ERROR_INVALID_PARAMETER;
+		}
+		if (*size < datasize) {
+			*size = datasize;
+			return ERROR_MORE_DATA;
+		}
+		if (datasize != 0) {
+			std::memcpy(data, it->data.data(), datasize);
+		}
+		*size = datasize;
+		return ERROR_SUCCESS;
+	}
+
+	LONG MemoryHive::DeleteValue(const HKEY hk, const std::wstring& valuename) {
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto r = resolve(hk, true);
+		if (r.res != ERROR_SUCCESS) {
+			return r.res;
+		}
+		if (!removevalue(r.st->keys[r.key], valuename)) {
+			return ERROR_FILE_NOT_FOUND;
+		}
+		record(r, operation::deletevalue, valuename);
+		return ERROR_SUCCESS;
+	}
+
+	LONG MemoryHive::DeleteKey(const HKEY hk, const std::wstring& subkey) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto r = resolve(hk, true);
+		if (r.res != ERROR_SUCCESS) {
+			return r.res;
+		}
+		const auto key = findpath(*r.st, r.key, split(subkey));
+		if (key == npos) {
+			return ERROR_FILE_NOT_FOUND;
+		}
+		if (r.st->keys[key].parent == npos || !r.st->keys[key].subkeys.empty()) {
+			return ERROR_ACCESS_DENIED;
+		}
+		r.key = key;
+		record(r, operation::deletekey);
+		removekey(*r.st, key);
+		return ERROR_SUCCESS;
+	}
+
+	LONG MemoryHive::DeleteTree(const HKEY hk, const std::wstring& subkey) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto r = resolve(hk, true);
+		if (r.res != ERROR_SUCCESS) {
+			return r.res;
+		}
+		const auto path = split(subkey);
+		if (path.empty()) { // like RegDeleteTree, removes content of the key, but not the key itself
+			record(r, operation::clearkey);
+			clearkey(*r.st, r.key);
+			return ERROR_SUCCESS;
+		}
+		const auto key = findpath(*r.st, r.key, path);
+		if (key == npos) {
+			return ERROR_FILE_NOT_FOUND;
+		}
+		r.key = key;
+		record(r, operation::deletekey);
+		removekey(*r.st, key);
+		return ERROR_SUCCESS;
+	}
+
+	LONG MemoryHive::QueryInfoKey(const HKEY hk, DWORD* cSubKeys, DWORD* cbMaxSubKey, DWORD* cValues, DWORD* cbMaxValueName, DWORD* cbMaxValueData) {
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto r = resolve(hk, false);
+		if (r.res != ERROR_SUCCESS) {
+			return r.res;
+		}
+		const auto& subkeys = r.st->keys[r.key].subkeys;
+		if (cSubKeys != nullptr) {
+			*cSubKeys = static_cast<DWORD>(subkeys.size());
+		}
+		if (cbMaxSubKey != nullptr) {
+			std::size_t maxsize = 0;
+			for (const auto& v : subkeys) {
+				maxsize = (std::max)(maxsize, r.st->keys[v].name.size());
+			}
+			*cbMaxSubKey = static_cast<DWORD>(maxsize);
+		}
+		const auto& values = r.st->keys[r.key].values;
+		if (cValues != nullptr) {
+			*cValues = static_cast<DWORD>(values.size());
+		}
+		if (cbMaxValueName != nullptr) {
+			std::size_t maxsize = 0;
+			for (const auto& v : values) {
+				maxsize = (std::max)(maxsize, v.name.size());
+			}
+			*cbMaxValueName = static_cast<DWORD>(maxsize);
+		}
+		if (cbMaxValueData != nullptr) {
+			std::size_t maxsize = 0;
+			for (const auto& v : values) {
+				maxsize = (std::max)(maxsize, v.data.size());
+			}
+			*cbMaxValueData = static_cast<DWORD>(maxsize);
+		}
+		return ERROR_SUCCESS;
+	}
+
+	LONG MemoryHive::EnumKeyEx(const HKEY hk, const DWORD index, wchar_t* name, DWORD* size) {
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto r = resolve(hk, false);
+		if (r.res != ERROR_SUCCESS) {
+			return r.res;
+		}
+		const auto& subkeys = r.st->keys[r.key].subkeys;
+		if (index >= subkeys.size()) {
+			return ERROR_NO_MORE_ITEMS;
+		}
+		const auto& keyname = r.st->keys[subkeys[index]].name;
+		if (*size <= keyname.size()) { // need space for the terminating null
+			return ERROR_MORE_DATA;
+		}
+		std::copy(keyname.begin(), keyname.end(), name);
+		name[keyname.size()] = L'\0';
+		*size = static_cast<DWORD>(keyname.size());
+		return ERROR_SUCCESS;
+	}
+
+	LONG MemoryHive::EnumValue(const HKEY hk, const DWORD index, wchar_t* name, DWORD* namesize, DWORD* type, BYTE* data, DWORD* datasize) {
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto r = resolve(hk, false);
+		if (r.res != ERROR_SUCCESS) {
+			return r.res;
+		}
+		const auto& values = r.st->keys[r.key].values;
+		if (index >= values.size()) {
+			return ERROR_NO_MORE_ITEMS;
+		}
+		const auto& value = values[index];
+		if (*namesize <= value.name.size()) { // need space for the terminating null
+			return ERROR_MORE_DATA;
+		}
+		const auto size = static_cast<DWORD>(value.data.size());
+		if (data != nullptr && (datasize == nullptr || *datasize < size)) {
+			if (datasize != nullptr) {
+				*datasize = size;
+			}
+			return ERROR_MORE_DATA;
+		}
+		std::copy(value.name.begin(), value.name.end(), name);
+		name[value.name.size()] = L'\0';
+		*namesize = static_cast<DWORD>(value.name.size());
+		if (type != nullptr) {
+			*type = value.type;
+		}
+		if (data != nullptr && size != 0) {
+			std::memcpy(data, value.data.data(), size);
+		}
+		if (datasize != nullptr) {
+			*datasize = size;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	LONG MemoryHive::CreateTransaction(HANDLE* result) {
+		std::lock_guard<std::mutex> lock(mutex);
+		transactions.push_back(transactionentry{ transactionentry::state::active, false, {}, {} });
+		*result = to_handle(transactions.size() - 1);
+		return ERROR_SUCCESS;
+	}
+
+	bool MemoryHive::CommitTransaction(const HANDLE transaction) {
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto index = from_handle(transaction);
+		if (transaction == nullptr || index >= transactions.size() || transactions[index].st != transactionentry::state::active) {
+			return false;
+		}
+		auto& t = transactions[index];
+		for (const auto& v : t.log) {
+			replay(v);
+		}
+		t.st = transactionentry::state::committed;
+		t.copy = store{};
+		t.log = std::vector<logentry>{};
+		return true;
+	}
+
+	void MemoryHive::CloseTransaction(const HANDLE transaction) noexcept {
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto index = from_handle(transaction);
+		if (transaction == nullptr || index >= transactions.size()) {
+			return;
+		}
+		// closing an active transaction is a rollback
+		auto& t = transactions[index];
+		t.st = transactionentry::state::closed;
+		t.copy = store{};
+		t.log = std::vector<logentry>{};
+	}
+
+	std::size_t MemoryHive::OpenHandles() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto keys = std::count_if(handles.begin(), handles.end(), [](const handleentry& h) {return h.inuse; });
+		const auto trans = std::count_if(transactions.begin(), transactions.end(), [](const transactionentry& t) {return t.st != transactionentry::state::closed; });
+		return static_cast<std::size_t>(keys + trans);
+	}
+}
@@ -0,0 +1,139 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// local
+#include "registry_backend.hpp"
+#include "win_types.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+namespace registry {
+
+	/// Registry kept in memory, used for testing and benchmarking the policy code without touching (or having) the windows registry
+	/// - all keys of all root hives are stored in a single vector, and reference each other by index
+	/// - subkeys are kept sorted by name (case insensitive, only ascii letters are folded) for binary search and enumeration
+	/// - values are stored in insertion order, there are normally only a few values per key
+	/// - a transaction works on a copy of the hive (created on the first write), and the recorded operations are replayed on the hive when committing
+	/// - deleted keys are never reused, open handles to them return ERROR_KEY_DELETED
+	/// - access rights and options (volatile, wow64) are ignored
+	class MemoryHive final : public Backend {
+	public:
+		MemoryHive();
+
+		LONG OpenKeyEx(const HKEY hk, const std::wstring& subkey, const DWORD dwOptions, const REGSAM samDesired, HKEY* result) override;
+		LONG CreateKeyEx(const HKEY hk, const std::wstring& subkey, const DWORD dwOptions, const REGSAM samDesired, const HANDLE transaction, HKEY* result) override;
+		LONG CloseKey(const HKEY hk) noexcept override;
+
+		LONG SetValueEx(const HKEY hk, const std::wstring& valuename, const DWORD type, const BYTE* data, const DWORD size) override;
+		LONG QueryValueEx(const HKEY hk, const std::wstring& valuename, DWORD* type, BYTE* data, DWORD* size) override;
+		LONG DeleteValue(const HKEY hk, const std::wstring& valuename) override;
+
+		LONG DeleteKey(const HKEY hk, const std::wstring& subkey) override;
+		LONG DeleteTree(const HKEY hk, const std::wstring& subkey) override;
+
+		LONG QueryInfoKey(const HKEY hk, DWORD* cSubKeys, DWORD* cbMaxSubKey, DWORD* cValues, DWORD* cbMaxValueName, DWORD* cbMaxValueData) override;
+		LONG EnumKeyEx(const HKEY hk, const DWORD index, wchar_t* name, DWORD* size) override;
+		LONG EnumValue(const HKEY hk, const DWORD index, wchar_t* name, DWORD* namesize, DWORD* type, BYTE* data, DWORD* datasize) override;
+
+		LONG CreateTransaction(HANDLE* result) override;
+		bool CommitTransaction(const HANDLE transaction) override;
+		void CloseTransaction(const HANDLE transaction) noexcept override;
+
+		/// number of handles (keys and transactions) not closed yet
+		std::size_t OpenHandles() const;
+
+	private:
+		struct valueentry {
+			std::wstring name;
+			std::wstring foldedname;
+			DWORD type;
+			std::vector<BYTE> data;
+		};
+
+		struct keyentry {
+			std::wstring name;
+			std::wstring foldedname;
+			std::size_t parent;
+			std::vector<std::size_t> subkeys; // sorted by foldedname
+			std::vector<valueentry> values;
+			bool deleted;
+		};
+
+		// all keys, the first ones are the predefined root keys
+		struct store {
+			std::vector<keyentry> keys;
+		};
+
+		enum class operation { createkey, setvalue, deletevalue, deletekey, clearkey };
+		struct logentry {
+			operation op;
+			std::vector<std::wstring> path; // from the root key, path.at(0) is the name of the root
+			std::wstring name;              // name of the value
+			DWORD type;
+			std::vector<BYTE> data;
+		};
+
+		struct transactionentry {
+			enum class state { active, committed, closed };
+			state st;
+			bool hascopy;
+			store copy;
+			std::vector<logentry> log;
+		};
+
+		static constexpr std::size_t notransaction = static_cast<std::size_t>(-1);
+		struct handleentry {
+			std::size_t key;
+			std::size_t trans;
+			bool inuse;
+		};
+
+		struct resolved {
+			LONG res;
+			store* st;
+			std::size_t key;
+			std::size_t trans;
+		};
+
+		mutable std::mutex mutex;
+		store hive;
+		std::vector<handleentry> handles;
+		std::vector<std::size_t> freehandles;
+		std::vector<transactionentry> transactions;
+
+		resolved resolve(const HKEY hk, const bool forwriting);
+		LONG ensurecopy(const std::size_t trans);
+		HKEY newhandle(const std::size_t key, const std::size_t trans);
+		void record(const resolved& r, const operation op, const std::wstring& name = L"", const DWORD type = REG_NONE, const BYTE* data = nullptr, const DWORD size = 0);
+		void replay(const logentry& entry);
+
+		static std::size_t findchild(const store& st, const std::size_t parent, const std::wstring& foldedname);
+		static std::size_t findpath(const store& st, std::size_t from, const std::vector<std::wstring>& path);
+		static std::size_t createpath(store& st, std::size_t from, const std::vector<std::wstring>& path);
+		static void removekey(store& st, const std::size_t key);
+		static void clearkey(store& st, const std::size_t key);
+		static std::vector<std::wstring> pathof(const store& st, std::size_t key);
+		static void setvalue(keyentry& k, const std::wstring& valuename, const DWORD type, const BYTE* data, const DWORD size);
+		static bool removevalue(keyentry& k, const std::wstring& valuename);
+	};
+}
@@ -25,16 +25,20 @@
 #include "common.hpp"
 #include "registry.hpp"
 #include "uuid.hpp"
-#include "win_handles.hpp"
-
-// windows
-#include <Windows.h>
+#include "policydiff.hpp"
+#include "utf.hpp"
+#include "win_types.hpp"
 
 //std
 #include <vector>
 #include <string>
 #include <stdexcept>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <algorithm>
 
 // FIXME: vedere se \\live.sysinternals.com\DavWWWRoot\Tools è eseguibuile quando disabilito tutti i drive! vedi: https://en.wikipedia.org/wiki/Path_%28computing%29#Representations_of_paths_by_operating_system_and_shell
 namespace policy{
@@ -165,14 +169,38 @@ namespace policy{
 		}
 	}
 
-	bool PolicyManager::SetPolicy(const policy_rule& p, const securitylevel sec, const std::string& uuid) {
-		const std::string seclevel = std::to_string(static_cast<int>(sec));
-		const auto key(registry::CreateKey(hkeyCodeIdentifiers.key.get(), seclevel + "\\Paths\\" + uuid, KEY_WRITE));
-		registry::SetValue(key.get(), L"Description", p.Description);
-		registry::SetValue(key.get(), L"SaferFlags", 0);
-		registry::SetValue(key.get(), L"Name", p.name);
-		registry::SetValue(key.get(), L"ItemData", p.ItemData, p.ItemDataType);
+	HKEY PolicyManager::getPaths(const securitylevel sec) {
+		auto& paths = hkeyPaths[sec == securitylevel::Disallowed ? 0 : 1];
+		if (!paths) {
+			const std::string seclevel = std::to_string(static_cast<int>(sec));
+			paths = registry::CreateKey(hkeyCodeIdentifiers.key.get(), seclevel + "\\Paths", KEY_WRITE);
+		}
+		return paths.get();
+	}
 
+	namespace {
+		const std::wstring valDescription(L"Description");
+		const std::wstring valSaferFlags(L"SaferFlags");
+		const std::wstring valName(L"Name");
+		const std::wstring valItemData(L"ItemData");
+
+		// buffer is reused between rules, to avoid allocating for every converted string
+		void setrule(const HKEY paths, const policy_rule& p, const std::string& uuid, std::wstring& buffer) {
+			utf::to_wide(uuid.data(), uuid.size(), buffer);
+			const auto key(registry::CreateKey(paths, buffer, KEY_WRITE));
+			utf::to_wide(p.Description.data(), p.Description.size(), buffer);
+			registry::SetValue(key.get(), valDescription, buffer);
+			registry::SetValue(key.get(), valSaferFlags, 0);
+			utf::to_wide(p.name.data(), p.name.size(), buffer);
+			registry::SetValue(key.get(), valName, buffer);
+			utf::to_wide(p.ItemData.data(), p.ItemData.size(), buffer);
+			registry::SetValue(key.get(), valItemData, buffer, p.ItemDataType);
+		}
+	}
+
+	bool PolicyManager::SetPolicy(const policy_rule& p, const securitylevel sec, const std::string& uuid) {
+		std::wstring buffer;
+		setrule(getPaths(sec), p, uuid, buffer);
 		return true;
 	}
 	bool PolicyManager::SetPolicy(const policy_rule& p, const securitylevel sec, const UUID& uuid) {
@@ -183,6 +211,22 @@ namespace policy{
 		return SetPolicy(p, sec, uid::createUUID());
 	}
 
+	bool PolicyManager::SetPolicies(const std::vector<policy_s>& policies) {
+		const auto missing = static_cast<std::size_t>(std::count_if(policies.begin(), policies.end(), [](const policy_s& v) { return v.UUID.empty(); }));
+		const auto newuuids = uid::generate(missing);
+		auto next = newuuids.begin();
+		std::wstring buffer;
+		std::string uuid;
+		for (const auto& v : policies) {
+			if (v.UUID.empty()) {
+				uuid.resize(uid::BinaryUUID::stringsize);
+				(next++)->format(&uuid[0]);
+			}
+			setrule(getPaths(v.sec), v.pol, v.UUID.empty() ? uuid : v.UUID, buffer);
+		}
+		return true;
+	}
+
 	bool PolicyManager::RemovePolicy(const securitylevel sec, const std::string& UUID) {
 		const std::string seclevel = std::to_string(static_cast<int>(sec));
 		const auto key(registry::OpenKeyOptional(hkeyCodeIdentifiers.key.get(), seclevel + "\\Paths\\", KEY_READ | KEY_WRITE));
@@ -192,6 +236,19 @@ namespace policy{
 		return false;
 	}
 
+	bool PolicyManager::Execute(const changeplan& plan) {
+		for (const auto& v : plan.toremove) {
+			RemovePolicy(v.sec, v.UUID);
+		}
+		for (const auto& v : plan.tomodify) {
+			if (v.from.sec != v.to.sec) {
+				RemovePolicy(v.from.sec, v.from.UUID);
+			}
+			SetPolicy(v.to.pol, v.to.sec, v.to.UUID);
+		}
+		return SetPolicies(plan.toadd);
+	}
+
 	bool PolicyManager::SetPolicyDisableDoubleExt(const std::vector<std::string>& doubleext) {
 
 		setEnforcementLevel(enforcementLevel::SkipDLLs);
@@ -200,12 +257,40 @@ namespace policy{
 
 		setSecurityLevel(securitylevel::Unrestricted);
 
-		const std::string description("WinSec, disable double extensions");
-		for (const auto& v : doubleext) {
-			policy_rule p;
-			p.Description = description;
-			p.ItemData = v;
-			SetPolicy(p, securitylevel::Disallowed);
+		const Atom description("WinSec, disable double extensions"); // interned once, not once per rule
+		std::vector<policy_s> rules(doubleext.size());
+		for (std::size_t i = 0; i != doubleext.size(); ++i) {
+			rules[i].pol.Description = description;
+			rules[i].pol.ItemData = doubleext[i];
+			rules[i].sec = securitylevel::Disallowed;
+		}
+		return SetPolicies(rules);
+	}
+
+	bool PolicyManager::SetPolicyDisableDoubleExt(const std::vector<std::string>& ext1, const std::vector<std::string>& ext2) {
+
+		setEnforcementLevel(enforcementLevel::SkipDLLs);
+
+		setPolicyScope(policyScope::AllUsers);
+
+		setSecurityLevel(securitylevel::Unrestricted);
+
+		policy_rule p;
+		p.Description = "WinSec, disable double extensions";
+		const auto paths = getPaths(securitylevel::Disallowed);
+		std::wstring buffer;
+		// UUIDs are generated in blocks, so that the memory does not depend on the number of pairs
+		uid::BinaryUUID uuids[256];
+		std::size_t nextuuid = sizeof(uuids) / sizeof(uuids[0]);
+		std::string uuid(uid::BinaryUUID::stringsize, '\0');
+		for (combineextgenerator gen(ext1, ext2); gen.next(); ) {
+			if (nextuuid == sizeof(uuids) / sizeof(uuids[0])) {
+				uid::generate(uuids, nextuuid);
+				nextuuid = 0;
+			}
+			uuids[nextuuid++].format(&uuid[0]);
+			p.ItemData = gen.current(); // reuses the capacity of ItemData
+			setrule(paths, p, uuid, buffer);
 		}
 		return true;
 	}
@@ -220,16 +305,16 @@ namespace policy{
 
 		setExecutableTypes(exec_ext);
 
-		const std::string description("WinSec, disable insecure locations");
-		for (const auto& v : locations) {
-			policy_rule p;
-			p.name = "DisableInsecureLocations";
-			p.Description = description;
-			p.ItemData = v;
-			SetPolicy(p, securitylevel::Disallowed);
+		const Atom name("DisableInsecureLocations");
+		const Atom description("WinSec, disable insecure locations");
+		std::vector<policy_s> rules(locations.size());
+		for (std::size_t i = 0; i != locations.size(); ++i) {
+			rules[i].pol.name = name;
+			rules[i].pol.Description = description;
+			rules[i].pol.ItemData = locations[i];
+			rules[i].sec = securitylevel::Disallowed;
 		}
-
-		return true;
+		return SetPolicies(rules);
 	}
 
 	bool PolicyManager::SetPolicyEnableOnlySecureLocations(const std::vector<std::string>& locations, const std::vector<std::string>& exec_ext) {
@@ -242,23 +327,24 @@ namespace policy{
 
 		setExecutableTypes(exec_ext);
 
-		const std::string description("WinSec, enable only secure locations");
-		for (const auto& v : locations) {
-			policy_rule p;
-			p.name = "EnableOnlySecureLocations";
-			p.Description = description;
-			p.ItemData = v;
-			SetPolicy(p, securitylevel::Unrestricted);
+		const Atom name("EnableOnlySecureLocations");
+		const Atom description("WinSec, enable only secure locations");
+		std::vector<policy_s> rules(locations.size() + 1);
+		for (std::size_t i = 0; i != locations.size(); ++i) {
+			rules[i].pol.name = name;
+			rules[i].pol.Description = description;
+			rules[i].pol.ItemData = locations[i];
+			rules[i].sec = securitylevel::Unrestricted;
 		}
 
 		// we have registered the secure location, let set everything as insecure
-		policy_rule p;
-		p.name = "EnableOnlySecureLocations";
-		p.Description = description;
-		p.ItemData = "*:";
-		SetPolicy(p, securitylevel::Disallowed);
+		auto& all = rules.back();
+		all.pol.name = name;
+		all.pol.Description = description;
+		all.pol.ItemData = "*:";
+		all.sec = securitylevel::Disallowed;
 
-		return true;
+		return SetPolicies(rules);
 	}
 
 	bool PolicyManager::SetPolicyDisableBiDiFiles() {
@@ -270,21 +356,80 @@ namespace policy{
 		setSecurityLevel(securitylevel::Unrestricted);
 
 		const std::string any("*");
+		const Atom name("DisableBiDiFiles");
 		const std::string description("WinSec, disable BiDi files");
 		const auto bidis = getBidi();
-		for (const auto& v : bidis) {
-			policy_rule p;
-			p.name = "DisableBiDiFiles";
-			p.Description = description + v.desc;
-			p.ItemData = any + v.c + any;
-			SetPolicy(p, securitylevel::Disallowed);
-		}/**/
+		std::vector<policy_s> rules(bidis.size());
+		for (std::size_t i = 0; i != bidis.size(); ++i) {
+			rules[i].pol.name = name;
+			rules[i].pol.Description = description + bidis[i].desc;
+			rules[i].pol.ItemData = any + bidis[i].c + any;
+			rules[i].sec = securitylevel::Disallowed;
+		}
 
-		return true;
+		return SetPolicies(rules);
+	}
+
+	policiesfromini loadrulesfromfiles(const std::vector<std::string>& inifiles, unsigned int threads) {
+		std::vector<policiesfromini> results(inifiles.size());
+		std::vector<std::exception_ptr> errors(inifiles.size());
+
+		// every worker takes the next file to parse, results are stored by position, so the order does not depend on timing
+		std::atomic<std::size_t> next(0);
+		const auto worker = [&]() {
+			for (auto i = next++; i < inifiles.size(); i = next++) {
+				try {
+					results[i] = loadrulesfromini(inifiles[i]);
+				} catch (...) {
+					errors[i] = std::current_exception();
+				}
+			}
+		};
+		if (threads == 0) {
+			threads = (std::max)(1u, std::thread::hardware_concurrency());
+		}
+		threads = static_cast<unsigned int>((std::min)(static_cast<std::size_t>(threads), inifiles.size()));
+		if (threads <= 1) {
+			worker();
+		} else {
+			std::vector<std::thread> pool;
+			pool.reserve(threads - 1);
+			for (unsigned int i = 1; i != threads; ++i) {
+				pool.emplace_back(worker);
+			}
+			worker(); // the calling thread works too
+			for (auto& t : pool) {
+				t.join();
+			}
+		}
+		for (const auto& e : errors) {
+			if (e) {
+				std::rethrow_exception(e);
+			}
+		}
+
+		policiesfromini toreturn;
+		std::size_t policies = 0;
+		std::size_t doubleextpol = 0;
+		std::size_t settings = 0;
+		for (const auto& r : results) {
+			policies += r.policies.size();
+			doubleextpol += r.doubleextpol.size();
+			settings += r.settings.size();
+		}
+		toreturn.policies.reserve(policies);
+		toreturn.doubleextpol.reserve(doubleextpol);
+		toreturn.settings.reserve(settings);
+		for (auto& r : results) {
+			std::move(r.policies.begin(), r.policies.end(), std::back_inserter(toreturn.policies));
+			std::move(r.doubleextpol.begin(), r.doubleextpol.end(), std::back_inserter(toreturn.doubleextpol));
+			std::move(r.settings.begin(), r.settings.end(), std::back_inserter(toreturn.settings));
+		}
+		return toreturn;
 	}
 
 	bool PolicyManager::Apply() {
-		return ::CommitTransaction(hkeyCodeIdentifiers.transaction.get()) != 0;
+		return registry::CommitTransaction(hkeyCodeIdentifiers.transaction.get());
 	}
 }
 
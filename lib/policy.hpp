@@ -19,11 +19,11 @@
 
 // local
 #include "registry.hpp"
+#include "registry_snapshot.hpp"
+#include "atom.hpp"
 #include "common.hpp"
 #include "IniParser.hpp"
-
-// windows
-#include <Windows.h>
+#include "win_types.hpp"
 
 //std
 #include <vector>
@@ -32,8 +32,10 @@
 #include <sstream>
 #include <iterator>
 #include <tuple>
-#include <regex>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
 
 namespace policy{
 
@@ -149,8 +151,8 @@ namespace policy{
 	inline int to_int(const enforcementLevel lev) { return static_cast<int>(lev); }
 
 	struct policy_rule {
-		std::string name;
-		std::string Description;
+		Atom name;        // interned, shared by all rules of a group
+		Atom Description; // interned, normally shared by all rules of a group
 		//DWORD SaferFlags = 0; // unused
 		std::string ItemData;
 		registry::regtype ItemDataType = registry::regtype::expand_sz;
@@ -163,8 +165,13 @@ namespace policy{
 		securitylevel sec; // securitylevel (also used to locate the policy)
 	};
 
+	struct changeplan;
+
 	class PolicyManager {
 		registry::TransactionKey hkeyCodeIdentifiers;
+		RAII_HKEY hkeyPaths[2]; // <securitylevel>\Paths for Disallowed and Unrestricted, created on first use, part of the transaction
+
+		HKEY getPaths(const securitylevel sec);
 	public:
 		/// Changes are applied only when committing transaction (method Apply)
 		PolicyManager();
@@ -188,9 +195,18 @@ namespace policy{
 		bool SetPolicy(const policy_rule& p, const securitylevel sec, const UUID& uuid);
 		bool SetPolicy(const policy_rule& p, const securitylevel sec);
 
+		/// writes all rules in the current transaction, the Paths keys are opened once and strings are converted in reused buffers
+		/// rules without UUID get a new one
+		bool SetPolicies(const std::vector<policy_s>& policies);
+
 		bool RemovePolicy(const securitylevel sec, const std::string& UUID);
 
+		/// stages all changes of the plan (see PolicyDiff), a rule that changes security level is moved to the other Paths key
+		bool Execute(const changeplan& plan);
+
 		bool SetPolicyDisableDoubleExt(const std::vector<std::string>& doubleext);
+		/// same as SetPolicyDisableDoubleExt(combineext(ext1, ext2)), without creating all patterns at once
+		bool SetPolicyDisableDoubleExt(const std::vector<std::string>& ext1, const std::vector<std::string>& ext2);
 		bool SetPolicyDisableInsecureLocations(const std::vector<std::string>& locations, const std::vector<std::string>& exec_ext);
 		bool SetPolicyEnableOnlySecureLocations(const std::vector<std::string>& locations, const std::vector<std::string>& exec_ext);
 		bool SetPolicyDisableBiDiFiles();
@@ -199,71 +215,63 @@ namespace policy{
 
 	};
 
+	// rule stored in the key k of the snapshot
+	inline policy_s rulefromsnapshot(const registry::Snapshot& snapshot, const std::size_t k, const HKEY hk, const securitylevel sec) {
+		policy::policy_s pol;
+		pol.hk = hk; // FIXME
+		pol.sec = sec;
+		pol.pol.Description = snapshot.QueryString(k, L"Description");
+		pol.pol.ItemData = snapshot.QueryString(k, L"ItemData");
+		pol.pol.name = snapshot.QueryString(k, L"Name");
+		pol.UUID = snapshot.keyname(k); // FIXME
+		auto saferflags = snapshot.QueryDWORD(k, L"SaferFlags"); // NOTE: ignore for the moment
+		assert(saferflags == 0); (void)saferflags;
+		return pol;
+	}
+
 	// just give local machine or user
-	inline std::vector<policy_s> getLoadedRules(const HKEY hk) {
-		std::vector<policy::policy_s> policies;
-		const std::wstring CodeIdentifiers0(L"SOFTWARE\\Policies\\Microsoft\\Windows\\Safer\\CodeIdentifiers\\0\\Paths");
-		auto key = registry::OpenKeyOptional(hk, CodeIdentifiers0);
-		if(key){
-			auto listofkeys = registry::EnumKey(key.get());
-			policies.reserve(listofkeys.size());
-			policy::policy_s pol;
-			pol.hk = hk; // FIXME
-			pol.sec = securitylevel::Disallowed; // FIXME
-			for (const auto v : listofkeys) {
-				const auto key2 = registry::OpenKey(key.get(), v);
-				pol.pol.Description = registry::QueryString(key2.get(), L"Description");
-				pol.pol.ItemData = registry::QueryString(key2.get(), L"ItemData");
-				pol.pol.name = registry::QueryString(key2.get(), L"Name");
-				pol.UUID = v; // FIXME
-				auto saferflags = registry::QueryDWORD(key2.get(), L"SaferFlags"); // NOTE: ignore for the moment
-				assert(saferflags == 0); (void)saferflags;
-				policies.push_back(pol);
-			}
-		}
+	// the whole CodeIdentifiers subtree is read at once, same as getLoadedRuleTable(hk).to_vector() (see ruletable.hpp)
+	std::vector<policy_s> getLoadedRules(const HKEY hk);
 
-		const std::wstring CodeIdentifiers1(L"SOFTWARE\\Policies\\Microsoft\\Windows\\Safer\\CodeIdentifiers\\262144\\Paths");
-		key.reset();
-		key = registry::OpenKeyOptional(hk, CodeIdentifiers1);
-		if(!key){
-			return policies;
+	// a single rule, by UUID, only its key is read (for example for the few rules of an event), false if it does not exist
+	inline bool getLoadedRule(const HKEY hk, const std::string& UUID, policy_s& out) {
+		if (UUID.empty() || UUID.find('\\') != std::string::npos) {
+			return false;
 		}
-		const auto listofkeys = registry::EnumKey(key.get());
-		policies.reserve(policies.size() + listofkeys.size());
-		policy::policy_s pol;
-		pol.sec = securitylevel::Unrestricted; // FIXME
-		for (const auto v : listofkeys) {
-			const auto key2 = registry::OpenKey(key.get(), v);
-			pol.pol.Description = registry::QueryString(key2.get(), L"Description");
-			pol.pol.ItemData = registry::QueryString(key2.get(), L"ItemData");
-			pol.pol.name = registry::QueryString(key2.get(), L"Name");
-			pol.UUID = v; // FIXME
-			auto saferflags = registry::QueryDWORD(key2.get(), L"SaferFlags"); // NOTE: ignore for the moment
-			assert(saferflags == 0); (void)saferflags;
-			policies.push_back(pol);
+		struct level {
+			securitylevel sec;
+			const wchar_t* name;
+		};
+		const level levels[] = { { securitylevel::Disallowed, L"0" },{ securitylevel::Unrestricted, L"262144" } };
+		for (const auto& l : levels) {
+			const registry::Snapshot snapshot(hk, std::wstring(L"SOFTWARE\\Policies\\Microsoft\\Windows\\Safer\\CodeIdentifiers\\") + l.name + L"\\Paths\\" + s2ws(UUID));
+			if (!snapshot.empty()) {
+				out = rulefromsnapshot(snapshot, 0, hk, l.sec);
+				out.UUID = UUID;
+				return true;
+			}
 		}
-		return policies;
+		return false;
 	}
 
 	// policies with different or no title are separated -> title is not unique!
-	// lot of possible optimizations -> elements are copied and then removed
-	// a) copy and do not remove (prevent reallocation) -> vector can be passed as (non constant) reference
-	// b) move (prevent new allocation)
+	// groups are in the order in which their name appears first, policies inside a group keep their relative order
+	// single pass: every name is looked up once in a hash table (the hash of an Atom is the hash of its address), and every policy is moved (not copied) in its group
 	inline std::vector<std::vector<policy::policy_s>> groupbyname(std::vector<policy::policy_s> pols, bool groupemtpy = false) {
 		std::vector<std::vector<policy::policy_s>> toreturn;
-		while (!pols.empty()) {
-			const std::string name = pols.at(0).pol.name;
-			if (name.empty() && !groupemtpy) { // elements without name are separated
-				toreturn.push_back({ pols.at(0) });
-				pols.erase(pols.begin());
+		std::unordered_map<Atom, std::size_t> groups; // name -> index in toreturn, names are interned
+		for (auto& v : pols) {
+			if (v.pol.name.empty() && !groupemtpy) { // elements without name are separated
+				toreturn.emplace_back();
+				toreturn.back().push_back(std::move(v));
 				continue;
 			}
-			const auto lambda = [&name](const policy::policy_s& p) {return p.pol.name == name; };
-			const auto lastel = std::partition(pols.begin(), pols.end(), lambda);
-			const std::vector<policy::policy_s> tmp(pols.begin(), lastel); // could remember position of previous search?
-			assert (!tmp.empty() && "if cannot be empty since pols.at(0) had the searched name!");
-			pols.erase(pols.begin(), lastel);
-			toreturn.push_back(tmp);
+			auto it = groups.find(v.pol.name);
+			if (it == groups.end()) {
+				it = groups.emplace(v.pol.name, toreturn.size()).first;
+				toreturn.emplace_back();
+			}
+			toreturn[it->second].push_back(std::move(v));
 		}
 		return toreturn;
 	}
@@ -277,6 +285,22 @@ namespace policy{
 		securitylevel sec;
 	};
 
+	// matches "*.ext1.ext2", where ext1 and ext2 are not empty and do not contain '.'
+	// on success ext1 and ext2 are set
+	inline bool splitdoubleext(const iniparser::strview itemdata, std::string& ext1, std::string& ext2) {
+		const auto size = itemdata.size();
+		if (size < 5 || itemdata[0] != '*' || itemdata[1] != '.') {
+			return false;
+		}
+		const auto dot = static_cast<std::size_t>(std::find(itemdata.begin() + 2, itemdata.end(), '.') - itemdata.begin());
+		if (dot == size || dot == 2 || dot == size - 1 || std::find(itemdata.begin() + dot + 1, itemdata.end(), '.') != itemdata.end()) {
+			return false;
+		}
+		ext1.assign(itemdata.data() + 2, dot - 2);
+		ext2.assign(itemdata.data() + dot + 1, size - dot - 1);
+		return true;
+	}
+
 	// They are a policy of double-ext if all properties (except itemdata and UUID) are equals and itemdata are all double-ext
 	// This function may split the double-ext for different properties (user, security level, ...), but not yet
 	inline doubleext getdoubleext(const std::vector<policy::policy_s>& pols) {
@@ -284,45 +308,55 @@ namespace policy{
 			return{};
 		}
 
-		const std::regex r1("^\\*\\.([^.]+)\\.([^.]+)$");
-
 		std::vector<std::string> ext1;
 		std::vector<std::string> ext2;
+		// extensions are returned in the order they are found, the sets are only used to find duplicates
+		std::unordered_set<std::string> unique1;
+		std::unordered_set<std::string> unique2;
+		std::string e1;
+		std::string e2;
 		const auto& name = pols.at(0).pol.name; // name
 		const auto& description = pols.at(0).pol.Description; // description
 		const auto& sec = pols.at(0).sec; // security settings
 		const auto& hk = pols.at(0).hk; // user
 
 		for (const auto& v : pols) {
+			// name and description are interned, comparing them does not compare the strings
 			if (v.pol.name != name || v.pol.Description != description || v.sec != sec || v.hk != hk) {
 				return{};
 			}
-			std::smatch sm;
-			if(std::regex_match(v.pol.ItemData, sm, r1) && sm.size() == 3) {
-				add_if_unique(ext1, sm[1]);
-				add_if_unique(ext2, sm[2]);
+			if (!splitdoubleext(v.pol.ItemData, e1, e2)) {
+				return{};
+			}
+			if (unique1.insert(e1).second) {
+				ext1.push_back(e1);
 			}
-			else {
-				return {};
+			if (unique2.insert(e2).second) {
+				ext2.push_back(e2);
 			}
 		}
-		return{ ext1, ext2, name, description, hk, sec };
+		return{ std::move(ext1), std::move(ext2), name, description, hk, sec };
 	}
 
 
 	inline std::vector<doubleext> removedoubleext(std::vector<std::vector<policy::policy_s>>& groupedpols){
 		std::vector<doubleext> toreturn;
 
-		for(auto it = groupedpols.begin(); it != groupedpols.end(); ){
+		// groups that are not double-ext are compacted at the front, instead of erasing every double-ext group
+		auto out = groupedpols.begin();
+		for(auto it = groupedpols.begin(); it != groupedpols.end(); ++it){
 			assert(!it->empty());
 			auto doubleextension = policy::getdoubleext(*it);
 			if (!doubleextension.ext1.empty() && !doubleextension.ext2.empty()) {
-				toreturn.push_back(doubleextension);
-				it = groupedpols.erase(it);
+				toreturn.push_back(std::move(doubleextension));
 			} else {
-				++it;
+				if (out != it) {
+					*out = std::move(*it);
+				}
+				++out;
 			}
 		}
+		groupedpols.erase(out, groupedpols.end());
 		return toreturn;
 	}
 
@@ -366,73 +400,84 @@ namespace policy{
 		std::vector<policysettings> settings;
 	};
 	inline policiesfromini loadrulesfromini(const std::string& inifile) {
-		iniparser::IniParser parser(inifile);
+		const iniparser::MappedIniParser parser(inifile);
 
 		// policies are grouped together by name (if options are consistent)
 		policiesfromini toreturn;
-		for (const auto& v : parser.content) {
-			const auto name = v.first;
-			const std::string Who = (v.second.count(keys::who) ? v.second.at(keys::who) : "*"); //if nothing->everyone
-
-			const bool hasext1 = v.second.count(keys::ext1) !=0;
-			const bool hasext2 = v.second.count(keys::ext2) !=0;
+		for (const auto& v : parser.sections()) {
+			const Atom name(v.name.to_string()); // interned once per section, not once per rule
+			const auto has = [&parser, &v](const std::string& key) { return parser.FindProperty(v, key) != nullptr; };
+			const auto at = [&parser, &v](const std::string& key) { return parser.FindProperty(v, key)->value.to_string(); };
+			const std::string Who = (has(keys::who) ? at(keys::who) : "*"); //if nothing->everyone
+
+			const bool hasext1 = has(keys::ext1);
+			const bool hasext2 = has(keys::ext2);
 			if ( (hasext1 && !hasext2) || (!hasext1 && hasext2)) {
 				throw std::runtime_error("Invalid double ext configuration, you need to set ext1 and ext2");
 			}
 
 			if (hasext1) {
 				doubleext d;
-				d.ext1 = uniquify(trimandremovedelim(explode(v.second.at(keys::ext1), ',')));
-				d.ext2 = uniquify(trimandremovedelim(explode(v.second.at(keys::ext2), ',')));
-				d.description = v.second.count(keys::description) != 0 ? v.second.at(keys::description) : "";
+				d.ext1 = uniquify(trimandremovedelim(explode(at(keys::ext1), ',')));
+				d.ext2 = uniquify(trimandremovedelim(explode(at(keys::ext2), ',')));
+				d.description = has(keys::description) ? at(keys::description) : "";
 				d.name = name;
 				toreturn.doubleextpol.push_back(d);
 				continue;
 			}
 
-			const bool hasexecutables = v.second.count(keys::executables) != 0;
-			const bool hassecuritylevel = v.second.count(keys::securitylevel) != 0;
-			const bool haspolicyScope = v.second.count(keys::policyscope) != 0;
-			const bool hasenforcementLevel = v.second.count(keys::enforcementlevel) != 0;
-			const bool hasadmininfourl = v.second.count(keys::admin_info_url) != 0;
+			const bool hasexecutables = has(keys::executables);
+			const bool hassecuritylevel = has(keys::securitylevel);
+			const bool haspolicyScope = has(keys::policyscope);
+			const bool hasenforcementLevel = has(keys::enforcementlevel);
+			const bool hasadmininfourl = has(keys::admin_info_url);
 
 			if (hasexecutables || hassecuritylevel || haspolicyScope || hasenforcementLevel || hasadmininfourl) {
 				policysettings settings;
 				if (hasexecutables) {
-					settings.executables = uniquify(trimandremovedelim(explode(v.second.at(keys::executables), ',')));
+					settings.executables = uniquify(trimandremovedelim(explode(at(keys::executables), ',')));
 				}
-				settings.SecurityLevel = hassecuritylevel ? std::make_unique<securitylevel>( to_securitylevel(v.second.at(keys::securitylevel))) : nullptr;
-				settings.PolicyScope = haspolicyScope ? std::make_unique<policyScope>(to_policyScope(v.second.at(keys::policyscope))) : nullptr;
-				settings.admininfourl = hasadmininfourl ? std::make_unique<std::string>(v.second.at(keys::admin_info_url)) : nullptr;
-				settings.EnforcementLevel = hasenforcementLevel ? std::make_unique<enforcementLevel>(to_enforcementLevel(v.second.at(keys::enforcementlevel))) : nullptr;
+				settings.SecurityLevel = hassecuritylevel ? std::make_unique<securitylevel>( to_securitylevel(at(keys::securitylevel))) : nullptr;
+				settings.PolicyScope = haspolicyScope ? std::make_unique<policyScope>(to_policyScope(at(keys::policyscope))) : nullptr;
+				settings.admininfourl = hasadmininfourl ? std::make_unique<std::string>(at(keys::admin_info_url)) : nullptr;
+				settings.EnforcementLevel = hasenforcementLevel ? std::make_unique<enforcementLevel>(to_enforcementLevel(at(keys::enforcementlevel))) : nullptr;
 				toreturn.settings.push_back(std::move(settings));
 			}
 
-			const std::string Allow = (v.second.count(keys::security) ? v.second.at(keys::security) : ""); //maybe only given specific, if not throw
-			auto description = v.second.count(keys::description) != 0 ? v.second.at(keys::description) : "";
+			const std::string Allow = (has(keys::security) ? at(keys::security) : ""); //maybe only given specific, if not throw
+			const Atom description(has(keys::description) ? at(keys::description) : "");
 			std::vector<policy::policy_s> tmppolicies;
-			for (const auto& vv : v.second) {
-				const auto match0 = matchwithoptionalnumber(vv.first, keys::rule);
+			const auto& entries = parser.entries();
+			for (auto i = v.first; i != v.first + v.count; ++i) {
+				const auto& vv = entries[i];
+				if (vv.property.size() < keys::rule.size() || !std::equal(keys::rule.begin(), keys::rule.end(), vv.property.begin())) {
+					continue; // avoid creating a string for every property
+				}
+				const auto match0 = matchwithoptionalnumber(vv.property.to_string(), keys::rule);
 				if (match0.first) {
 					policy::policy_s tmp;
 					tmp.pol.name = name;
-					tmp.pol.ItemData = vv.second;
+					tmp.pol.ItemData = vv.value.to_string();
 					const auto securitykey = keys::security + match0.second;
-					tmp.sec = to_securitylevel( v.second.count(securitykey) != 0 ? v.second.at(securitykey) : Allow);
+					tmp.sec = to_securitylevel( has(securitykey) ? at(securitykey) : Allow);
 					const auto descriptionkey = keys::description + match0.second;
-					tmp.pol.Description = v.second.count(descriptionkey) != 0 ? v.second.at(descriptionkey) : description;
+					tmp.pol.Description = has(descriptionkey) ? Atom(at(descriptionkey)) : description;
 					const auto uuidkey = keys::uuid + match0.second;
-					tmp.UUID = v.second.count(uuidkey) != 0 ? v.second.at(uuidkey) : "";
-					tmppolicies.push_back(tmp);
+					tmp.UUID = has(uuidkey) ? at(uuidkey) : "";
+					tmppolicies.push_back(std::move(tmp));
 				}
 			}
 			if (!tmppolicies.empty()) {
-				toreturn.policies.push_back(tmppolicies);
+				toreturn.policies.push_back(std::move(tmppolicies));
 			}
 		}
 		return toreturn;
 	}
 
+	/// parses the files on a pool of threads (0 means one per core), and merges the results in the same order of the files
+	/// if a file cannot be parsed, the exception of the first such file is rethrown
+	policiesfromini loadrulesfromfiles(const std::vector<std::string>& inifiles, unsigned int threads = 0);
+
 	struct CompareByRule {
 		bool operator()(const std::string& s, const std::string& s2) const {
 			return s2 < s;
@@ -454,6 +499,7 @@ namespace policy{
 		}
 	};
 
+	// Atom::operator< compares strings only if the atoms are different
 	struct Compare_policy_s {
 		bool operator()(const policy::policy_s& p, const policy::policy_s& p2) const {
 			return std::tie(p.UUID, p.sec, p.pol.Description, p.pol.ItemData, p.pol.name ) < std::tie(p2.UUID, p2.sec, p2.pol.Description, p2.pol.ItemData, p2.pol.name );
@@ -0,0 +1,201 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "policydiff.hpp"
+
+// local
+#include "policy.hpp"
+#include "uuid.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace policy {
+
+	namespace {
+		// registry keys are case insensitive, and so are the UUIDs used as key name
+		std::string folduuid(std::string uuid) {
+			std::transform(uuid.begin(), uuid.end(), uuid.begin(), [](const char c) {
+				return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+			});
+			return uuid;
+		}
+	}
+
+	PolicyDiff::PolicyDiff(RuleTable installed) : rules(std::move(installed)) {
+		byuuid.reserve(rules.size());
+		for (std::size_t row = 0; row != rules.size(); ++row) {
+			index(row);
+		}
+	}
+
+	void PolicyDiff::index(const std::size_t row) {
+		auto uuid = folduuid(rules.uuid(row).to_string());
+		byname[rules.name(row)].insert(uuid);
+		byuuid[std::move(uuid)] = row;
+	}
+
+	void PolicyDiff::erase(const std::string& uuid) {
+		const auto it = byuuid.find(uuid);
+		if (it == byuuid.end()) {
+			return;
+		}
+		const auto group = byname.find(rules.name(it->second));
+		if (group != byname.end()) {
+			group->second.erase(uuid);
+			if (group->second.empty()) {
+				byname.erase(group);
+			}
+		}
+		byuuid.erase(it);
+	}
+
+	bool PolicyDiff::find(const std::string& uuid, policy_s& out) const {
+		const auto it = byuuid.find(folduuid(uuid));
+		if (it == byuuid.end()) {
+			return false;
+		}
+		out = rules[it->second];
+		return true;
+	}
+
+	std::vector<policy_s> PolicyDiff::group(const Atom& name) const {
+		std::vector<policy_s> res;
+		const auto it = byname.find(name);
+		if (it == byname.end()) {
+			return res;
+		}
+		res.reserve(it->second.size());
+		for (const auto& uuid : it->second) {
+			res.push_back(rules[byuuid.at(uuid)]);
+		}
+		return res;
+	}
+
+	changeplan PolicyDiff::diff(const std::vector<policy_s>& wanted, const Atom& name) const {
+		changeplan plan;
+		std::unordered_set<std::string> seen; // folded uuids of installed rules that are still wanted
+		seen.reserve(wanted.size());
+		// row of the installed rule matched by every wanted rule, none if it needs to be added
+		const auto none = static_cast<std::size_t>(-1);
+		std::vector<std::size_t> matched(wanted.size(), none);
+
+		// first the rules with an UUID, so that a rule without UUID can not claim an installed rule that is wanted by UUID
+		{
+			std::unordered_set<std::string> uuids;
+			uuids.reserve(wanted.size());
+			for (std::size_t i = 0; i != wanted.size(); ++i) {
+				const auto& w = wanted[i];
+				if (w.UUID.empty()) {
+					continue;
+				}
+				auto uuid = folduuid(w.UUID);
+				if (!uuids.insert(uuid).second) {
+					throw std::runtime_error("duplicate UUID " + w.UUID);
+				}
+				const auto it = byuuid.find(uuid);
+				if (it != byuuid.end()) {
+					seen.insert(it->first);
+					matched[i] = it->second;
+				}
+			}
+		}
+
+		// then the rules without UUID, by ItemData and security level, among the installed rules of the group not claimed yet
+		const auto group = byname.find(name);
+		if (group != byname.end()) {
+			// only created if some wanted rule has no UUID
+			std::unordered_multimap<std::string, const std::string*> byitemdata;
+			bool byitemdatacreated = false;
+			for (std::size_t i = 0; i != wanted.size(); ++i) {
+				const auto& w = wanted[i];
+				if (!w.UUID.empty()) {
+					continue;
+				}
+				if (!byitemdatacreated) {
+					byitemdata.reserve(group->second.size());
+					for (const auto& uuid : group->second) {
+						byitemdata.emplace(rules.itemdata(byuuid.at(uuid)).to_string(), &uuid);
+					}
+					byitemdatacreated = true;
+				}
+				const auto range = byitemdata.equal_range(w.pol.ItemData);
+				for (auto it = range.first; it != range.second; ++it) {
+					const auto candidate = byuuid.at(*it->second);
+					if (rules.sec(candidate) == w.sec && seen.insert(*it->second).second) {
+						matched[i] = candidate;
+						break;
+					}
+				}
+			}
+		}
+
+		for (std::size_t i = 0; i != wanted.size(); ++i) {
+			const auto& w = wanted[i];
+			const auto installed = matched[i];
+			if (installed == none) {
+				plan.toadd.push_back(w);
+			} else if (!rules.samerule(installed, w)) {
+				changeplan::modification m{ rules[installed], w };
+				m.to.UUID = m.from.UUID; // same spelling of the key in the registry
+				plan.tomodify.push_back(std::move(m));
+			}
+		}
+
+		// all missing UUIDs are generated at once
+		const auto missing = static_cast<std::size_t>(std::count_if(plan.toadd.begin(), plan.toadd.end(), [](const policy_s& v) { return v.UUID.empty(); }));
+		if (missing != 0) {
+			const auto uuids = uid::generatestrings(missing);
+			auto next = uuids.begin();
+			for (auto& v : plan.toadd) {
+				if (v.UUID.empty()) {
+					v.UUID = *next++;
+				}
+			}
+		}
+
+		if (group != byname.end()) {
+			for (const auto& uuid : group->second) {
+				if (seen.count(uuid) == 0) {
+					plan.toremove.push_back(rules[byuuid.at(uuid)]);
+				}
+			}
+		}
+		return plan;
+	}
+
+	void PolicyDiff::update(const changeplan& plan) {
+		for (const auto& v : plan.toremove) {
+			erase(folduuid(v.UUID));
+		}
+		for (const auto& v : plan.tomodify) {
+			erase(folduuid(v.from.UUID));
+			rules.push_back(v.to);
+			index(rules.size() - 1);
+		}
+		for (const auto& v : plan.toadd) {
+			rules.push_back(v);
+			index(rules.size() - 1);
+		}
+	}
+}
@@ -0,0 +1,89 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// local
+#include "policy.hpp"
+#include "ruletable.hpp"
+#include "atom.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstddef>
+
+namespace policy {
+
+	/// minimal set of registry changes for going from the installed rules to the wanted ones, executed by PolicyManager::Execute
+	struct changeplan {
+		struct modification {
+			policy_s from; // installed rule
+			policy_s to;   // new values, with the same UUID
+		};
+		std::vector<policy_s> toadd;          // every rule has an UUID
+		std::vector<policy_s> toremove;
+		std::vector<modification> tomodify;
+
+		bool empty() const { return toadd.empty() && toremove.empty() && tomodify.empty(); }
+	};
+
+	/// Index of the installed rules, by UUID and by name.
+	///
+	/// A diff only looks at the wanted rules and at the installed rules with the same name,
+	/// so its cost does not depend on the total number of rules on the machine.
+	/// - a wanted rule with an UUID is compared with the installed rule with the same UUID (case insensitive)
+	/// - a wanted rule without UUID is compared with an installed rule of the group with the same ItemData and security level
+	///   that is not wanted by UUID, if there is none a new UUID is created
+	/// - two wanted rules with the same UUID are an error (std::runtime_error)
+	/// - installed rules of the group that are not wanted anymore are removed
+	/// After the plan has been applied, update keeps the index in sync without reloading all rules.
+	/// The installed rules are kept in a RuleTable (for example from getLoadedRuleTable), policy_s are created only for the rules in the plan.
+	class PolicyDiff {
+	public:
+		PolicyDiff() = default;
+		explicit PolicyDiff(RuleTable installed);
+		explicit PolicyDiff(const std::vector<policy_s>& installed) : PolicyDiff(RuleTable(installed)) {}
+
+		/// wanted is the complete content of the group with the given name
+		changeplan diff(const std::vector<policy_s>& wanted, const Atom& name) const;
+
+		void update(const changeplan& plan);
+
+		/// installed rule with the given UUID (case insensitive), false if there is none
+		bool find(const std::string& uuid, policy_s& out) const;
+		/// installed rules with the given name, in no particular order
+		std::vector<policy_s> group(const Atom& name) const;
+		std::size_t size() const { return byuuid.size(); }
+
+	private:
+		RuleTable rules; // rows of removed and modified rules stay in the table, but they are not indexed anymore
+		std::unordered_map<std::string, std::size_t> byuuid; // folded uuid -> row
+		std::unordered_map<Atom, std::unordered_set<std::string>> byname; // name -> folded uuids
+
+		void index(const std::size_t row);
+		void erase(const std::string& uuid);
+	};
+
+	/// same values, ignoring the UUID
+	inline bool samerule(const policy_s& p1, const policy_s& p2) {
+		return p1.sec == p2.sec && p1.pol.name == p2.pol.name && p1.pol.Description == p2.pol.Description
+			&& p1.pol.ItemData == p2.pol.ItemData && p1.pol.ItemDataType == p2.pol.ItemDataType;
+	}
+}
@@ -17,20 +17,24 @@
 
 #include "registry.hpp"
 
-#include "win_handles.hpp"
-
 // local
 #include "common.hpp"
+#include "registry_backend.hpp"
+#include "memoryhive.hpp"
+#include "win_types.hpp"
 
+#if defined(_WIN32)
 // windows
 #include <winreg.h>
 #include <KtmW32.h> // >= windows vista, CreateTransaction
-#include <WinDNS.h> // qword
+#endif
 
 // std
 #include <string>
 #include <cassert>
 #include <algorithm>
+#include <atomic>
+#include <limits>
 
 #ifdef DONOTSAFEREGKEY
 constexpr auto flag_volatile = REG_OPTION_VOLATILE;
@@ -40,6 +44,91 @@ constexpr auto flag_volatile = REG_OPTION_NON_VOLATILE;
 
 namespace registry {
 
+	namespace {
+#if defined(_WIN32)
+		class Win32Backend final : public Backend {
+		public:
+			LONG OpenKeyEx(const HKEY hk, const std::wstring& subkey, const DWORD dwOptions, const REGSAM samDesired, HKEY* result) override {
+				return ::RegOpenKeyExW(hk, subkey.c_str(), dwOptions, samDesired, result);
+			}
+			LONG CreateKeyEx(const HKEY hk, const std::wstring& subkey, const DWORD dwOptions, const REGSAM samDesired, const HANDLE transaction, HKEY* result) override {
+				if (transaction == nullptr) {
+					return ::RegCreateKeyExW(hk, subkey.c_str(), 0, nullptr, dwOptions, samDesired, nullptr, result, nullptr);
+				}
+				return ::RegCreateKeyTransactedW(hk, subkey.c_str(), 0, nullptr, dwOptions, samDesired, nullptr, result, nullptr, transaction, nullptr);
+			}
+			LONG CloseKey(const HKEY hk) noexcept override {
+				return ::RegCloseKey(hk);
+			}
+			LONG SetValueEx(const HKEY hk, const std::wstring& valuename, const DWORD type, const BYTE* data, const DWORD size) override {
+				return ::RegSetValueExW(hk, valuename.c_str(), 0, type, data, size);
+			}
+			LONG QueryValueEx(const HKEY hk, const std::wstring& valuename, DWORD* type, BYTE* data, DWORD* size) override {
+				return ::RegQueryValueExW(hk, valuename.c_str(), nullptr, type, data, size);
+			}
+			LONG DeleteValue(const HKEY hk, const std::wstring& valuename) override {
+				return ::RegDeleteValueW(hk, valuename.c_str());
+			}
+			LONG DeleteKey(const HKEY hk, const std::wstring& subkey) override {
+				return ::RegDeleteKeyW(hk, subkey.c_str());
+			}
+			LONG DeleteTree(const HKEY hk, const std::wstring& subkey) override {
+#if WINVER < _WIN32_WINNT_VISTA
+#warning "need to link to Shlwapi.lib"
+				return ::SHDeleteKey(hk, subkey.c_str());
+#else
+				return ::RegDeleteTreeW(hk, subkey.c_str());
+#endif
+			}
+			LONG QueryInfoKey(const HKEY hk, DWORD* cSubKeys, DWORD* cbMaxSubKey, DWORD* cValues, DWORD* cbMaxValueName, DWORD* cbMaxValueData) override {
+				return ::RegQueryInfoKeyW(hk, nullptr, nullptr, nullptr, cSubKeys, cbMaxSubKey, nullptr, cValues, cbMaxValueName, cbMaxValueData, nullptr, nullptr);
+			}
+			LONG EnumKeyEx(const HKEY hk, const DWORD index, wchar_t* name, DWORD* size) override {
+				return ::RegEnumKeyExW(hk, index, name, size, nullptr, nullptr, nullptr, nullptr);
+			}
+			LONG EnumValue(const HKEY hk, const DWORD index, wchar_t* name, DWORD* namesize, DWORD* type, BYTE* data, DWORD* datasize) override {
+				return ::RegEnumValueW(hk, index, name, namesize, nullptr, type, data, datasize);
+			}
+			LONG CreateTransaction(HANDLE* result) override {
+				const HANDLE handle = ::CreateTransaction(nullptr, nullptr, 0, 0, 0, 0, nullptr);
+				if (handle == nullptr || handle == INVALID_HANDLE_VALUE) {
+					return static_cast<LONG>(::GetLastError());
+				}
+				*result = handle;
+				return ERROR_SUCCESS;
+			}
+			bool CommitTransaction(const HANDLE transaction) override {
+				return ::CommitTransaction(transaction) != 0;
+			}
+			void CloseTransaction(const HANDLE transaction) noexcept override {
+				const auto res = ::CloseHandle(transaction); (void)res; assert(res != 0);
+			}
+		};
+
+		Backend& DefaultBackend() {
+			static Win32Backend backend;
+			return backend;
+		}
+#else
+		Backend& DefaultBackend() {
+			static MemoryHive backend;
+			return backend;
+		}
+#endif
+
+		std::atomic<Backend*> currentbackend(nullptr);
+	}
+
+	Backend& GetBackend() {
+		const auto backend = currentbackend.load();
+		return backend != nullptr ? *backend : DefaultBackend();
+	}
+
+	Backend* SetBackend(Backend* backend) {
+		const auto previous = currentbackend.exchange(backend);
+		return previous != nullptr ? previous : &DefaultBackend();
+	}
+
 	// return false if both KEY_WOW64_32KEY and KEY_WOW64_64KEY are set
 	constexpr bool checkWOWflags(const DWORD dwOptions) {
 		return !((dwOptions & KEY_WOW64_32KEY) && (dwOptions & KEY_WOW64_64KEY));
@@ -48,12 +137,13 @@ namespace registry {
 	RAII_HKEY OpenKey(const HKEY hk, const std::wstring& subkey, const REGSAM samDesired, DWORD dwOptions) {
 		assert(!subkey.empty() && subkey.at(0) != '\\' && "stupid error, path will be invalid");
 		assert(checkWOWflags(dwOptions) && "does not make any sense");
+		auto& backend = GetBackend();
 		HKEY hkey;
-		const auto res = RegOpenKeyExW(hk, subkey.c_str(), dwOptions | flag_volatile, samDesired, &hkey);
+		const auto res = backend.OpenKeyEx(hk, subkey, dwOptions | flag_volatile, samDesired, &hkey);
 		if (res != ERROR_SUCCESS) {
 			throw std::runtime_error("unable to open key");
 		}
-		RAII_HKEY k(hkey);
+		RAII_HKEY k(hkey, details::sKeyDeleter{ &backend });
 		return k;
 	}
 
@@ -64,8 +154,9 @@ namespace registry {
 	RAII_HKEY OpenKeyOptional(const HKEY hk, const std::wstring& subkey, const REGSAM samDesired, DWORD dwOptions) {
 		assert(!subkey.empty() && subkey.at(0) != '\\' && "stupid error, path will be invalid");
 		assert(checkWOWflags(dwOptions) && "does not make any sense");
+		auto& backend = GetBackend();
 		HKEY hkey;
-		const auto res = RegOpenKeyExW(hk, subkey.c_str(), dwOptions | flag_volatile, samDesired, &hkey);
+		const auto res = backend.OpenKeyEx(hk, subkey, dwOptions | flag_volatile, samDesired, &hkey);
 		if(res == ERROR_FILE_NOT_FOUND || res == ERROR_PATH_NOT_FOUND){
 			RAII_HKEY k;
 			return k;
@@ -73,7 +164,7 @@ namespace registry {
 		if (res != ERROR_SUCCESS) {
 			throw std::runtime_error("unable to open key");
 		}
-		RAII_HKEY k(hkey);
+		RAII_HKEY k(hkey, details::sKeyDeleter{ &backend });
 		return k;
 	}
 
@@ -84,12 +175,13 @@ namespace registry {
 	RAII_HKEY CreateKey(const HKEY hk, const std::wstring& subkey, const REGSAM samDesired, DWORD dwOptions) {
 		assert(!subkey.empty() && subkey.at(0) != '\\' && "stupid error, path will be invalid");
 		assert(checkWOWflags(dwOptions) && "does not make any sense");
+		auto& backend = GetBackend();
 		HKEY hkey;
-		const auto res = RegCreateKeyExW(hk, subkey.c_str(), 0, nullptr, dwOptions | flag_volatile, samDesired, nullptr, &hkey, nullptr);
+		const auto res = backend.CreateKeyEx(hk, subkey, dwOptions | flag_volatile, samDesired, nullptr, &hkey);
 		if (res != ERROR_SUCCESS) {
 			throw std::runtime_error("unable to create key");
 		}
-		RAII_HKEY k(hkey);
+		RAII_HKEY k(hkey, details::sKeyDeleter{ &backend });
 		return k;
 	}
 
@@ -97,25 +189,31 @@ namespace registry {
 		return CreateKey(hk, s2ws(subkey), samDesired, dwOptions);
 	}
 
-	RAII_HANDLE CreateTransaction() {
-		const HANDLE handle = ::CreateTransaction(nullptr, nullptr, 0, 0, 0, 0, nullptr);
-		if (handle == nullptr || handle == INVALID_HANDLE_VALUE) {
+	RAII_TRANSACTION CreateTransaction() {
+		auto& backend = GetBackend();
+		HANDLE handle = nullptr;
+		const auto res = backend.CreateTransaction(&handle);
+		if (res != ERROR_SUCCESS) {
 			throw std::runtime_error("unable to create transaction handle");
 		}
-		return RAII_HANDLE(handle);
+		return RAII_TRANSACTION(handle, details::sTransactionDeleter{ &backend });
+	}
+
+	bool CommitTransaction(const HANDLE transaction) {
+		return GetBackend().CommitTransaction(transaction);
 	}
 
 	TransactionKey CreateKeyTransacted(const HKEY hk, const std::wstring& subkey, const REGSAM samDesired, DWORD dwOptions) {
 		assert(!subkey.empty() && subkey.at(0) != L'\\' && "stupid error, path will be invalid");
 		assert(checkWOWflags(dwOptions) && "does not make any sense");
+		auto& backend = GetBackend();
 		auto transhadle(CreateTransaction());
 		HKEY hkey;
-		const auto res = RegCreateKeyTransactedW(hk, subkey.c_str(), 0, nullptr, dwOptions | flag_volatile, samDesired,
-												 nullptr, &hkey, nullptr, transhadle.get(), nullptr);
+		const auto res = backend.CreateKeyEx(hk, subkey, dwOptions | flag_volatile, samDesired, transhadle.get(), &hkey);
 		if (res != ERROR_SUCCESS) {
 			throw std::runtime_error("unable to open key");
 		}
-		RAII_HKEY k(hkey);
+		RAII_HKEY k(hkey, details::sKeyDeleter{ &backend });
 		return TransactionKey{ std::move(k), std::move(transhadle) };
 	}
 
@@ -124,7 +222,7 @@ namespace registry {
 	}
 
 	bool SetValue(const HKEY hk, const std::wstring& valuename, DWORD value) {
-		const auto res = RegSetValueExW(hk, valuename.c_str(), 0, REG_DWORD, reinterpret_cast<const BYTE*>(&value), sizeof(value));
+		const auto res = GetBackend().SetValueEx(hk, valuename, REG_DWORD, reinterpret_cast<const BYTE*>(&value), sizeof(value));
 		if (res != ERROR_SUCCESS) {
 			return false;
 		}
@@ -140,7 +238,7 @@ namespace registry {
 			throw std::runtime_error("value to save in the registry is too long");
 		}
 		// cbData must include the size of the terminating null
-		const auto res = RegSetValueExW(hk, valuename.c_str(), 0, static_cast<DWORD>(rt), reinterpret_cast<const BYTE*>(value.c_str()), static_cast<DWORD>((value.size() + 1)*sizeof(wchar_t)));
+		const auto res = GetBackend().SetValueEx(hk, valuename, static_cast<DWORD>(rt), reinterpret_cast<const BYTE*>(value.c_str()), static_cast<DWORD>((value.size() + 1)*sizeof(wchar_t)));
 		if (res != ERROR_SUCCESS) {
 			return false;
 		}
@@ -180,7 +278,7 @@ namespace registry {
 
 
 	bool RemoveValue(const HKEY hk, const std::wstring& valuename) {
-		const auto res = RegDeleteValueW(hk, valuename.c_str());
+		const auto res = GetBackend().DeleteValue(hk, valuename);
 		if (res != ERROR_SUCCESS) {
 			return false;
 		}
@@ -193,18 +291,13 @@ namespace registry {
 
 	bool RemoveKey(const HKEY hk, const std::wstring& valuename, const bool removesubkeys) {
 		if(removesubkeys){
-#if WINVER < _WIN32_WINNT_VISTA
-#warning "need to link to Shlwapi.lib"
-			const auto res = SHDeleteKey (hk, valuename.c_str());
-#else
-			const auto res = RegDeleteTreeW(hk, valuename.c_str());
-#endif
+			const auto res = GetBackend().DeleteTree(hk, valuename);
 			if (res != ERROR_SUCCESS) {
 				return false;
 			}
 			return true;
 		}
-		const auto res = RegDeleteKeyW(hk, valuename.c_str());
+		const auto res = GetBackend().DeleteKey(hk, valuename);
 		if (res != ERROR_SUCCESS) {
 			return false;
 		}
@@ -217,10 +310,11 @@ namespace registry {
 
 	// ERROR_ACCESS_DENIED --> open with KEY_ENUMERATE_SUB_KEYS | KEY_QUERY_VALUE
 	std::vector<std::string> EnumKey(const HKEY hk) {
+		auto& backend = GetBackend();
 		DWORD cSubKeys = 0;
 		DWORD cbMaxSubKey = 0;
 		// Get the class name and the value count.
-		auto retCode = RegQueryInfoKeyW(hk, nullptr, nullptr, nullptr, &cSubKeys, &cbMaxSubKey, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+		auto retCode = backend.QueryInfoKey(hk, &cSubKeys, &cbMaxSubKey, nullptr, nullptr, nullptr);
 		if (retCode != ERROR_SUCCESS) {
 			throw std::runtime_error("unable to RegQueryInfoKeyW key");
 		}
@@ -238,7 +332,7 @@ namespace registry {
 		for (DWORD i = 0; ;  ++i ) {
 			std::wstring buffer(cbMaxSubKey, '\0');
 			DWORD size = cbMaxSubKey;
-			retCode = RegEnumKeyExW(hk, i, &buffer[0], &size, nullptr, nullptr, nullptr, nullptr);
+			retCode = backend.EnumKeyEx(hk, i, &buffer[0], &size);
 			while (retCode == ERROR_MORE_DATA) { // timing issue, cbMaxSubKey may not be accurate
 				if (buffer.size() >= (std::numeric_limits<DWORD>::max)() / 2) { // cannot safely double the size
 					buffer.resize((std::numeric_limits<DWORD>::max)());
@@ -248,7 +342,7 @@ namespace registry {
 					throw std::runtime_error("error during RegEnumKeyExW");
 				}
 				size = static_cast<DWORD>(buffer.size()); // no conversion loss, checked when resizing buffer
-				retCode = RegEnumKeyExW(hk, i, &buffer[0], &size, nullptr, nullptr, nullptr, nullptr);
+				retCode = backend.EnumKeyEx(hk, i, &buffer[0], &size);
 			}
 			if (retCode == ERROR_NO_MORE_ITEMS) {
 				break;
@@ -266,7 +360,7 @@ namespace registry {
 
 	DWORD QueryType(const HKEY hk, const std::wstring& valuename) {
 		DWORD type = 0;
-		auto res = RegQueryValueExW(hk, valuename.c_str(), nullptr, &type, nullptr, nullptr);
+		auto res = GetBackend().QueryValueEx(hk, valuename, &type, nullptr, nullptr);
 		if (res != ERROR_SUCCESS) {
 			throw std::runtime_error("error while querying type");
 		}
@@ -279,14 +373,15 @@ namespace registry {
 	}
 
 	std::string QueryString(const HKEY hk, const std::wstring& valuename) {
+		auto& backend = GetBackend();
 		DWORD type = REG_SZ; //  or REG_EXPAND_SZ
 		DWORD size = 0;
-		auto res = RegQueryValueExW(hk, valuename.c_str(), nullptr, &type, nullptr, &size);
+		auto res = backend.QueryValueEx(hk, valuename, &type, nullptr, &size);
 		if (res != ERROR_SUCCESS || (type != REG_SZ && type != REG_EXPAND_SZ)) {
 			throw std::runtime_error("error while querying value");
 		}
 		std::wstring buffer(size/sizeof(wchar_t), '\0');
-		res = RegQueryValueExW(hk, valuename.c_str(), nullptr, &type, reinterpret_cast<LPBYTE>(&buffer.at(0)), &size);
+		res = backend.QueryValueEx(hk, valuename, &type, reinterpret_cast<LPBYTE>(&buffer.at(0)), &size);
 		if (res != ERROR_SUCCESS) {
 			throw std::runtime_error("error while querying value");
 		}
@@ -300,14 +395,15 @@ namespace registry {
 	}
 
 	std::vector<std::string> QueryMultiString(const HKEY hk, const std::wstring& valuename) {
+		auto& backend = GetBackend();
 		DWORD type = REG_SZ; //  or REG_EXPAND_SZ
 		DWORD size = 0;
-		auto res = RegQueryValueExW(hk, valuename.c_str(), nullptr, &type, nullptr, &size);
+		auto res = backend.QueryValueEx(hk, valuename, &type, nullptr, &size);
 		if (res != ERROR_SUCCESS || (type != REG_MULTI_SZ)) {
 			//throw std::runtime_error("error while querying value");
 		}
 		std::wstring buffer(size / sizeof(wchar_t), '\0');
-		res = RegQueryValueExW(hk, valuename.c_str(), nullptr, &type, reinterpret_cast<LPBYTE>(&buffer.at(0)), &size);
+		res = backend.QueryValueEx(hk, valuename, &type, reinterpret_cast<LPBYTE>(&buffer.at(0)), &size);
 		if (res != ERROR_SUCCESS) {
 			throw std::runtime_error("error while querying value");
 		}
@@ -344,10 +440,10 @@ namespace registry {
 	}
 
 	QWORD QueryQWORD(const HKEY hk, const std::wstring& valuename) {
-		QWORD buffer;
+		QWORD buffer = 0; // a REG_DWORD fills only the lower part
 		DWORD type = REG_QWORD;
 		DWORD size = sizeof(buffer);
-		const auto res = RegQueryValueExW(hk, valuename.c_str(), nullptr, &type, reinterpret_cast<LPBYTE>(&buffer), &size);
+		const auto res = GetBackend().QueryValueEx(hk, valuename, &type, reinterpret_cast<LPBYTE>(&buffer), &size);
 		if (res != ERROR_SUCCESS || (type != REG_DWORD && type != REG_QWORD)) {
 			throw std::runtime_error("error while querying value");
 		}
@@ -362,7 +458,7 @@ namespace registry {
 		DWORD buffer;
 		DWORD type = REG_QWORD;
 		DWORD size = sizeof(buffer);
-		const auto res = RegQueryValueExW(hk, valuename.c_str(), nullptr, &type, reinterpret_cast<LPBYTE>(&buffer), &size);
+		const auto res = GetBackend().QueryValueEx(hk, valuename, &type, reinterpret_cast<LPBYTE>(&buffer), &size);
 		if (res != ERROR_SUCCESS || type != REG_DWORD) {
 			throw std::runtime_error("error while querying value");
 		}
@@ -373,4 +469,17 @@ namespace registry {
 		return QueryDWORD(hk, s2ws(valuename));
 	}
 
+#if defined(_WIN32)
+	RAII_HKEY loadhive(const std::string& filename) {
+		HKEY hkey;
+		// FIXME: SAM as parameter, alternatives for REG_PROCESS_APPKEY
+		const auto ret = ::RegLoadAppKeyA(filename.c_str(), &hkey, KEY_ALL_ACCESS, 0, 0);
+		if (ret != ERROR_SUCCESS) {
+			throw std::runtime_error("unable to load key");
+		}
+		RAII_HKEY k(hkey, details::sKeyDeleter{ &DefaultBackend() });
+		return k;
+	}
+#endif
+
 }
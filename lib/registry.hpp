@@ -18,18 +18,40 @@
 #pragma once
 
 // local
-#include "win_handles.hpp"
-
-// windows
-#include <winreg.h>
-#include <KtmW32.h> // >= windows vista
-#include <WinDNS.h> // qword, should I really add it as a dependency?
+#include "win_types.hpp"
+#include "registry_backend.hpp"
 
 // std
 #include <string>
 #include <cassert>
 #include <algorithm>
 #include <vector>
+#include <memory>
+
+namespace registry {
+
+	namespace details {
+		// handles are closed by the backend that created them
+		struct sKeyDeleter {
+			typedef HKEY pointer;
+			Backend* backend = nullptr;
+			void operator()(const HKEY& hkey) const noexcept {
+				const auto res = (backend != nullptr ? *backend : GetBackend()).CloseKey(hkey); (void)res; assert(res == ERROR_SUCCESS);
+			}
+		};
+
+		struct sTransactionDeleter {
+			typedef HANDLE pointer;
+			Backend* backend = nullptr;
+			void operator()(const HANDLE& h) const noexcept {
+				(backend != nullptr ? *backend : GetBackend()).CloseTransaction(h);
+			}
+		};
+	}
+}
+
+using RAII_HKEY        = std::unique_ptr<HKEY,   registry::details::sKeyDeleter>;
+using RAII_TRANSACTION = std::unique_ptr<HANDLE, registry::details::sTransactionDeleter>;
 
 namespace registry {
 
@@ -44,11 +66,13 @@ namespace registry {
 
 	RAII_HKEY CreateKey(const HKEY hk, const std::string& subkey, const REGSAM samDesired = KEY_READ, const DWORD dwOptions = REG_OPTION_NON_VOLATILE);
 
-	RAII_HANDLE CreateTransaction();
+	RAII_TRANSACTION CreateTransaction();
+
+	bool CommitTransaction(const HANDLE transaction);
 
 	struct TransactionKey {
 		RAII_HKEY key;
-		RAII_HANDLE transaction;
+		RAII_TRANSACTION transaction;
 	};
 	TransactionKey CreateKeyTransacted(const HKEY hk, const std::wstring& subkey = L"", const REGSAM samDesired = KEY_QUERY_VALUE, DWORD dwOptions = REG_OPTION_NON_VOLATILE);
 
@@ -96,16 +120,10 @@ namespace registry {
 	QWORD QueryQWORD(const HKEY hk, const std::wstring& valuename);
 	QWORD QueryQWORD(const HKEY hk, const std::string& valuename);
 
+#if defined(_WIN32)
 	// Any hive loaded using RegLoadAppKey is automatically unloaded when all handles to the keys inside the hive are closed using RegCloseKey. --> unclear, do i need to regclose also HKEY? I think yes
-	inline RAII_HKEY loadhive(const std::string& filename) {
-		HKEY hkey;
-		// FIXME: SAM as parameter, alternatives for REG_PROCESS_APPKEY
-		const auto ret = ::RegLoadAppKeyA(filename.c_str(), &hkey, KEY_ALL_ACCESS, 0, 0);
-		if (ret != ERROR_SUCCESS) {
-			throw std::runtime_error("unable to load key");
-		}
-		RAII_HKEY k(hkey);
-		return k;
-	}
+	// always uses the windows registry, independently of the current backend
+	RAII_HKEY loadhive(const std::string& filename);
+#endif
 
 }
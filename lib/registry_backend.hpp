@@ -0,0 +1,79 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// local
+#include "win_types.hpp"
+
+// std
+#include <string>
+
+namespace registry {
+
+	/// Primitive operations used by the functions in registry.hpp
+	/// The methods mirror the Reg* functions of the windows api (same parameters and same return codes),
+	/// so that the logic in registry.cpp does not depend on where the data is stored
+	/// - on windows the default backend forwards to the windows registry
+	/// - MemoryHive (memoryhive.hpp) keeps everything in memory, it is the default backend on other platforms
+	class Backend {
+	public:
+		virtual ~Backend() = default;
+
+		virtual LONG OpenKeyEx(const HKEY hk, const std::wstring& subkey, const DWORD dwOptions, const REGSAM samDesired, HKEY* result) = 0;
+		/// transaction may be nullptr
+		virtual LONG CreateKeyEx(const HKEY hk, const std::wstring& subkey, const DWORD dwOptions, const REGSAM samDesired, const HANDLE transaction, HKEY* result) = 0;
+		virtual LONG CloseKey(const HKEY hk) noexcept = 0;
+
+		virtual LONG SetValueEx(const HKEY hk, const std::wstring& valuename, const DWORD type, const BYTE* data, const DWORD size) = 0;
+		/// same semantic of RegQueryValueExW: if data is nullptr only type and size are queried
+		virtual LONG QueryValueEx(const HKEY hk, const std::wstring& valuename, DWORD* type, BYTE* data, DWORD* size) = 0;
+		virtual LONG DeleteValue(const HKEY hk, const std::wstring& valuename) = 0;
+
+		virtual LONG DeleteKey(const HKEY hk, const std::wstring& subkey) = 0;
+		virtual LONG DeleteTree(const HKEY hk, const std::wstring& subkey) = 0;
+
+		/// every parameter may be nullptr
+		/// sizes of names are in characters, without the terminating null, the size of the data is in bytes
+		virtual LONG QueryInfoKey(const HKEY hk, DWORD* cSubKeys, DWORD* cbMaxSubKey, DWORD* cValues, DWORD* cbMaxValueName, DWORD* cbMaxValueData) = 0;
+		/// size is the size of the buffer in characters, and afterwards the length of the name (without the terminating null)
+		virtual LONG EnumKeyEx(const HKEY hk, const DWORD index, wchar_t* name, DWORD* size) = 0;
+		/// same semantic of RegEnumValueW: name, type and data in a single call
+		virtual LONG EnumValue(const HKEY hk, const DWORD index, wchar_t* name, DWORD* namesize, DWORD* type, BYTE* data, DWORD* datasize) = 0;
+
+		virtual LONG CreateTransaction(HANDLE* result) = 0;
+		virtual bool CommitTransaction(const HANDLE transaction) = 0;
+		virtual void CloseTransaction(const HANDLE transaction) noexcept = 0;
+	};
+
+	/// backend used by the functions in registry.hpp
+	Backend& GetBackend();
+
+	/// returns the previous backend, nullptr restores the default one
+	/// handles opened with the previous backend are still closed with the backend that created them
+	Backend* SetBackend(Backend* backend);
+
+	/// replaces the backend for the lifetime of the object
+	class ScopedBackend {
+		Backend* previous;
+	public:
+		explicit ScopedBackend(Backend& backend) : previous(SetBackend(&backend)) {}
+		~ScopedBackend() { SetBackend(previous); }
+		ScopedBackend(const ScopedBackend&) = delete;
+		ScopedBackend& operator=(const ScopedBackend&) = delete;
+	};
+}
@@ -0,0 +1,230 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "registry_snapshot.hpp"
+
+// local
+#include "registry.hpp"
+#include "registry_backend.hpp"
+#include "common.hpp"
+#include "win_types.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+namespace registry {
+
+	namespace {
+		wchar_t foldchar(const wchar_t c) {
+			return (c >= L'A' && c <= L'Z') ? static_cast<wchar_t>(c - L'A' + L'a') : c;
+		}
+
+		template<class T>
+		void growbuffer(std::vector<T>& buffer, const std::size_t minsize) {
+			if (buffer.size() >= (std::numeric_limits<DWORD>::max)() / 2) { // cannot safely double the size
+				throw std::runtime_error("value saved in the registry is too long");
+			}
+			buffer.resize((std::max)(minsize, 2 * buffer.size()));
+		}
+	}
+
+	constexpr std::size_t Snapshot::npos;
+
+	Snapshot::Snapshot(const HKEY hk, const std::wstring& subkey) {
+		auto& backend = GetBackend();
+		HKEY root = nullptr;
+		const auto res = backend.OpenKeyEx(hk, subkey, 0, KEY_READ, &root);
+		if (res == ERROR_FILE_NOT_FOUND) {
+			return;
+		}
+		if (res != ERROR_SUCCESS) {
+			throw std::runtime_error("unable to open key for snapshot");
+		}
+		const RAII_HKEY key(root, details::sKeyDeleter{ &backend });
+
+		names.assign(subkey.begin(), subkey.end());
+		keys.push_back({ 0, subkey.size(), npos, 0, 0, 0, 0 });
+		// buffers are reused for every key, they only grow to the longest name/data of the subtree
+		std::vector<wchar_t> namebuffer(256);
+		std::vector<BYTE> databuffer(1024);
+		readkey(key.get(), 0, namebuffer, databuffer);
+	}
+
+	void Snapshot::readkey(const HKEY hk, const std::size_t k, std::vector<wchar_t>& namebuffer, std::vector<BYTE>& databuffer) {
+		auto& backend = GetBackend();
+		DWORD cSubKeys = 0;
+		DWORD cbMaxSubKey = 0;
+		DWORD cValues = 0;
+		DWORD cbMaxValueName = 0;
+		DWORD cbMaxValueData = 0;
+		auto res = backend.QueryInfoKey(hk, &cSubKeys, &cbMaxSubKey, &cValues, &cbMaxValueName, &cbMaxValueData);
+		if (res != ERROR_SUCCESS) {
+			throw std::runtime_error("unable to RegQueryInfoKeyW key");
+		}
+		if (cbMaxSubKey >= namebuffer.size() || cbMaxValueName >= namebuffer.size()) {
+			namebuffer.resize(std::size_t(1) + (std::max)(cbMaxSubKey, cbMaxValueName));
+		}
+		if (cbMaxValueData > databuffer.size()) {
+			databuffer.resize(cbMaxValueData);
+		}
+
+		// values, like for subkeys, the number of elements and sizes may change while enumerating
+		keys[k].firstvalue = values.size();
+		values.reserve(values.size() + cValues);
+		for (DWORD i = 0; ; ++i) {
+			DWORD namesize = static_cast<DWORD>(namebuffer.size());
+			DWORD type = REG_NONE;
+			DWORD datasize = static_cast<DWORD>(databuffer.size());
+			res = backend.EnumValue(hk, i, namebuffer.data(), &namesize, &type, databuffer.data(), &datasize);
+			while (res == ERROR_MORE_DATA) { // timing issue, cbMaxValueName or cbMaxValueData may not be accurate
+				if (namesize >= namebuffer.size()) {
+					growbuffer(namebuffer, namebuffer.size());
+				}
+				growbuffer(databuffer, datasize);
+				namesize = static_cast<DWORD>(namebuffer.size());
+				datasize = static_cast<DWORD>(databuffer.size());
+				res = backend.EnumValue(hk, i, namebuffer.data(), &namesize, &type, databuffer.data(), &datasize);
+			}
+			if (res == ERROR_NO_MORE_ITEMS) {
+				break;
+			}
+			if (res != ERROR_SUCCESS) {
+				throw std::runtime_error("error during RegEnumValueW");
+			}
+			values.push_back({ names.size(), namesize, type, data.size(), datasize });
+			names.insert(names.end(), namebuffer.begin(), namebuffer.begin() + namesize);
+			data.insert(data.end(), databuffer.begin(), databuffer.begin() + datasize);
+		}
+		keys[k].values = values.size() - keys[k].firstvalue;
+
+		// all subkeys are added before descending, so that they are contiguous
+		const auto firstsubkey = keys.size();
+		keys.reserve(keys.size() + cSubKeys);
+		for (DWORD i = 0; ; ++i) {
+			DWORD size = static_cast<DWORD>(namebuffer.size());
+			res = backend.EnumKeyEx(hk, i, namebuffer.data(), &size);
+			while (res == ERROR_MORE_DATA) {
+				growbuffer(namebuffer, namebuffer.size());
+				size = static_cast<DWORD>(namebuffer.size());
+				res = backend.EnumKeyEx(hk, i, namebuffer.data(), &size);
+			}
+			if (res == ERROR_NO_MORE_ITEMS) {
+				break;
+			}
+			if (res != ERROR_SUCCESS) {
+				throw std::runtime_error("error during RegEnumKeyExW");
+			}
+			keys.push_back({ names.size(), size, k, 0, 0, 0, 0 });
+			names.insert(names.end(), namebuffer.begin(), namebuffer.begin() + size);
+		}
+		const auto subkeys = keys.size() - firstsubkey;
+		keys[k].firstsubkey = firstsubkey;
+		keys[k].subkeys = subkeys;
+
+		for (auto i = firstsubkey; i != firstsubkey + subkeys; ++i) {
+			const std::wstring name(&names[keys[i].name], keys[i].namesize);
+			HKEY subkey = nullptr;
+			res = backend.OpenKeyEx(hk, name, 0, KEY_READ, &subkey);
+			if (res == ERROR_FILE_NOT_FOUND) { // removed in the meantime, keep it as empty key
+				continue;
+			}
+			if (res != ERROR_SUCCESS) {
+				throw std::runtime_error("unable to open key for snapshot");
+			}
+			const RAII_HKEY key(subkey, details::sKeyDeleter{ &backend });
+			readkey(key.get(), i, namebuffer, databuffer);
+		}
+	}
+
+	std::string Snapshot::keyname(const std::size_t k) const {
+		const auto& entry = keys.at(k);
+		return ws2s(std::wstring(names.data() + entry.name, entry.namesize));
+	}
+
+	std::string Snapshot::valuename(const std::size_t v) const {
+		const auto& entry = values.at(v);
+		return ws2s(std::wstring(names.data() + entry.name, entry.namesize));
+	}
+
+	bool Snapshot::equalname(const std::size_t offset, const std::size_t size, const wchar_t* name) const {
+		const wchar_t* str = names.data() + offset;
+		for (std::size_t i = 0; i != size; ++i) {
+			if (name[i] == L'\0' || foldchar(name[i]) != foldchar(str[i])) {
+				return false;
+			}
+		}
+		return name[size] == L'\0';
+	}
+
+	std::size_t Snapshot::findsubkey(const std::size_t k, const wchar_t* name) const {
+		const auto& entry = keys.at(k);
+		for (auto i = entry.firstsubkey; i != entry.firstsubkey + entry.subkeys; ++i) {
+			if (equalname(keys[i].name, keys[i].namesize, name)) {
+				return i;
+			}
+		}
+		return npos;
+	}
+
+	std::size_t Snapshot::findvalue(const std::size_t k, const wchar_t* name) const {
+		const auto& entry = keys.at(k);
+		for (auto i = entry.firstvalue; i != entry.firstvalue + entry.values; ++i) {
+			if (equalname(values[i].name, values[i].namesize, name)) {
+				return i;
+			}
+		}
+		return npos;
+	}
+
+	const Snapshot::valueentry& Snapshot::getvalue(const std::size_t k, const wchar_t* name) const {
+		const auto v = findvalue(k, name);
+		if (v == npos) {
+			throw std::runtime_error("error while querying value");
+		}
+		return values[v];
+	}
+
+	std::string Snapshot::QueryString(const std::size_t k, const wchar_t* name) const {
+		const auto& v = getvalue(k, name);
+		if (v.type != REG_SZ && v.type != REG_EXPAND_SZ) {
+			throw std::runtime_error("error while querying value");
+		}
+		std::wstring buffer(v.datasize / sizeof(wchar_t), L'\0');
+		if (!buffer.empty()) { // data is not necessarily aligned
+			std::memcpy(&buffer[0], data.data() + v.data, buffer.size() * sizeof(wchar_t));
+		}
+		if (!buffer.empty() && buffer.back() == L'\0') {
+			buffer.pop_back();
+		}
+		return ws2s(buffer);
+	}
+
+	DWORD Snapshot::QueryDWORD(const std::size_t k, const wchar_t* name) const {
+		const auto& v = getvalue(k, name);
+		DWORD buffer = 0;
+		if (v.type != REG_DWORD || v.datasize != sizeof(buffer)) {
+			throw std::runtime_error("error while querying value");
+		}
+		std::memcpy(&buffer, data.data() + v.data, sizeof(buffer));
+		return buffer;
+	}
+}
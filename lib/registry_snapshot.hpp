@@ -0,0 +1,91 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// local
+#include "win_types.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace registry {
+
+	/// Copy of a whole subtree (keys, value names, types and raw data), read in a single pass.
+	/// Every key is opened once, and every value is read with a single call (name, type and data together),
+	/// afterwards no other call to the registry is necessary.
+	/// - names are stored in one buffer, data in another, entries reference them by offset
+	/// - the subkeys of a key are stored one after the other, and so are the values
+	/// - the first entry (index 0) is the root of the snapshot, if the snapshot is not empty
+	/// Names are compared case insensitive (like the registry does), but only ascii letters are folded.
+	class Snapshot {
+	public:
+		static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+		struct keyentry {
+			std::size_t name;       // offset in names
+			std::size_t namesize;   // in characters
+			std::size_t parent;     // npos for the root
+			std::size_t firstsubkey;
+			std::size_t subkeys;
+			std::size_t firstvalue;
+			std::size_t values;
+		};
+
+		struct valueentry {
+			std::size_t name;       // offset in names
+			std::size_t namesize;   // in characters
+			DWORD type;
+			std::size_t data;       // offset in data
+			std::size_t datasize;   // in bytes
+		};
+
+		Snapshot() = default;
+		/// if the subkey does not exist the snapshot is empty, other errors throw std::runtime_error
+		Snapshot(const HKEY hk, const std::wstring& subkey);
+
+		bool empty() const { return keys.empty(); }
+		std::size_t keycount() const { return keys.size(); }
+		std::size_t valuecount() const { return values.size(); }
+
+		const keyentry& key(const std::size_t k) const { return keys.at(k); }
+		const valueentry& value(const std::size_t v) const { return values.at(v); }
+
+		std::string keyname(const std::size_t k) const;
+		std::string valuename(const std::size_t v) const;
+
+		/// npos if there is no such subkey (or value)
+		std::size_t findsubkey(const std::size_t k, const wchar_t* name) const;
+		std::size_t findvalue(const std::size_t k, const wchar_t* name) const;
+
+		/// same semantic (and exceptions) of the registry::Query* functions
+		std::string QueryString(const std::size_t k, const wchar_t* name) const;
+		DWORD QueryDWORD(const std::size_t k, const wchar_t* name) const;
+
+	private:
+		std::vector<keyentry> keys;
+		std::vector<valueentry> values;
+		std::vector<wchar_t> names;
+		std::vector<BYTE> data;
+
+		void readkey(const HKEY hk, const std::size_t k, std::vector<wchar_t>& namebuffer, std::vector<BYTE>& databuffer);
+		bool equalname(const std::size_t offset, const std::size_t size, const wchar_t* name) const;
+		const valueentry& getvalue(const std::size_t k, const wchar_t* name) const;
+	};
+}
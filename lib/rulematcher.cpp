@@ -0,0 +1,322 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rulematcher.hpp"
+
+// local
+#include "policy.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+namespace policy {
+
+	namespace {
+		char fold(const char c) {
+			if (c >= 'A' && c <= 'Z') {
+				return static_cast<char>(c - 'A' + 'a');
+			}
+			return c == '/' ? '\\' : c;
+		}
+
+		bool iswildcard(const char c) {
+			return c == '*' || c == '?';
+		}
+
+		std::string foldstring(std::string s) {
+			std::transform(s.begin(), s.end(), s.begin(), fold);
+			return s;
+		}
+
+		std::string expand(const std::string& pattern, const std::map<std::string, std::string>& environment) {
+			std::string toreturn;
+			toreturn.reserve(pattern.size());
+			std::size_t pos = 0;
+			while (pos < pattern.size()) {
+				const auto begin = pattern.find('%', pos);
+				const auto end = (begin == std::string::npos) ? begin : pattern.find('%', begin + 1);
+				if (end == std::string::npos) {
+					toreturn.append(pattern, pos, std::string::npos);
+					break;
+				}
+				toreturn.append(pattern, pos, begin - pos);
+				const auto it = environment.find(foldstring(pattern.substr(begin + 1, end - begin - 1)));
+				if (it != environment.end()) {
+					toreturn += it->second;
+				} else {
+					toreturn.append(pattern, begin, end - begin + 1);
+				}
+				pos = end + 1;
+			}
+			return toreturn;
+		}
+
+		// matches the whole text, text is folded while matching
+		// '*' never needs to backtrack over '\', since the caller selects a text with the same number of separators of the pattern
+		bool globmatch(const char* pattern, const std::size_t patternsize, const char* text, const std::size_t textsize) {
+			std::size_t p = 0;
+			std::size_t t = 0;
+			std::size_t star = std::string::npos;
+			std::size_t mark = 0;
+			while (t < textsize) {
+				const char c = fold(text[t]);
+				if (p < patternsize && (pattern[p] == c || (pattern[p] == '?' && c != '\\'))) {
+					++p;
+					++t;
+				} else if (p < patternsize && pattern[p] == '*') {
+					star = p++;
+					mark = t;
+				} else if (star != std::string::npos) {
+					p = star + 1;
+					t = ++mark;
+				} else {
+					return false;
+				}
+			}
+			while (p < patternsize && pattern[p] == '*') {
+				++p;
+			}
+			return p == patternsize;
+		}
+
+		std::map<std::string, std::string> foldenvironment(const std::map<std::string, std::string>& environment) {
+			std::map<std::string, std::string> env;
+			for (const auto& v : environment) {
+				env[foldstring(v.first)] = v.second;
+			}
+			return env;
+		}
+
+		std::string normalizepattern(const std::string& pattern, const std::map<std::string, std::string>& env) {
+			auto toreturn = foldstring(expand(pattern, env));
+			while (toreturn.size() > 1 && toreturn.back() == '\\') { // "c:\windows\" is the same as "c:\windows"
+				toreturn.pop_back();
+			}
+			return toreturn;
+		}
+	}
+
+	constexpr std::size_t RuleMatcher::npos;
+
+	RuleMatcher::RuleMatcher(const std::vector<policy_s>& rules, const securitylevel defaultlevel_, const std::map<std::string, std::string>& environment)
+		: defaultlevel(defaultlevel_), pathtrie(1), nametrie(1) {
+		const auto env = foldenvironment(environment);
+
+		compiled.reserve(rules.size());
+		for (std::size_t i = 0; i != rules.size(); ++i) {
+			auto pattern = normalizepattern(rules[i].pol.ItemData, env);
+			if (pattern.empty()) {
+				continue;
+			}
+			compiledrule r;
+			r.specificity = static_cast<std::size_t>(std::count_if(pattern.begin(), pattern.end(), [](const char c) { return !iswildcard(c); }));
+			r.sec = rules[i].sec;
+			r.index = i;
+			r.separators = 0;
+			const bool ispath = pattern.find_first_of("\\:") != std::string::npos;
+			if (ispath) {
+				r.literal = static_cast<std::size_t>(std::find_if(pattern.begin(), pattern.end(), iswildcard) - pattern.begin());
+				r.separators = static_cast<std::size_t>(std::count(pattern.begin() + static_cast<std::ptrdiff_t>(r.literal), pattern.end(), '\\'));
+				const auto node = insert(pathtrie, pattern.substr(0, r.literal));
+				pathtrie[node].rules.push_back(compiled.size());
+			} else {
+				r.literal = static_cast<std::size_t>(std::find_if(pattern.rbegin(), pattern.rend(), iswildcard) - pattern.rbegin());
+				const auto node = insert(nametrie, std::string(pattern.rbegin(), pattern.rbegin() + static_cast<std::ptrdiff_t>(r.literal)));
+				nametrie[node].rules.push_back(compiled.size());
+			}
+			r.pattern = std::move(pattern);
+			compiled.push_back(std::move(r));
+		}
+	}
+
+	std::size_t RuleMatcher::insert(std::vector<trienode>& trie, const std::string& key) {
+		std::size_t node = 0;
+		for (const auto c : key) {
+			auto& edges = trie[node].edges;
+			const auto it = std::lower_bound(edges.begin(), edges.end(), c, [](const edge& e, const char ch) { return e.c < ch; });
+			if (it != edges.end() && it->c == c) {
+				node = it->node;
+				continue;
+			}
+			const auto next = trie.size();
+			edges.insert(it, edge{ c, next });
+			trie.emplace_back(); // invalidates edges
+			node = next;
+		}
+		return node;
+	}
+
+	std::size_t RuleMatcher::child(const std::vector<trienode>& trie, const std::size_t node, const char c) {
+		const auto& edges = trie[node].edges;
+		const auto it = std::lower_bound(edges.begin(), edges.end(), c, [](const edge& e, const char ch) { return e.c < ch; });
+		return (it != edges.end() && it->c == c) ? it->node : npos;
+	}
+
+	void RuleMatcher::consider(const std::size_t rule, std::size_t& best) const {
+		if (best == npos) {
+			best = rule;
+			return;
+		}
+		const auto& r = compiled[rule];
+		const auto& b = compiled[best];
+		if (r.specificity != b.specificity) {
+			if (r.specificity > b.specificity) {
+				best = rule;
+			}
+			return;
+		}
+		if (r.sec != b.sec) {
+			if (r.sec == securitylevel::Disallowed) {
+				best = rule;
+			}
+			return;
+		}
+		if (r.index < b.index) {
+			best = rule;
+		}
+	}
+
+	std::size_t RuleMatcher::find(const std::string& path) const {
+		std::size_t best = npos;
+		const char* str = path.data();
+		const auto size = path.size();
+
+		// path rules, pos is the number of characters matched by the literal prefix
+		const auto matchpath = [&](const std::size_t node, const std::size_t pos) {
+			for (const auto rule : pathtrie[node].rules) {
+				const auto& r = compiled[rule];
+				// the rest of the pattern matches up to the end of the path, or up to a separator (it is a directory containing the file)
+				std::size_t end = pos;
+				std::size_t separators = 0;
+				for (; end != size; ++end) {
+					if (fold(str[end]) == '\\' && separators++ == r.separators) {
+						break;
+					}
+				}
+				if (separators < r.separators) {
+					continue;
+				}
+				if (globmatch(r.pattern.data() + r.literal, r.pattern.size() - r.literal, str + pos, end - pos)) {
+					consider(rule, best);
+				}
+			}
+		};
+		std::size_t node = 0;
+		matchpath(node, 0);
+		for (std::size_t i = 0; i != size; ++i) {
+			node = child(pathtrie, node, fold(str[i]));
+			if (node == npos) {
+				break;
+			}
+			matchpath(node, i + 1);
+		}
+
+		// file name rules, walking the name backwards
+		std::size_t namestart = size;
+		while (namestart != 0 && fold(str[namestart - 1]) != '\\') {
+			--namestart;
+		}
+		const auto matchname = [&](const std::size_t n, const std::size_t suffixstart) {
+			for (const auto rule : nametrie[n].rules) {
+				const auto& r = compiled[rule];
+				if (globmatch(r.pattern.data(), r.pattern.size() - r.literal, str + namestart, suffixstart - namestart)) {
+					consider(rule, best);
+				}
+			}
+		};
+		node = 0;
+		matchname(node, size);
+		for (std::size_t i = size; i != namestart; --i) {
+			node = child(nametrie, node, fold(str[i - 1]));
+			if (node == npos) {
+				break;
+			}
+			matchname(node, i - 1);
+		}
+
+		return best;
+	}
+
+	std::size_t RuleMatcher::Match(const std::string& path) const {
+		const auto best = find(path);
+		return best == npos ? npos : compiled[best].index;
+	}
+
+	securitylevel RuleMatcher::Evaluate(const std::string& path) const {
+		const auto best = find(path);
+		return best == npos ? defaultlevel : compiled[best].sec;
+	}
+
+	RuleIndex::RuleIndex(const std::map<std::string, std::string>& environment) : env(foldenvironment(environment)) {}
+
+	RuleIndex::RuleIndex(const std::vector<policy_s>& rules_, const std::map<std::string, std::string>& environment) : RuleIndex(environment) {
+		rules.reserve(rules_.size());
+		for (const auto& v : rules_) {
+			add(v);
+		}
+	}
+
+	std::string RuleIndex::normalize(const std::string& itemdata) const {
+		return normalizepattern(itemdata, env);
+	}
+
+	void RuleIndex::add(const policy_s& rule) {
+		rules.emplace(normalize(rule.pol.ItemData), rule);
+	}
+
+	bool RuleIndex::remove(const policy_s& rule) {
+		const auto range = rules.equal_range(normalize(rule.pol.ItemData));
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second.UUID == rule.UUID) {
+				rules.erase(it);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool RuleIndex::contains(const std::string& itemdata) const {
+		return rules.count(normalize(itemdata)) != 0;
+	}
+
+	std::vector<policy_s> RuleIndex::find(const std::string& itemdata) const {
+		std::vector<policy_s> toreturn;
+		const auto range = rules.equal_range(normalize(itemdata));
+		for (auto it = range.first; it != range.second; ++it) {
+			toreturn.push_back(it->second);
+		}
+		return toreturn;
+	}
+
+	std::vector<std::size_t> RuleIndex::duplicates(const std::vector<policy_s>& candidates) const {
+		std::vector<std::size_t> toreturn;
+		std::unordered_set<std::string> seen;
+		seen.reserve(candidates.size());
+		for (std::size_t i = 0; i != candidates.size(); ++i) {
+			auto key = normalize(candidates[i].pol.ItemData);
+			if (rules.count(key) != 0 || !seen.insert(std::move(key)).second) {
+				toreturn.push_back(i);
+			}
+		}
+		return toreturn;
+	}
+}
@@ -0,0 +1,119 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// local
+#include "policy.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <cstddef>
+
+namespace policy {
+
+	/// Answers "would this file be blocked?" for a set of path rules, without touching the registry or the file system.
+	///
+	/// Rules are interpreted like Safer does:
+	/// - a rule containing '\' or ':' is a path rule, it matches the path itself and everything inside it
+	/// - other rules (like "*.pdf.exe") are matched against the file name only
+	/// - '*' matches any number of characters, and '?' a single character, but neither matches '\'
+	/// - comparison is case insensitive (only ascii letters are folded), '/' is the same as '\'
+	/// - if more rules match, the most specific one (more non-wildcard characters) wins, with the same specificity Disallowed wins
+	/// - environment variables (%name%) are replaced with the given values, unknown variables are kept as they are
+	///
+	/// All rules are compiled in two tries: path rules by their literal prefix and file name rules by their literal suffix.
+	/// A query walks each trie once, and only the rules found on the way need to match their wildcards.
+	class RuleMatcher {
+	public:
+		static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+		explicit RuleMatcher(const std::vector<policy_s>& rules, const securitylevel defaultlevel = securitylevel::Unrestricted,
+			const std::map<std::string, std::string>& environment = {});
+
+		/// index (in the vector used for creating the matcher) of the rule that decides the security level, npos if no rule matches
+		std::size_t Match(const std::string& path) const;
+
+		/// security level of the matching rule, or the default level
+		securitylevel Evaluate(const std::string& path) const;
+
+		bool IsBlocked(const std::string& path) const { return Evaluate(path) == securitylevel::Disallowed; }
+
+		std::size_t size() const { return compiled.size(); }
+
+	private:
+		struct edge {
+			char c;
+			std::size_t node;
+		};
+		struct trienode {
+			std::vector<edge> edges;        // sorted by character
+			std::vector<std::size_t> rules; // rules whose literal part ends here
+		};
+		struct compiledrule {
+			std::string pattern;            // folded, with expanded variables
+			std::size_t literal;            // length of the literal prefix (path rules) or suffix (name rules)
+			std::size_t separators;         // number of '\' after the literal prefix (path rules)
+			std::size_t specificity;
+			securitylevel sec;
+			std::size_t index;
+		};
+
+		securitylevel defaultlevel;
+		std::vector<compiledrule> compiled;
+		std::vector<trienode> pathtrie;     // indexed by literal prefix
+		std::vector<trienode> nametrie;     // indexed by reversed literal suffix
+
+		static std::size_t insert(std::vector<trienode>& trie, const std::string& key);
+		static std::size_t child(const std::vector<trienode>& trie, const std::size_t node, const char c);
+		void consider(const std::size_t rule, std::size_t& best) const;
+		std::size_t find(const std::string& path) const; // index in compiled
+	};
+
+	/// Index of rules by ItemData, for answering "is there already a rule for %TEMP%?" without scanning all rules.
+	///
+	/// ItemData is normalized like RuleMatcher does: known environment variables are expanded, ascii letters are folded,
+	/// '/' is the same as '\', and trailing '\' are removed. So "%temp%\", "%TEMP%" and the expanded path are the same key.
+	/// Rules can be added and removed one at a time, a lookup is a single hash table lookup.
+	class RuleIndex {
+	public:
+		explicit RuleIndex(const std::map<std::string, std::string>& environment = {});
+		explicit RuleIndex(const std::vector<policy_s>& rules, const std::map<std::string, std::string>& environment = {});
+
+		void add(const policy_s& rule);
+		/// removes the rule with the same ItemData and UUID, returns false if there is none
+		bool remove(const policy_s& rule);
+
+		bool contains(const std::string& itemdata) const;
+		/// all rules with the same normalized ItemData
+		std::vector<policy_s> find(const std::string& itemdata) const;
+
+		/// indexes of the candidates that are already in the index, or that are repeated in candidates
+		std::vector<std::size_t> duplicates(const std::vector<policy_s>& candidates) const;
+
+		std::string normalize(const std::string& itemdata) const;
+
+		std::size_t size() const { return rules.size(); }
+
+	private:
+		std::map<std::string, std::string> env; // folded names
+		std::unordered_multimap<std::string, policy_s> rules; // normalized ItemData -> rule
+	};
+}
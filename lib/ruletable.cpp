@@ -0,0 +1,289 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ruletable.hpp"
+
+// local
+#include "policy.hpp"
+#include "atom.hpp"
+#include "registry_snapshot.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <numeric>
+#include <iterator>
+#include <cstring>
+#include <cassert>
+
+namespace policy {
+
+	RuleTable::RuleTable(const std::vector<policy_s>& rules) {
+		std::size_t arenasize = 0;
+		for (const auto& v : rules) {
+			arenasize += v.UUID.size() + v.pol.ItemData.size();
+		}
+		reserve(rules.size(), arenasize);
+		for (const auto& v : rules) {
+			push_back(v);
+		}
+	}
+
+	void RuleTable::reserve(const std::size_t rows, const std::size_t arenasize) {
+		arena.reserve(arenasize);
+		uuids.reserve(rows);
+		itemdatas.reserve(rows);
+		names.reserve(rows);
+		descriptions.reserve(rows);
+		secs.reserve(rows);
+		hks.reserve(rows);
+		itemdatatypes.reserve(rows);
+	}
+
+	RuleTable::textref RuleTable::append(const iniparser::strview s) {
+		const textref t{ arena.size(), s.size() };
+		arena.insert(arena.end(), s.begin(), s.end());
+		return t;
+	}
+
+	void RuleTable::push_back(const policy_s& rule) {
+		push_back(rule.UUID, rule.pol.ItemData, rule.pol.name, rule.pol.Description, rule.sec, rule.hk, rule.pol.ItemDataType);
+	}
+
+	void RuleTable::push_back(const iniparser::strview uuid, const iniparser::strview itemdata, const Atom& name, const Atom& description,
+		const securitylevel sec, const HKEY hk, const registry::regtype itemdatatype) {
+		uuids.push_back(append(uuid));
+		itemdatas.push_back(append(itemdata));
+		names.push_back(name);
+		descriptions.push_back(description);
+		secs.push_back(sec);
+		hks.push_back(hk);
+		itemdatatypes.push_back(itemdatatype);
+	}
+
+	policy_s RuleTable::operator[](const std::size_t row) const {
+		policy_s p;
+		p.pol.name = names[row];
+		p.pol.Description = descriptions[row];
+		p.pol.ItemData = itemdata(row).to_string();
+		p.pol.ItemDataType = itemdatatypes[row];
+		p.UUID = uuid(row).to_string();
+		p.hk = hks[row];
+		p.sec = secs[row];
+		return p;
+	}
+
+	std::vector<policy_s> RuleTable::to_vector() const {
+		return to_vector(identity());
+	}
+
+	std::vector<policy_s> RuleTable::to_vector(const permutation& rows) const {
+		std::vector<policy_s> toreturn;
+		toreturn.reserve(rows.size());
+		for (const auto row : rows) {
+			toreturn.push_back((*this)[row]);
+		}
+		return toreturn;
+	}
+
+	RuleTable::permutation RuleTable::identity() const {
+		permutation p(size());
+		std::iota(p.begin(), p.end(), std::size_t(0));
+		return p;
+	}
+
+	int RuleTable::compare(const textref& t, const RuleTable& t2, const textref& other) const {
+		const auto common = (std::min)(t.size, other.size);
+		const auto res = (common == 0) ? 0 : std::memcmp(arena.data() + t.offset, t2.arena.data() + other.offset, common);
+		if (res != 0) {
+			return res;
+		}
+		return (t.size < other.size) ? -1 : (t.size > other.size ? 1 : 0);
+	}
+
+	bool RuleTable::less(const std::size_t row, const RuleTable& t2, const std::size_t row2) const {
+		// std::string compares characters like memcmp, as unsigned char
+		auto res = compare(uuids[row], t2, t2.uuids[row2]);
+		if (res != 0) {
+			return res < 0;
+		}
+		if (secs[row] != t2.secs[row2]) {
+			return secs[row] < t2.secs[row2];
+		}
+		if (descriptions[row] != t2.descriptions[row2]) {
+			return descriptions[row] < t2.descriptions[row2];
+		}
+		res = compare(itemdatas[row], t2, t2.itemdatas[row2]);
+		if (res != 0) {
+			return res < 0;
+		}
+		return names[row] < t2.names[row2];
+	}
+
+	RuleTable::permutation RuleTable::sorted() const {
+		auto p = identity();
+		std::sort(p.begin(), p.end(), [this](const std::size_t r1, const std::size_t r2) { return less(r1, *this, r2); });
+		return p;
+	}
+
+	RuleTable::permutation RuleTable::sortedbyrule() const {
+		auto p = identity();
+		std::sort(p.begin(), p.end(), [this](const std::size_t r1, const std::size_t r2) {
+			return compare(itemdatas[r2], *this, itemdatas[r1]) < 0;
+		});
+		return p;
+	}
+
+	std::vector<RuleTable::permutation> RuleTable::groupbyname(const bool groupempty) const {
+		std::vector<permutation> toreturn;
+		std::unordered_map<Atom, std::size_t> groups; // name -> index in toreturn
+		for (std::size_t row = 0; row != size(); ++row) {
+			const auto& name = names[row];
+			if (name.empty() && !groupempty) {
+				toreturn.push_back({ row });
+				continue;
+			}
+			auto it = groups.find(name);
+			if (it == groups.end()) {
+				it = groups.emplace(name, toreturn.size()).first;
+				toreturn.emplace_back();
+			}
+			toreturn[it->second].push_back(row);
+		}
+		return toreturn;
+	}
+
+	doubleext RuleTable::getdoubleext(const permutation& rows) const {
+		if (rows.empty()) {
+			return{};
+		}
+		std::vector<std::string> ext1;
+		std::vector<std::string> ext2;
+		// extensions are returned in the order they are found, the sets are only used to find duplicates
+		std::unordered_set<std::string> unique1;
+		std::unordered_set<std::string> unique2;
+		std::string e1;
+		std::string e2;
+		const auto first = rows.front();
+		for (const auto row : rows) {
+			if (names[row] != names[first] || descriptions[row] != descriptions[first] || secs[row] != secs[first] || hks[row] != hks[first]) {
+				return{};
+			}
+			if (!splitdoubleext(itemdata(row), e1, e2)) {
+				return{};
+			}
+			if (unique1.insert(e1).second) {
+				ext1.push_back(e1);
+			}
+			if (unique2.insert(e2).second) {
+				ext2.push_back(e2);
+			}
+		}
+		return{ std::move(ext1), std::move(ext2), names[first], descriptions[first], hks[first], secs[first] };
+	}
+
+	std::vector<doubleext> RuleTable::removedoubleext(std::vector<permutation>& groups) const {
+		std::vector<doubleext> toreturn;
+		auto out = groups.begin();
+		for (auto it = groups.begin(); it != groups.end(); ++it) {
+			auto doubleextension = getdoubleext(*it);
+			if (!doubleextension.ext1.empty() && !doubleextension.ext2.empty()) {
+				toreturn.push_back(std::move(doubleextension));
+			} else {
+				if (out != it) {
+					*out = std::move(*it);
+				}
+				++out;
+			}
+		}
+		groups.erase(out, groups.end());
+		return toreturn;
+	}
+
+	bool RuleTable::samerule(const std::size_t row, const policy_s& p) const {
+		return secs[row] == p.sec && names[row] == p.pol.name && descriptions[row] == p.pol.Description
+			&& itemdata(row) == p.pol.ItemData && itemdatatypes[row] == p.pol.ItemDataType;
+	}
+
+	RuleTable::diffresult RuleTable::diff(const RuleTable& installed) const {
+		const auto wanted = sorted();
+		const auto current = installed.sorted();
+		diffresult toreturn;
+		// set_difference on the permutations, the rows are never copied
+		auto i1 = wanted.begin();
+		auto i2 = current.begin();
+		while (i1 != wanted.end() && i2 != current.end()) {
+			if (less(*i1, installed, *i2)) {
+				toreturn.toadd.push_back(*i1++);
+			} else if (installed.less(*i2, *this, *i1)) {
+				toreturn.toremove.push_back(*i2++);
+			} else {
+				++i1;
+				++i2;
+			}
+		}
+		toreturn.toadd.insert(toreturn.toadd.end(), i1, wanted.end());
+		toreturn.toremove.insert(toreturn.toremove.end(), i2, current.end());
+		return toreturn;
+	}
+
+	RuleTable getLoadedRuleTable(const HKEY hk) {
+		RuleTable table;
+		const registry::Snapshot snapshot(hk, L"SOFTWARE\\Policies\\Microsoft\\Windows\\Safer\\CodeIdentifiers");
+		if (snapshot.empty()) {
+			return table;
+		}
+		struct level {
+			securitylevel sec;
+			const wchar_t* name;
+		};
+		const level levels[] = { { securitylevel::Disallowed, L"0" },{ securitylevel::Unrestricted, L"262144" } };
+		// rules of a group have the same name and description, they are interned only when they change
+		Atom name;
+		Atom description;
+		for (const auto& l : levels) {
+			const auto levelkey = snapshot.findsubkey(0, l.name);
+			const auto paths = (levelkey == registry::Snapshot::npos) ? levelkey : snapshot.findsubkey(levelkey, L"Paths");
+			if (paths == registry::Snapshot::npos) {
+				continue;
+			}
+			const auto& pathsentry = snapshot.key(paths);
+			table.reserve(table.size() + pathsentry.subkeys);
+			for (auto k = pathsentry.firstsubkey; k != pathsentry.firstsubkey + pathsentry.subkeys; ++k) {
+				const auto n = snapshot.QueryString(k, L"Name");
+				if (n != name.str()) {
+					name = n;
+				}
+				const auto d = snapshot.QueryString(k, L"Description");
+				if (d != description.str()) {
+					description = d;
+				}
+				auto saferflags = snapshot.QueryDWORD(k, L"SaferFlags"); // NOTE: ignore for the moment
+				assert(saferflags == 0); (void)saferflags;
+				table.push_back(snapshot.keyname(k), snapshot.QueryString(k, L"ItemData"), name, description, l.sec, hk);
+			}
+		}
+		return table;
+	}
+
+	std::vector<policy_s> getLoadedRules(const HKEY hk) {
+		return getLoadedRuleTable(hk).to_vector();
+	}
+}
@@ -0,0 +1,113 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// local
+#include "policy.hpp"
+#include "atom.hpp"
+#include "win_types.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace policy {
+
+	/// Column store for rules: every field of policy_s has its own vector, and UUID and ItemData are saved in a single character arena.
+	/// Sorting, grouping and diffing never move the rules, they return permutations (vectors of row indexes).
+	/// The rules of the machine are loaded in a table (getLoadedRuleTable), grouped, and diffed (PolicyDiff) without creating a policy_s per rule,
+	/// operator[] and to_vector create policy_s only for the rows that are needed (getLoadedRules is to_vector of the whole table).
+	class RuleTable {
+	public:
+		using permutation = std::vector<std::size_t>;
+
+		RuleTable() = default;
+		explicit RuleTable(const std::vector<policy_s>& rules);
+
+		void reserve(const std::size_t rows, const std::size_t arenasize = 0);
+		void push_back(const policy_s& rule);
+		void push_back(const iniparser::strview uuid, const iniparser::strview itemdata, const Atom& name, const Atom& description,
+			const securitylevel sec, const HKEY hk, const registry::regtype itemdatatype = registry::regtype::expand_sz);
+
+		std::size_t size() const { return secs.size(); }
+		bool empty() const { return secs.empty(); }
+
+		// columns, the views are valid until the next push_back
+		iniparser::strview uuid(const std::size_t row) const { return text(uuids[row]); }
+		iniparser::strview itemdata(const std::size_t row) const { return text(itemdatas[row]); }
+		const Atom& name(const std::size_t row) const { return names[row]; }
+		const Atom& description(const std::size_t row) const { return descriptions[row]; }
+		securitylevel sec(const std::size_t row) const { return secs[row]; }
+		HKEY hk(const std::size_t row) const { return hks[row]; }
+		registry::regtype itemdatatype(const std::size_t row) const { return itemdatatypes[row]; }
+
+		policy_s operator[](const std::size_t row) const;
+		std::vector<policy_s> to_vector() const;
+		std::vector<policy_s> to_vector(const permutation& rows) const;
+
+		permutation identity() const;
+
+		/// same order of Compare_policy_s
+		permutation sorted() const;
+		/// same order of CompareByRule (descending ItemData)
+		permutation sortedbyrule() const;
+
+		/// same groups, in the same order, of groupbyname
+		std::vector<permutation> groupbyname(const bool groupempty = false) const;
+		/// like getdoubleext for the rules of a group
+		doubleext getdoubleext(const permutation& rows) const;
+		/// like removedoubleext, the groups that are not double-ext are left in groups
+		std::vector<doubleext> removedoubleext(std::vector<permutation>& groups) const;
+
+		/// same values of the rule, ignoring the UUID, like samerule
+		bool samerule(const std::size_t row, const policy_s& p) const;
+
+		/// rows that are only in this table (toadd) and rows that are only in installed (toremove), compared like Compare_policy_s
+		struct diffresult {
+			permutation toadd;    // rows of this table
+			permutation toremove; // rows of installed
+		};
+		diffresult diff(const RuleTable& installed) const;
+
+		/// true if row of this table is ordered before row2 of t2, like Compare_policy_s
+		bool less(const std::size_t row, const RuleTable& t2, const std::size_t row2) const;
+
+	private:
+		struct textref {
+			std::size_t offset;
+			std::size_t size;
+		};
+
+		std::vector<char> arena;
+		std::vector<textref> uuids;
+		std::vector<textref> itemdatas;
+		std::vector<Atom> names;
+		std::vector<Atom> descriptions;
+		std::vector<securitylevel> secs;
+		std::vector<HKEY> hks;
+		std::vector<registry::regtype> itemdatatypes;
+
+		textref append(const iniparser::strview s);
+		iniparser::strview text(const textref& t) const { return iniparser::strview(arena.data() + t.offset, t.size); }
+		int compare(const textref& t, const RuleTable& t2, const textref& other) const;
+	};
+
+	/// reads the whole CodeIdentifiers subtree at once (like getLoadedRules), and creates a row for every rule
+	RuleTable getLoadedRuleTable(const HKEY hk);
+}
@@ -0,0 +1,96 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sidcache.hpp"
+
+// std
+#include <string>
+#include <utility>
+#include <mutex>
+#include <stdexcept>
+
+namespace evtlog {
+
+	SidCache::SidCache(SidResolver& resolver_, const std::size_t capacity_, const clock::duration ttl_, const clock::duration negativettl_,
+		std::function<clock::time_point()> now_)
+		: resolver(resolver_), capacity(capacity_), ttl(ttl_), negativettl(negativettl_), now(std::move(now_)) {
+		if (capacity == 0) {
+			throw std::runtime_error("cache without capacity");
+		}
+		bysid.reserve(capacity);
+	}
+
+	template<class T>
+	T SidCache::get(const std::string& sid, value<T> entry::* field, bool (SidResolver::* lookup)(const std::string&, T&)) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			const auto it = bysid.find(sid);
+			if (it != bysid.end()) {
+				lru.splice(lru.begin(), lru, it->second);
+				const auto& v = (*it->second).*field;
+				if (v.valid && now() < v.expiry) {
+					return v.data;
+				}
+			}
+		}
+
+		T data{};
+		const bool found = (resolver.*lookup)(sid, data);
+		if (!found) {
+			data = T{};
+		}
+		const auto expiry = now() + (found ? ttl : negativettl);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = bysid.find(sid);
+		if (it == bysid.end()) {
+			if (bysid.size() == capacity) {
+				bysid.erase(lru.back().sid);
+				lru.pop_back();
+			}
+			lru.emplace_front();
+			lru.front().sid = sid;
+			it = bysid.emplace(sid, lru.begin()).first;
+		} else {
+			lru.splice(lru.begin(), lru, it->second);
+		}
+		auto& v = (*it->second).*field;
+		v.data = data;
+		v.expiry = expiry;
+		v.valid = true;
+		return data;
+	}
+
+	account SidCache::username(const std::string& sid) {
+		return get(sid, &entry::user, &SidResolver::lookup_account);
+	}
+
+	std::string SidCache::home(const std::string& sid) {
+		return get(sid, &entry::home, &SidResolver::lookup_home);
+	}
+
+	std::size_t SidCache::size() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return bysid.size();
+	}
+
+	void SidCache::clear() {
+		std::lock_guard<std::mutex> lock(mutex);
+		bysid.clear();
+		lru.clear();
+	}
+}
@@ -0,0 +1,90 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// std
+#include <string>
+#include <utility>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <cstddef>
+
+namespace evtlog {
+
+	/// account name and domain of a SID
+	using account = std::pair<std::string, std::string>;
+
+	/// Looks up information about users, the windows implementation asks LookupAccountSid and the ProfileList registry key
+	class SidResolver {
+	public:
+		virtual ~SidResolver() = default;
+		/// return false if the SID is unknown
+		virtual bool lookup_account(const std::string& sid, account& out) = 0;
+		virtual bool lookup_home(const std::string& sid, std::string& out) = 0;
+	};
+
+	/// Remembers what a SidResolver returned, since events repeat the same few SIDs
+	/// - at most capacity SIDs are kept, the least recently used is forgotten first
+	/// - results expire after ttl, unknown SIDs after negativettl (so that a missing user is not looked up for every event)
+	/// - can be used from more threads, the resolver is called without holding the lock
+	class SidCache {
+	public:
+		using clock = std::chrono::steady_clock;
+
+		explicit SidCache(SidResolver& resolver, const std::size_t capacity = 256,
+			const clock::duration ttl = std::chrono::minutes(10), const clock::duration negativettl = std::chrono::minutes(1),
+			std::function<clock::time_point()> now = &clock::now);
+
+		/// empty strings if the SID is unknown
+		account username(const std::string& sid);
+		/// empty string if the SID is unknown
+		std::string home(const std::string& sid);
+
+		std::size_t size() const;
+		void clear();
+
+	private:
+		template<class T>
+		struct value {
+			T data;
+			clock::time_point expiry;
+			bool valid = false;
+		};
+		struct entry {
+			std::string sid;
+			value<account> user;
+			value<std::string> home;
+		};
+
+		SidResolver& resolver;
+		const std::size_t capacity;
+		const clock::duration ttl;
+		const clock::duration negativettl;
+		const std::function<clock::time_point()> now;
+
+		mutable std::mutex mutex;
+		std::list<entry> lru; // most recently used first
+		std::unordered_map<std::string, std::list<entry>::iterator> bysid;
+
+		template<class T>
+		T get(const std::string& sid, value<T> entry::* field, bool (SidResolver::* lookup)(const std::string&, T&));
+	};
+}
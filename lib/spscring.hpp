@@ -0,0 +1,116 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// std
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include <cstddef>
+
+/// Bounded lock-free queue between exactly one producer thread and one consumer thread
+///
+/// The elements live in the ring and are reused: the producer fills the slot returned by reserve and publishes it with commit,
+/// the consumer gets a reference to the slots with drain. So elements with buffers (like std::string) do not need to allocate once the ring is warm.
+/// The producer never waits, if the ring is full reserve returns nullptr and the caller decides what to drop.
+template<class T>
+class SpscRing {
+public:
+	static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+	/// capacity is rounded up to a power of two
+	explicit SpscRing(const std::size_t capacity) : mask(roundup(capacity) - 1), slots(new T[mask + 1]) {}
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	// producer
+
+	/// slot for the next element, nullptr if the ring is full
+	T* reserve() {
+		const auto t = tail.load(std::memory_order_relaxed);
+		if (t - cachedhead > mask) {
+			cachedhead = head.load(std::memory_order_acquire);
+			if (t - cachedhead > mask) {
+				return nullptr;
+			}
+		}
+		return &slots[t & mask];
+	}
+	/// publishes the slot returned by reserve
+	void commit() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+	bool push(const T& value) {
+		const auto slot = reserve();
+		if (slot == nullptr) {
+			return false;
+		}
+		*slot = value;
+		commit();
+		return true;
+	}
+
+	// consumer
+
+	/// calls f(T&) on up to max elements, in order, and releases their slots, returns the number of consumed elements
+	/// if f throws, the elements before the one that failed are consumed
+	template<class F>
+	std::size_t drain(F f, const std::size_t max = npos) {
+		const auto h = head.load(std::memory_order_relaxed);
+		const auto n = (std::min)(tail.load(std::memory_order_acquire) - h, max);
+		struct release {
+			std::atomic<std::size_t>& head;
+			std::size_t pos;
+			~release() { head.store(pos, std::memory_order_release); }
+		} done{ head, h };
+		for (; done.pos != h + n; ++done.pos) {
+			f(slots[done.pos & mask]);
+		}
+		return n;
+	}
+	/// swaps the first element with out, so that the slot reuses the memory of out
+	bool pop(T& out) {
+		using std::swap;
+		return drain([&out](T& value){ swap(out, value); }, 1) == 1;
+	}
+
+	/// only exact when called while the other thread is not using the ring
+	std::size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+	std::size_t capacity() const { return mask + 1; }
+
+private:
+	static std::size_t roundup(const std::size_t n) {
+		std::size_t toreturn = 1;
+		while (toreturn < n) {
+			toreturn *= 2;
+		}
+		return toreturn;
+	}
+
+	// head and tail on different cache lines, so that producer and consumer do not invalidate each other at every operation
+	std::atomic<std::size_t> head{ 0 };  // written by the consumer
+	char padhead[64];
+	std::atomic<std::size_t> tail{ 0 };  // written by the producer
+	std::size_t cachedhead = 0;          // last head seen by the producer
+	char padtail[64];
+	const std::size_t mask;
+	std::unique_ptr<T[]> slots;
+};
@@ -17,16 +17,18 @@
 
 // local
 #include "common.hpp"
+#include "utf.hpp"
+#include "spscring.hpp"
 #include "policy.hpp"
 
 // test
 #include "catch.hpp"
 
-// windows
-#include <Windows.h>
-
 //std
 #include <string>
+#include <vector>
+#include <stdexcept>
+#include <thread>
 
 
 TEST_CASE("RuleCompare", "[common][matchwithoptionalnumber]") {
@@ -151,3 +153,157 @@ TEST_CASE("trimandremovedelim", "[common][removedel][trim]") {
 	std::vector<std::string> output = { "a", "a", " a" };
 	REQUIRE(trimandremovedelim(input) == output);
 }
+
+TEST_CASE("utf8utf16", "[common][utf]") {
+	// ascii of different lengths and alignments, for testing the vectorized and scalar paths
+	const std::string ascii = "The quick brown fox jumps over the lazy dog 0123456789 !\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+	for (std::size_t offset = 0; offset != 17; ++offset) {
+		for (std::size_t size = 0; offset + size <= ascii.size(); size += 7) {
+			const std::string in = ascii.substr(offset, size);
+			std::vector<char16_t> utf16(utf::max_utf16_size(in.size()) + 1);
+			const auto len = utf::utf8_to_utf16(in.data(), in.size(), utf16.data());
+			REQUIRE(len == in.size());
+			REQUIRE(std::equal(in.begin(), in.end(), utf16.begin()));
+			std::string out(utf::max_utf8_size_from_utf16(len) + 1, '\0');
+			REQUIRE(utf::utf16_to_utf8(utf16.data(), len, &out[0]) == in.size());
+			REQUIRE(out.substr(0, in.size()) == in);
+		}
+	}
+
+	// 2, 3 and 4 bytes sequences, also after a full block of ascii characters
+	const std::string mixed = u8"0123456789abcdef\u00e4\u00f6\u00fc 0123456789abcdef\u20ac\U0001F600 end";
+	std::vector<char16_t> utf16(utf::max_utf16_size(mixed.size()));
+	const auto len = utf::utf8_to_utf16(mixed.data(), mixed.size(), utf16.data());
+	const std::u16string expected = u"0123456789abcdef\u00e4\u00f6\u00fc 0123456789abcdef\u20ac\U0001F600 end";
+	REQUIRE(std::u16string(utf16.data(), len) == expected);
+	std::string out(utf::max_utf8_size_from_utf16(len), '\0');
+	REQUIRE(utf::utf16_to_utf8(utf16.data(), len, &out[0]) == mixed.size());
+	REQUIRE(out.substr(0, mixed.size()) == mixed);
+
+	std::vector<char32_t> utf32(utf::max_utf32_size(mixed.size()));
+	const auto len32 = utf::utf8_to_utf32(mixed.data(), mixed.size(), utf32.data());
+	REQUIRE(std::u32string(utf32.data(), len32) == U"0123456789abcdef\u00e4\u00f6\u00fc 0123456789abcdef\u20ac\U0001F600 end");
+	std::string out32(utf::max_utf8_size_from_utf32(len32), '\0');
+	REQUIRE(utf::utf32_to_utf8(utf32.data(), len32, &out32[0]) == mixed.size());
+	REQUIRE(out32.substr(0, mixed.size()) == mixed);
+
+	REQUIRE(s2ws(mixed) == L"0123456789abcdef\u00e4\u00f6\u00fc 0123456789abcdef\u20ac\U0001F600 end");
+	REQUIRE(ws2s(s2ws(mixed)) == mixed);
+	REQUIRE(s2ws("").empty());
+	REQUIRE(ws2s(L"").empty());
+}
+
+TEST_CASE("utfinvalid", "[common][utf]") {
+	const std::vector<std::string> invalid = {
+		"\x80",                 // continuation byte without lead byte
+		"abc\xC3",              // truncated
+		"\xE2\x82",            // truncated
+		"\xC0\xAF",            // overlong '/'
+		"\xE0\x80\xAF",       // overlong '/'
+		"\xED\xA0\x80",       // surrogate
+		"\xF4\x90\x80\x80",  // above U+10FFFF
+		"\xFF",
+		"0123456789abcdef0123456789abcdef\xC3\x28",
+	};
+	std::vector<char16_t> utf16(64);
+	for (const auto& s : invalid) {
+		REQUIRE(utf::utf8_to_utf16(s.data(), s.size(), utf16.data()) == utf::invalid);
+		REQUIRE_THROWS_AS(s2ws(s), std::runtime_error);
+	}
+
+	std::string out(64, '\0');
+	const char16_t lonehigh[] = { u'a', 0xD800, u'b' };
+	REQUIRE(utf::utf16_to_utf8(lonehigh, 3, &out[0]) == utf::invalid);
+	const char16_t lonelow[] = { 0xDC00, u'a' };
+	REQUIRE(utf::utf16_to_utf8(lonelow, 2, &out[0]) == utf::invalid);
+	const char16_t truncated[] = { u'a', 0xD83D };
+	REQUIRE(utf::utf16_to_utf8(truncated, 2, &out[0]) == utf::invalid);
+	const char32_t toobig[] = { 0x110000 };
+	REQUIRE(utf::utf32_to_utf8(toobig, 1, &out[0]) == utf::invalid);
+	const char32_t surrogate[] = { 0xDFFF };
+	REQUIRE(utf::utf32_to_utf8(surrogate, 1, &out[0]) == utf::invalid);
+}
+
+TEST_CASE("utfreusebuffer", "[common][utf]") {
+	std::wstring wbuffer;
+	std::string buffer;
+	const std::string longer = "a long string, longer than the following one";
+	utf::to_wide(longer.data(), longer.size(), wbuffer);
+	REQUIRE(wbuffer == L"a long string, longer than the following one");
+	utf::to_wide("short", 5, wbuffer);
+	REQUIRE(wbuffer == L"short");
+	utf::to_utf8(wbuffer.data(), wbuffer.size(), buffer);
+	REQUIRE(buffer == "short");
+	REQUIRE_THROWS_AS(utf::to_wide("\xC3", 1, wbuffer), std::runtime_error);
+}
+
+TEST_CASE("combineextgenerator", "[common][combineext]") {
+	const std::vector<std::string> ext1 = { "doc", "pdf", "jpeg" };
+	const std::vector<std::string> ext2 = { "exe", "com", "scr", "diagcab" };
+	combineextgenerator gen(ext1, ext2);
+	REQUIRE(gen.size() == 12);
+	std::vector<std::string> generated;
+	while (gen.next()) {
+		generated.push_back(gen.current());
+	}
+	REQUIRE(!gen.next()); // stays at the end
+	REQUIRE(generated == combineext(ext1, ext2));
+	REQUIRE(generated.front() == "*.doc.exe");
+	REQUIRE(generated.at(3) == "*.doc.diagcab");
+	REQUIRE(generated.back() == "*.jpeg.diagcab");
+
+	const std::vector<std::string> none;
+	combineextgenerator empty(ext1, none);
+	REQUIRE(empty.size() == 0);
+	REQUIRE(!empty.next());
+}
+
+TEST_CASE("SpscRing", "[common][SpscRing]") {
+	SpscRing<std::string> ring(3);
+	REQUIRE(ring.capacity() == 4);
+	REQUIRE(ring.push("a"));
+	REQUIRE(ring.push("b"));
+	auto slot = ring.reserve();
+	REQUIRE(slot != nullptr);
+	*slot = "c";
+	ring.commit();
+	REQUIRE(ring.push("d"));
+	REQUIRE(!ring.push("e")); // full
+	REQUIRE(ring.size() == 4);
+
+	std::string out;
+	REQUIRE(ring.pop(out));
+	REQUIRE(out == "a");
+	std::string all;
+	REQUIRE(ring.drain([&](std::string& s){ all += s; }, 2) == 2);
+	REQUIRE(all == "bc");
+	REQUIRE(ring.push("e"));
+	REQUIRE(ring.push("f"));
+	REQUIRE(ring.drain([&](std::string& s){ all += s; }) == 3);
+	REQUIRE(all == "bcdef");
+	REQUIRE(!ring.pop(out));
+}
+
+TEST_CASE("SpscRingThreads", "[common][SpscRing]") {
+	SpscRing<std::size_t> ring(64);
+	const std::size_t count = 200000;
+	std::thread producer([&]{
+		for (std::size_t i = 0; i != count;) {
+			if (ring.push(i)) {
+				++i;
+			} else {
+				std::this_thread::yield();
+			}
+		}
+	});
+	std::size_t expected = 0;
+	bool inorder = true;
+	while (expected != count) {
+		if (ring.drain([&](const std::size_t v){ inorder = inorder && v == expected; ++expected; }, 16) == 0) {
+			std::this_thread::yield();
+		}
+	}
+	producer.join();
+	REQUIRE(inorder);
+	REQUIRE(ring.size() == 0);
+}
@@ -0,0 +1,572 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#include "../eventsource.hpp"
+#include "../blockedevent.hpp"
+#include "../eventhistory.hpp"
+#include "../sidcache.hpp"
+#include "../aggregator.hpp"
+#include "../journal.hpp"
+#include "settings.hpp"
+
+// test
+#include "catch.hpp"
+
+//std
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <fstream>
+#include <cstdio>
+#include <iterator>
+#include <stdexcept>
+
+TEST_CASE("ReplaySource", "[evtlog][EventSource]") {
+	evtlog::ReplaySource source(test_data_dir + "events866.xml");
+	REQUIRE(source.size() == 3);
+
+	std::vector<std::string> events;
+	REQUIRE(source.run([&](const char* xml, const std::size_t size){ events.emplace_back(xml, size); }) == 3);
+	REQUIRE(events.size() == 3);
+	for (const auto& e : events) {
+		REQUIRE(e.compare(0, 7, "<Event ") == 0);
+		REQUIRE(e.compare(e.size() - 8, 8, "</Event>") == 0);
+	}
+	REQUIRE(events[1].find("D:\\invoice.pdf.exe") != std::string::npos);
+
+	// a source can be replayed, and stopped by the consumer
+	evtlog::ReplaySource endless(test_data_dir + "events866.xml", 0, 0);
+	std::size_t count = 0;
+	REQUIRE(endless.run([&](const char*, std::size_t){ if (++count == 10) { endless.stop(); } }) == 10);
+
+	// a stop that arrives before run is not lost, and it does not affect the following run
+	endless.stop();
+	REQUIRE(endless.run([](const char*, std::size_t){}) == 0);
+	count = 0;
+	REQUIRE(endless.run([&](const char*, std::size_t){ if (++count == 5) { endless.stop(); } }) == 5);
+
+	REQUIRE_THROWS(evtlog::ReplaySource(test_data_dir + "doesnotexist.xml"));
+}
+
+TEST_CASE("ReplaySourceRate", "[evtlog][EventSource]") {
+	evtlog::ReplaySource source(test_data_dir + "events866.xml", 1000, 10);
+	const auto start = std::chrono::steady_clock::now();
+	REQUIRE(source.run([](const char*, std::size_t){}) == 30);
+	// the last event is due after 29ms
+	REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(28));
+}
+
+TEST_CASE("ReplaySourceBenchmark", "[evtlog][EventSource][.]") {
+	evtlog::ReplaySource source(test_data_dir + "events866.xml", 100000, 0);
+	std::size_t bytes = 0;
+	std::size_t count = 0;
+	const auto start = std::chrono::steady_clock::now();
+	source.run([&](const char*, const std::size_t size){ bytes += size; if (++count == 300000) { source.stop(); } });
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	std::cout << count << " events (" << bytes << " bytes) in " << elapsed.count() << "ms\n";
+	REQUIRE(elapsed >= std::chrono::milliseconds(2990));
+}
+
+TEST_CASE("ParseBlockedEvent", "[evtlog][BlockedEvent]") {
+	evtlog::ReplaySource source(test_data_dir + "events866.xml");
+	std::vector<evtlog::BlockedEvent> events;
+	source.run([&](const char* xml, const std::size_t size){
+		evtlog::BlockedEvent e;
+		REQUIRE(evtlog::parse_event(xml, size, e));
+		events.push_back(e);
+	});
+	REQUIRE(events.size() == 3);
+
+	REQUIRE(events[0].time == 1478110807LL * 1000000);
+	REQUIRE(events[0].record == 4161);
+	REQUIRE(events[0].user == "S-1-5-21-13210259-1748602183-1043662369-1001");
+	REQUIRE(events[0].path == "C:\\Users\\me\\AppData\\Local\\Temp\\setup.exe");
+	REQUIRE(events[0].rulepath == "%TEMP%");
+	REQUIRE(events[0].rule.to_string() == "{3B8C9C6B-E2A1-4F87-9E6A-2E4B0F4E3D21}");
+
+	REQUIRE(events[1].time == 1478110902LL * 1000000 + 517000);
+	REQUIRE(events[1].user == "S-1-5-21-13210259-1748602183-1043662369-1002");
+	REQUIRE(events[1].path == "D:\\invoice.pdf.exe");
+	REQUIRE(events[1].rulepath == "*.pdf.exe");
+
+	REQUIRE(events[2].path == "C:\\Users\\me\\Downloads\\a & b.exe");
+	REQUIRE(events[2].rule == events[0].rule);
+}
+
+TEST_CASE("ParseBlockedEventData", "[evtlog][BlockedEvent]") {
+	const std::string xml = "<Event xmlns='http://schemas.microsoft.com/win/2004/08/events/event'><System>"
+		"<TimeCreated SystemTime=\"1969-12-31T23:59:59Z\"/><!-- <Security UserID='S-1-0'/> --></System>"
+		"<EventData><Data Name='AttemptedPath'>C:\\&#x4E2D;&#35;.exe</Data><Data Name='RulePath'/><Data Name='SrpRuleGuid'>not a guid</Data></EventData></Event>";
+	evtlog::BlockedEvent e;
+	e.user = "previous";
+	REQUIRE(evtlog::parse_event(xml, e));
+	REQUIRE(e.time == -1000000);
+	REQUIRE(e.user.empty());
+	REQUIRE(e.path == "C:\\\xE4\xB8\xAD#.exe");
+	REQUIRE(e.rulepath.empty());
+	REQUIRE(e.rule.isnil());
+
+	REQUIRE(!evtlog::parse_event(xml.substr(0, xml.size() - 3), e));
+	REQUIRE(!evtlog::parse_event("<Event><System", e));
+
+	// parsing again in the same object does not need to allocate
+	REQUIRE(evtlog::parse_event(xml, e));
+	const auto data = e.path.data();
+	REQUIRE(evtlog::parse_event(xml, e));
+	REQUIRE(e.path.data() == data);
+}
+
+TEST_CASE("ParseBlockedEventBenchmark", "[evtlog][BlockedEvent][.]") {
+	evtlog::ReplaySource source(test_data_dir + "events866.xml", 0, 100000);
+	evtlog::BlockedEvent e;
+	std::size_t parsed = 0;
+	const auto start = std::chrono::steady_clock::now();
+	source.run([&](const char* xml, const std::size_t size){ parsed += evtlog::parse_event(xml, size, e); });
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	std::cout << parsed << " events parsed in " << elapsed.count() << "ms\n";
+	REQUIRE(parsed == 300000);
+}
+
+namespace {
+	std::string paths(const evtlog::EventHistory& history) {
+		std::string toreturn;
+		for (std::size_t i = 0; i != history.size(); ++i) {
+			toreturn += history[i].path;
+		}
+		return toreturn;
+	}
+
+	void append(evtlog::EventHistory& history, const std::int64_t time, const std::string& path) {
+		auto& e = history.append();
+		e.time = time;
+		e.path = path;
+	}
+}
+
+TEST_CASE("EventHistory", "[evtlog][EventHistory]") {
+	evtlog::EventHistory history(4);
+	append(history, 3, "c");
+	append(history, 1, "a");
+	REQUIRE(history.size() == 0); // not visible before update
+	REQUIRE(history.stored() == 2);
+	REQUIRE(history.appendsonly());
+	history.update();
+	REQUIRE(paths(history) == "ac");
+	const auto seqc = history.sequence(1);
+	REQUIRE(history.visible(seqc));
+
+	history.sort(evtlog::EventHistory::column::path, false);
+	REQUIRE(paths(history) == "ca");
+	append(history, 2, "b");
+	append(history, 5, "e");
+	append(history, 4, "d");
+	REQUIRE(!history.appendsonly());
+	history.update();
+	REQUIRE(history.size() == 4);
+	REQUIRE(paths(history) == "edba"); // "c", the oldest, has been replaced
+	REQUIRE(!history.visible(seqc));
+	REQUIRE(history.visible(history.sequence(0)));
+
+	history.sort(evtlog::EventHistory::column::time, true);
+	REQUIRE(paths(history) == "abde");
+	append(history, 6, "f");
+	REQUIRE(!history.appendsonly()); // "a" is replaced
+
+	// more events than capacity between two updates
+	for (int i = 0; i != 10; ++i) {
+		append(history, 10 - i, std::string(1, static_cast<char>('A' + i)));
+	}
+	history.update();
+	REQUIRE(paths(history) == "JIHG");
+	REQUIRE(history.capacity() == 4);
+}
+
+TEST_CASE("EventHistoryUser", "[evtlog][EventHistory]") {
+	// sorted by the name that is shown, not by SID
+	std::size_t calls = 0;
+	evtlog::EventHistory history(8, [&calls](const std::string& sid){
+		++calls;
+		return sid == "S-1-5-21-1" ? std::string("zoe") : (sid == "S-1-5-21-2" ? std::string("adam") : sid);
+	});
+	history.sort(evtlog::EventHistory::column::user, true);
+	auto& e1 = history.append();
+	e1.time = 1;
+	e1.user = "S-1-5-21-1";
+	auto& e2 = history.append();
+	e2.time = 2;
+	e2.user = "S-1-5-21-2";
+	history.update();
+	REQUIRE(calls == 2); // once per event
+	REQUIRE(history.username(0) == "adam");
+	REQUIRE(history.username(1) == "zoe");
+	REQUIRE(history[0].user == "S-1-5-21-2");
+
+	history.sort(evtlog::EventHistory::column::time, true);
+	REQUIRE(history.username(0) == "zoe");
+	auto& e3 = history.append();
+	e3.time = 3;
+	e3.user = "S-1-5-21-3";
+	REQUIRE(history.appendsonly()); // the newest event goes after the others
+	history.update();
+	REQUIRE(history.username(2) == "S-1-5-21-3");
+	REQUIRE(calls == 3);
+}
+
+namespace {
+	struct FakeResolver : evtlog::SidResolver {
+		std::map<std::string, evtlog::account> accounts;
+		std::size_t calls = 0;
+		bool lookup_account(const std::string& sid, evtlog::account& out) override {
+			++calls;
+			const auto it = accounts.find(sid);
+			if (it == accounts.end()) {
+				return false;
+			}
+			out = it->second;
+			return true;
+		}
+		bool lookup_home(const std::string& sid, std::string& out) override {
+			++calls;
+			if (accounts.count(sid) == 0) {
+				return false;
+			}
+			out = "C:\\Users\\" + accounts[sid].first;
+			return true;
+		}
+	};
+}
+
+TEST_CASE("SidCache", "[evtlog][SidCache]") {
+	FakeResolver resolver;
+	resolver.accounts["S-1"] = { "me", "PC" };
+	resolver.accounts["S-2"] = { "you", "PC" };
+	resolver.accounts["S-3"] = { "them", "PC" };
+	auto now = evtlog::SidCache::clock::time_point();
+	evtlog::SidCache cache(resolver, 2, std::chrono::minutes(10), std::chrono::minutes(1), [&]{ return now; });
+
+	REQUIRE(cache.username("S-1") == evtlog::account("me", "PC"));
+	REQUIRE(cache.username("S-1") == evtlog::account("me", "PC"));
+	REQUIRE(resolver.calls == 1);
+	REQUIRE(cache.home("S-1") == "C:\\Users\\me");
+	REQUIRE(cache.home("S-1") == "C:\\Users\\me");
+	REQUIRE(resolver.calls == 2);
+
+	// unknown SIDs are remembered too, for less time
+	REQUIRE(cache.username("S-9").first.empty());
+	REQUIRE(cache.username("S-9").first.empty());
+	REQUIRE(resolver.calls == 3);
+	resolver.accounts["S-9"] = { "new", "PC" };
+	now += std::chrono::seconds(61);
+	REQUIRE(cache.username("S-9").first == "new");
+	REQUIRE(resolver.calls == 4);
+
+	// S-1 is the least recently used
+	REQUIRE(cache.size() == 2);
+	REQUIRE(cache.username("S-2").first == "you");
+	REQUIRE(cache.size() == 2);
+	REQUIRE(resolver.calls == 5);
+	REQUIRE(cache.username("S-9").first == "new");
+	REQUIRE(resolver.calls == 5);
+	REQUIRE(cache.username("S-1").first == "me");
+	REQUIRE(resolver.calls == 6);
+
+	// known users expire after ttl
+	resolver.accounts["S-1"] = { "renamed", "PC" };
+	REQUIRE(cache.username("S-1").first == "me");
+	now += std::chrono::minutes(11);
+	REQUIRE(cache.username("S-1").first == "renamed");
+	REQUIRE(resolver.calls == 7);
+}
+
+TEST_CASE("AggregatorReplay", "[evtlog][Aggregator]") {
+	evtlog::ReplaySource source(test_data_dir + "events866.xml");
+	evtlog::Aggregator aggregator;
+	evtlog::BlockedEvent e;
+	source.run([&](const char* xml, const std::size_t size){
+		REQUIRE(evtlog::parse_event(xml, size, e));
+		aggregator.add(e);
+	});
+	using dimension = evtlog::Aggregator::dimension;
+	REQUIRE(aggregator.total() == 3);
+	REQUIRE(aggregator.estimate(dimension::rule, "{3b8c9c6b-e2a1-4f87-9e6a-2e4b0f4e3d21}") == 2);
+	REQUIRE(aggregator.estimate(dimension::user, "S-1-5-21-13210259-1748602183-1043662369-1001") == 2);
+	REQUIRE(aggregator.estimate(dimension::path, "C:\\Users\\me\\") == 2);
+	REQUIRE(aggregator.estimate(dimension::path, "c:/users/me/appdata") == 1);
+	REQUIRE(aggregator.estimate(dimension::path, "D:") == 1);
+
+	const auto users = aggregator.top(dimension::user, 1);
+	REQUIRE(users.size() == 1);
+	REQUIRE(users[0].key == "S-1-5-21-13210259-1748602183-1043662369-1001");
+	REQUIRE(users[0].count == 2);
+
+	policy::policy_s temp;
+	temp.UUID = "{3B8C9C6B-E2A1-4F87-9E6A-2E4B0F4E3D21}";
+	temp.pol.ItemData = "%TEMP%";
+	policy::policy_s unused;
+	unused.UUID = "{00000000-0000-4000-8000-000000000001}";
+	const auto hits = aggregator.hits({ unused, temp });
+	REQUIRE(hits.size() == 2);
+	REQUIRE(hits[0].rule.pol.ItemData == "%TEMP%");
+	REQUIRE(hits[0].count == 2);
+	REQUIRE(hits[1].count == 0);
+}
+
+TEST_CASE("AggregatorWindow", "[evtlog][Aggregator]") {
+	using dimension = evtlog::Aggregator::dimension;
+	const std::int64_t second = 1000000;
+	evtlog::Aggregator aggregator(second, 10, 256, 4, 4); // 10 seconds
+	evtlog::BlockedEvent e;
+	// 200k events for a few users in the first 10 seconds, in many directories
+	for (std::int64_t i = 0; i != 200000; ++i) {
+		e.time = i * 50;
+		e.user = "S-" + std::to_string(i % 100 < 50 ? 0 : i % 7);
+		e.path = "C:\\dir" + std::to_string(i % 1000) + "\\a.exe";
+		aggregator.add(e);
+	}
+	REQUIRE(aggregator.total() == 200000);
+	REQUIRE(aggregator.estimate(dimension::user, "S-0") >= 100000);
+	REQUIRE(aggregator.estimate(dimension::user, "S-0") < 120000);
+	REQUIRE(aggregator.estimate(dimension::path, "C:") >= 200000); // never less, collisions can only add
+	REQUIRE(aggregator.top(dimension::user, 1).at(0).key == "S-0");
+	REQUIRE(aggregator.top(dimension::path, 100).size() <= 40); // at most topk candidates per bucket
+
+	// at 15 seconds only the events of the seconds 6 to 9 are still in the window
+	e.user = "S-new";
+	e.time = 15 * second;
+	aggregator.add(e);
+	REQUIRE(aggregator.total() == 80001);
+	REQUIRE(aggregator.estimate(dimension::user, "S-new") == 1);
+	// too old, ignored
+	e.time = 2 * second;
+	aggregator.add(e);
+	REQUIRE(aggregator.total() == 80001);
+	// later than the whole window
+	e.time = 100 * second;
+	aggregator.add(e);
+	REQUIRE(aggregator.total() == 1);
+	REQUIRE(aggregator.estimate(dimension::user, "S-0") == 0);
+
+	// no new events, the clock moves past the window
+	aggregator.advance(105 * second);
+	REQUIRE(aggregator.total() == 1);
+	REQUIRE(aggregator.estimate(dimension::user, "S-new") == 1);
+	aggregator.advance(50 * second); // not later, nothing changes
+	REQUIRE(aggregator.total() == 1);
+	aggregator.advance(110 * second);
+	REQUIRE(aggregator.total() == 0);
+	REQUIRE(aggregator.estimate(dimension::user, "S-new") == 0);
+	REQUIRE(aggregator.top(dimension::user, 1).empty());
+	// events older than the current time are still counted if they are in the window
+	e.time = 101 * second;
+	aggregator.add(e);
+	REQUIRE(aggregator.total() == 1);
+	e.time = 100 * second;
+	aggregator.add(e);
+	REQUIRE(aggregator.total() == 1);
+}
+
+namespace {
+	bool same(const evtlog::BlockedEvent& l, const evtlog::BlockedEvent& r) {
+		return l.time == r.time && l.record == r.record && l.user == r.user && l.path == r.path && l.rulepath == r.rulepath && l.rule == r.rule;
+	}
+}
+
+TEST_CASE("JournalReplay", "[evtlog][Journal]") {
+	const std::string filename = "soup_test.journal";
+	std::remove(filename.c_str());
+	std::vector<evtlog::BlockedEvent> events;
+	evtlog::ReplaySource source(test_data_dir + "events866.xml");
+	{
+		evtlog::Journal journal(filename, 2);
+		REQUIRE(journal.bookmark() == 0);
+		source.run([&](const char* xml, const std::size_t size){
+			evtlog::BlockedEvent e;
+			REQUIRE(evtlog::parse_event(xml, size, e));
+			REQUIRE(journal.append(e));
+			events.push_back(e);
+		});
+		REQUIRE(journal.blocks() == 1);
+		REQUIRE(journal.bookmark() == 4162);
+		REQUIRE(journal.query(0, INT64_MAX).size() == 3); // with the pending event
+	}
+	{
+		// after a restart the same events are not added again
+		evtlog::Journal journal(filename, 2);
+		REQUIRE(journal.blocks() == 2);
+		REQUIRE(journal.size() == 3);
+		REQUIRE(journal.bookmark() == 4163);
+		evtlog::BlockedEvent e;
+		std::size_t added = 0;
+		source.run([&](const char* xml, const std::size_t size){
+			REQUIRE(evtlog::parse_event(xml, size, e));
+			added += journal.append(e);
+		});
+		REQUIRE(added == 0);
+
+		const auto all = journal.query(0, INT64_MAX);
+		REQUIRE(all.size() == 3);
+		for (std::size_t i = 0; i != all.size(); ++i) {
+			REQUIRE(same(all[i], events[i]));
+		}
+		REQUIRE(journal.blocksread() == 2);
+
+		const auto temp = journal.query(0, INT64_MAX, events[0].rule);
+		REQUIRE(temp.size() == 2);
+		REQUIRE(same(temp[1], events[2]));
+		const auto pdf = journal.query(0, INT64_MAX, events[1].rule);
+		REQUIRE(pdf.size() == 1);
+		REQUIRE(journal.blocksread() == 1); // the second block does not have the rule
+		REQUIRE(journal.query(events[1].time, events[2].time).size() == 1);
+		REQUIRE(journal.query(events[2].time + 1, INT64_MAX).empty());
+		REQUIRE(journal.blocksread() == 0);
+	}
+	std::remove(filename.c_str());
+}
+
+TEST_CASE("JournalCorrupted", "[evtlog][Journal]") {
+	const std::string filename = "soup_test.journal";
+	std::remove(filename.c_str());
+	{
+		evtlog::Journal journal(filename, 1);
+		evtlog::BlockedEvent e;
+		e.record = 1;
+		e.path = "p";
+		REQUIRE(journal.append(e));
+	}
+	std::string data;
+	{
+		std::ifstream in(filename, std::ios::binary);
+		data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	// payload: one string (""), no rules, then time, record, user, rulepath, ...
+	const std::size_t headersize = 72;
+	REQUIRE(data.size() == headersize + 11);
+	REQUIRE(data[headersize + 5] == 0);
+	data[headersize + 5] = 1; // user after the end of the string table
+	std::uint32_t h = 2166136261u; // the checksum of the payload is still valid
+	for (std::size_t i = headersize; i != data.size(); ++i) {
+		h ^= static_cast<unsigned char>(data[i]);
+		h *= 16777619u;
+	}
+	for (std::size_t i = 0; i != 4; ++i) {
+		data[12 + i] = static_cast<char>((h >> (8 * i)) & 0xFF);
+	}
+	{
+		std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+		out.write(data.data(), static_cast<std::streamsize>(data.size()));
+	}
+	evtlog::Journal journal(filename, 1);
+	REQUIRE(journal.size() == 1);
+	REQUIRE_THROWS_AS(journal.query(0, INT64_MAX), std::runtime_error);
+}
+
+TEST_CASE("JournalReset", "[evtlog][Journal]") {
+	const std::string filename = "soup_test.journal";
+	std::remove(filename.c_str());
+	evtlog::BlockedEvent e;
+	e.path = "p";
+	{
+		evtlog::Journal journal(filename, 2);
+		for (const std::uint64_t record : { 5, 6, 7, 1, 2 }) { // the channel has been cleared after 7
+			e.record = record;
+			++e.time;
+			REQUIRE(journal.append(e));
+		}
+		REQUIRE(!journal.append(e)); // the same event again
+		journal.flush();
+		REQUIRE(journal.size() == 5);
+		REQUIRE(journal.bookmark() == 2);
+	}
+	{
+		// cleared while not running
+		evtlog::Journal journal(filename, 2);
+		REQUIRE(journal.size() == 5);
+		REQUIRE(journal.bookmark() == 2);
+		REQUIRE(!journal.append(e)); // already on disk
+		e.record = 1;
+		++e.time;
+		REQUIRE(journal.append(e));
+		journal.flush();
+		REQUIRE(journal.bookmark() == 1);
+		const auto all = journal.query(0, INT64_MAX);
+		REQUIRE(all.size() == 6);
+		REQUIRE(all.back().record == 1);
+	}
+	std::remove(filename.c_str());
+}
+
+TEST_CASE("JournalRange", "[evtlog][Journal]") {
+	const std::string filename = "soup_test.journal";
+	std::remove(filename.c_str());
+	const std::int64_t hour = 3600LL * 1000000;
+	const auto rule = uid::BinaryUUID::from_string("{3B8C9C6B-E2A1-4F87-9E6A-2E4B0F4E3D21}");
+	std::size_t rawsize = 0;
+	{
+		evtlog::Journal journal(filename, 256);
+		evtlog::BlockedEvent e;
+		e.user = "S-1-5-21-13210259-1748602183-1043662369-1001";
+		e.rulepath = "%TEMP%";
+		std::size_t added = 0;
+		for (std::uint64_t i = 0; i != 10000; ++i) { // 48 hours
+			e.time = static_cast<std::int64_t>(i) * 48 * hour / 10000;
+			e.record = i + 1;
+			e.path = "C:\\Users\\me\\AppData\\Local\\Temp\\setup" + std::to_string(i % 100) + ".exe";
+			e.rule = i % 10 == 0 ? rule : uid::BinaryUUID();
+			added += journal.append(e);
+			rawsize += sizeof(e.time) + sizeof(e.record) + e.user.size() + e.path.size() + e.rulepath.size() + 16;
+		}
+		REQUIRE(added == 10000);
+	}
+	{
+		std::ifstream in(filename, std::ios::binary | std::ios::ate);
+		REQUIRE(static_cast<std::size_t>(in.tellg()) * 5 < rawsize);
+	}
+	{
+		evtlog::Journal journal(filename, 256);
+		REQUIRE(journal.size() == 10000);
+		const auto last24h = journal.query(24 * hour, 48 * hour, rule);
+		REQUIRE(last24h.size() == 500);
+		REQUIRE(journal.blocksread() <= journal.blocks() / 2 + 1);
+	}
+
+	// a block written only partially (crash while writing) is ignored and overwritten
+	{
+		std::ofstream out(filename, std::ios::binary | std::ios::app);
+		out << "SUJ1 incomplete block";
+	}
+	{
+		evtlog::Journal journal(filename, 256);
+		REQUIRE(journal.size() == 10000);
+		evtlog::BlockedEvent e;
+		e.record = 10001;
+		e.time = 49 * hour;
+		e.rule = rule;
+		REQUIRE(journal.append(e));
+	}
+	{
+		evtlog::Journal journal(filename, 256);
+		REQUIRE(journal.size() == 10001);
+		REQUIRE(journal.bookmark() == 10001);
+		REQUIRE(journal.query(48 * hour, 50 * hour, rule).size() == 1);
+	}
+	std::remove(filename.c_str());
+
+	REQUIRE(evtlog::bookmark_xml("Application", 4163) == "<BookmarkList><Bookmark Channel='Application' RecordId='4163' IsCurrent='true'/></BookmarkList>");
+}
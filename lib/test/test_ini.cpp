@@ -15,3 +15,153 @@
 	along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+// local
+#include "settings.hpp"
+#include "../IniParser.hpp"
+#include "../initokenizer.hpp"
+#include "../policy.hpp"
+
+// test
+#include "catch.hpp"
+
+//std
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <iostream>
+#include <cstdio>
+#include <functional>
+
+TEST_CASE("MappedIniParser", "[ini][mapped]") {
+	const iniparser::MappedIniParser parser(test_data_dir + "mapped.ini");
+
+	REQUIRE(parser.sections().size() == 4);
+	REQUIRE(parser.sections().at(0).name == ""); // sorted
+	REQUIRE(parser.HasSection("empty"));
+	REQUIRE(parser.sections().at(2).count == 0);
+	REQUIRE(parser.GetValue("", "unnamed") == "1");
+
+	REQUIRE(parser.GetValue("section b", "key") == "value with spaces"); // first occurrence wins
+	REQUIRE(parser.GetValue("section b", "quoted") == "  C:\\path  ");
+	REQUIRE(!parser.HasProperty("section b", "ignored"));
+	REQUIRE(parser.GetValue("section b", "after") == "2");
+
+	REQUIRE(parser.GetValue("a", "x") == "1"); // sections with the same name are merged
+	REQUIRE(parser.GetValue("a", "y") == "2");
+	REQUIRE(parser.GetValue("a", "z", "default") == "default");
+	REQUIRE_THROWS(parser.GetValue("a", "z"));
+	REQUIRE_THROWS(parser.GetValue("missing", "x"));
+}
+
+TEST_CASE("MappedIniParserCompare", "[ini][mapped]") {
+	// without spaces inside values, both parsers give the same result
+	const iniparser::IniParser parser(test_data_dir + "policy1.ini");
+	const iniparser::MappedIniParser mapped(test_data_dir + "policy1.ini");
+	REQUIRE(parser.content.size() == mapped.sections().size());
+	for (const auto& s : mapped.sections()) {
+		const auto& section = parser.content.at(s.name.to_string());
+		REQUIRE(section.size() == s.count);
+		for (auto i = s.first; i != s.first + s.count; ++i) {
+			const auto& e = mapped.entries().at(i);
+			const auto value = section.at(e.property.to_string());
+			if (value.find(' ') == std::string::npos && e.value.to_string().find(' ') == std::string::npos) {
+				REQUIRE(value == e.value.to_string());
+			}
+		}
+	}
+}
+
+TEST_CASE("loadrulesfrominiSpaces", "[ini][mapped][policy]") {
+	// only leading and trailing spaces are removed, spaces inside values are kept
+	const std::string filename = "soup_spaces.ini";
+	{
+		std::ofstream out(filename);
+		out << "[ policy with spaces ]\n";
+		out << "Description = blocks my app ; comment\n";
+		out << "Security =  Disallowed \n";
+		out << "Rule0 = C:\\Program Files\\My App\\app.exe\n";
+		out << "Rule1 = \"  C:\\quoted path  \"\n";
+		out << "Description1 = second rule\n";
+		out << "[double ext]\n";
+		out << "ext1 = doc , my ext\n";
+		out << "ext2 = exe\n";
+	}
+	const auto res = policy::loadrulesfromini(filename);
+	std::remove(filename.c_str());
+	REQUIRE(res.policies.size() == 1);
+	const auto& pols = res.policies.at(0);
+	REQUIRE(pols.size() == 2);
+	REQUIRE(pols.at(0).pol.name == "policy with spaces");
+	REQUIRE(pols.at(0).pol.ItemData == "C:\\Program Files\\My App\\app.exe");
+	REQUIRE(pols.at(0).pol.Description == "blocks my app");
+	REQUIRE(pols.at(0).sec == policy::securitylevel::Disallowed);
+	REQUIRE(pols.at(1).pol.ItemData == "  C:\\quoted path  ");
+	REQUIRE(pols.at(1).pol.Description == "second rule");
+
+	REQUIRE(res.doubleextpol.size() == 1);
+	REQUIRE(res.doubleextpol.at(0).name == "double ext");
+	REQUIRE(res.doubleextpol.at(0).ext1 == (std::vector<std::string>{ "doc", "my ext" }));
+}
+
+TEST_CASE("IniTokenizer", "[ini][tokenizer]") {
+	std::string buffer;
+	for (int i = 0; i != 200; ++i) { // different lengths and positions of the tokens, for testing the tail of the simd loops
+		buffer += "[s" + std::to_string(i) + "]\nk" + std::string(static_cast<std::size_t>(i % 37), ' ') + "=\"v\" ; c # // /* */\r\n";
+	}
+	std::vector<std::size_t> expected;
+	for (std::size_t i = 0; i != buffer.size(); ++i) {
+		if (std::string("\n=[]\";#/").find(buffer[i]) != std::string::npos) {
+			expected.push_back(i);
+		}
+	}
+	for (const auto level : { iniparser::simdlevel::scalar, iniparser::simdlevel::sse2, iniparser::simdlevel::avx2 }) {
+		for (std::size_t offset = 0; offset != 40; ++offset) { // unaligned buffers and all sizes of the remainder
+			std::vector<std::size_t> tokens;
+			iniparser::tokenize(buffer.data() + offset, buffer.size() - offset, tokens, level);
+			std::vector<std::size_t> exp;
+			for (const auto v : expected) {
+				if (v >= offset) {
+					exp.push_back(v - offset);
+				}
+			}
+			REQUIRE(tokens == exp);
+		}
+	}
+}
+
+TEST_CASE("IniParserBenchmark", "[ini][benchmark][.]") {
+	const std::string filename = "soup_benchmark.ini";
+	{
+		std::ofstream out(filename);
+		for (int i = 0; i != 20000; ++i) {
+			out << "[policy" << i << "]\n";
+			out << "Description=generated policy " << i << " ; comment\n";
+			out << "Security=Disallowed\n";
+			for (int j = 0; j != 10; ++j) {
+				out << "Rule" << j << "=\"C:\\some\\path" << i << "\\*.ext" << j << ".exe\"\n";
+			}
+			out << "\n";
+		}
+	}
+	const auto time = [](const char* desc, const std::function<void()>& f) {
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		const auto end = std::chrono::steady_clock::now();
+		std::cout << desc << ": " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms\n";
+	};
+	time("IniParser", [&filename] { const iniparser::IniParser parser(filename); REQUIRE(parser.content.size() == 20000); });
+	time("MappedIniParser", [&filename] { const iniparser::MappedIniParser parser(filename); REQUIRE(parser.sections().size() == 20000); });
+	time("loadrulesfromini", [&filename] { REQUIRE(policy::loadrulesfromini(filename).policies.size() == 20000); });
+	{
+		const MappedFile file(filename);
+		for (const auto level : { iniparser::simdlevel::scalar, iniparser::simdlevel::sse2, iniparser::simdlevel::avx2 }) {
+			std::vector<std::size_t> tokens;
+			tokens.reserve(file.size() / 8);
+			time(level == iniparser::simdlevel::scalar ? "tokenize scalar" : (level == iniparser::simdlevel::sse2 ? "tokenize sse2" : "tokenize avx2"), [&] {
+				iniparser::tokenize(file.data(), file.size(), tokens, level);
+			});
+		}
+	}
+	std::remove(filename.c_str());
+}
@@ -18,17 +18,23 @@
 // local
 #include "settings.hpp"
 #include "../policy.hpp"
+#include "../policydiff.hpp"
+#include "../ruletable.hpp"
+#include "../uuid.hpp"
+#include "../memoryhive.hpp"
 
 // test
 #include "catch.hpp"
 
-// windows
-#include <Windows.h>
-
 //std
 #include <string>
 #include <vector>
 #include <regex>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <cctype>
 
 TEST_CASE("TestPolicyDoubleExt", "[policy][DoubleExt][hide]") {
 	const auto doubleext = combineext(policy::CommonExtensions(), policy::ExecutableExtensions());
@@ -125,3 +131,450 @@ TEST_CASE("loadini2", "[policy][ini][invalid]") {
 	REQUIRE(res.doubleextpol.size() == 0);
 	REQUIRE(res.settings.size() == 0);
 }
+
+TEST_CASE("PolicyManagerMemoryHive", "[policy][MemoryHive]") {
+	registry::MemoryHive hive;
+	registry::ScopedBackend backend(hive);
+	{
+		policy::PolicyManager manager;
+		REQUIRE(manager.SetPolicyDisableInsecureLocations(policy::UnsecureLocations(), policy::ExecutableExtensions()));
+		REQUIRE(manager.getSecurityLevel() == policy::securitylevel::Unrestricted);
+		REQUIRE(manager.getEnforcementLevel() == policy::enforcementLevel::SkipDLLs);
+		REQUIRE(policy::getLoadedRules(HKEY_LOCAL_MACHINE).empty()); // not applied yet
+		REQUIRE(manager.Apply());
+	}
+	auto rules = policy::getLoadedRules(HKEY_LOCAL_MACHINE);
+	REQUIRE(rules.size() == policy::UnsecureLocations().size());
+	for (const auto& v : rules) {
+		REQUIRE(v.sec == policy::securitylevel::Disallowed);
+		REQUIRE(v.pol.name == "DisableInsecureLocations");
+	}
+	{
+		policy::PolicyManager manager;
+		REQUIRE(manager.RemovePolicy(rules.at(0).sec, rules.at(0).UUID));
+		REQUIRE(manager.Apply());
+	}
+	REQUIRE(policy::getLoadedRules(HKEY_LOCAL_MACHINE).size() == rules.size() - 1);
+	REQUIRE(hive.OpenHandles() == 0);
+}
+
+namespace {
+	std::vector<policy::policy_s> make_policies(const std::size_t count, const std::size_t names) {
+		std::vector<policy::policy_s> pols(count);
+		for (std::size_t i = 0; i != count; ++i) {
+			pols[i].pol.name = (i % 10 == 0) ? "" : "name" + std::to_string(i % names);
+			pols[i].pol.ItemData = "*.ext" + std::to_string(i) + ".exe";
+			pols[i].UUID = std::to_string(i);
+		}
+		return pols;
+	}
+}
+
+TEST_CASE("groupbyname", "[policy][groupbyname]") {
+	const auto pols = make_policies(100, 3);
+	const auto grouped = policy::groupbyname(pols);
+	REQUIRE(grouped.size() == 10 + 3); // every policy without name is a group
+	REQUIRE(grouped.at(0).size() == 1);
+	REQUIRE(grouped.at(0).at(0).UUID == "0");
+	REQUIRE(grouped.at(1).at(0).pol.name == "name1");
+	std::size_t total = 0;
+	for (const auto& v : grouped) {
+		REQUIRE(!v.empty());
+		total += v.size();
+		for (std::size_t i = 1; i < v.size(); ++i) { // same name, and original order
+			REQUIRE(v.at(i).pol.name == v.at(0).pol.name);
+			REQUIRE(std::stoul(v.at(i - 1).UUID) < std::stoul(v.at(i).UUID));
+		}
+	}
+	REQUIRE(total == pols.size());
+
+	const auto groupedempty = policy::groupbyname(pols, true);
+	REQUIRE(groupedempty.size() == 1 + 3);
+	REQUIRE(groupedempty.at(0).size() == 10);
+}
+
+TEST_CASE("groupbynameBenchmark", "[policy][groupbyname][benchmark][.]") {
+	for (const std::size_t count : { 1000, 10000, 100000 }) {
+		auto pols = make_policies(count, count / 10);
+		const auto start = std::chrono::steady_clock::now();
+		const auto grouped = policy::groupbyname(std::move(pols));
+		const auto end = std::chrono::steady_clock::now();
+		REQUIRE(!grouped.empty());
+		std::cout << "groupbyname, " << count << " rules: " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << " us\n";
+	}
+}
+
+TEST_CASE("getdoubleext", "[policy][DoubleExt]") {
+	const std::regex r1("^\\*\\.([^.]+)\\.([^.]+)$");
+	const std::vector<std::string> itemdata = {
+		"*.doc.exe", "*.doc?.com", "*.?htm?.diagcab", "*.?htm?_diagcab", "*.?htm?.diagcab.blabla",
+		" *.?htm?.diagcab", "_.?htm?.diagcab", "*..exe", "*.doc.", "*.a.b", "*.", "",
+	};
+	for (const auto& v : itemdata) {
+		std::string ext1;
+		std::string ext2;
+		std::smatch sm;
+		const bool match = std::regex_match(v, sm, r1);
+		REQUIRE(policy::splitdoubleext(v, ext1, ext2) == match);
+		if (match) {
+			REQUIRE(ext1 == sm[1]);
+			REQUIRE(ext2 == sm[2]);
+		}
+	}
+
+	std::vector<policy::policy_s> pols;
+	for (const auto& v : combineext({ "doc", "pdf" }, { "exe", "com" })) {
+		policy::policy_s p;
+		p.pol.name = "double";
+		p.pol.ItemData = v;
+		p.sec = policy::securitylevel::Disallowed;
+		p.hk = HKEY_LOCAL_MACHINE;
+		pols.push_back(p);
+	}
+	const auto d = policy::getdoubleext(pols);
+	REQUIRE(d.ext1 == std::vector<std::string>({ "doc", "pdf" }));
+	REQUIRE(d.ext2 == std::vector<std::string>({ "exe", "com" }));
+
+	policy::policy_s other;
+	other.pol.name = "other";
+	other.pol.ItemData = "C:\\Windows";
+	std::vector<std::vector<policy::policy_s>> grouped = { { other }, pols, { other } };
+	const auto removed = policy::removedoubleext(grouped);
+	REQUIRE(removed.size() == 1);
+	REQUIRE(grouped.size() == 2);
+	REQUIRE(grouped.at(1).at(0).pol.name == "other");
+}
+
+TEST_CASE("loadrulesfromfiles", "[policy][ini]") {
+	const std::vector<std::string> files(16, test_data_dir + "/policy1.ini");
+	const auto single = policy::loadrulesfromini(files.at(0));
+	for (const unsigned int threads : { 1u, 4u, 0u }) {
+		const auto res = policy::loadrulesfromfiles(files, threads);
+		REQUIRE(res.policies.size() == files.size() * single.policies.size());
+		REQUIRE(res.doubleextpol.size() == files.size() * single.doubleextpol.size());
+		REQUIRE(res.settings.size() == files.size() * single.settings.size());
+		for (std::size_t i = 0; i != res.policies.size(); ++i) { // same order of the files
+			REQUIRE(res.policies.at(i).at(0).pol.name == single.policies.at(i % single.policies.size()).at(0).pol.name);
+		}
+	}
+	REQUIRE(policy::loadrulesfromfiles({}).policies.empty());
+
+	auto withmissing = files;
+	withmissing.at(7) = test_data_dir + "/does_not_exist.ini";
+	REQUIRE_THROWS(policy::loadrulesfromfiles(withmissing, 4));
+}
+
+TEST_CASE("PolicyDiff", "[policy][PolicyDiff][MemoryHive]") {
+	registry::MemoryHive hive;
+	registry::ScopedBackend backend(hive);
+	{
+		policy::PolicyManager manager;
+		REQUIRE(manager.SetPolicyDisableInsecureLocations(policy::UnsecureLocations(), policy::ExecutableExtensions()));
+		REQUIRE(manager.SetPolicyDisableBiDiFiles());
+		REQUIRE(manager.Apply());
+	}
+	auto installed = policy::getLoadedRules(HKEY_LOCAL_MACHINE);
+	policy::PolicyDiff index(installed);
+	REQUIRE(index.size() == installed.size());
+
+	std::vector<policy::policy_s> group;
+	std::copy_if(installed.begin(), installed.end(), std::back_inserter(group), [](const policy::policy_s& p) { return p.pol.name == "DisableInsecureLocations"; });
+	REQUIRE(group.size() >= 3);
+	REQUIRE(index.group("DisableInsecureLocations").size() == group.size());
+	REQUIRE(index.diff(group, "DisableInsecureLocations").empty());
+
+	// uuids are case insensitive, and rules without uuid are found by ItemData
+	auto wanted = group;
+	for (auto& c : wanted.at(0).UUID) {
+		c = static_cast<char>(std::tolower(c));
+	}
+	wanted.at(1).UUID.clear();
+	REQUIRE(index.diff(wanted, "DisableInsecureLocations").empty());
+
+	wanted = group;
+	const auto removed = wanted.back();
+	wanted.pop_back();
+	wanted.at(0).pol.Description = "changed";
+	wanted.at(1).sec = policy::securitylevel::Unrestricted;
+	policy::policy_s added;
+	added.pol.name = "DisableInsecureLocations";
+	added.pol.ItemData = "C:\\new";
+	added.sec = policy::securitylevel::Disallowed;
+	added.hk = HKEY_LOCAL_MACHINE;
+	wanted.push_back(added);
+
+	const auto plan = index.diff(wanted, "DisableInsecureLocations");
+	REQUIRE(plan.toremove.size() == 1);
+	REQUIRE(plan.toremove.at(0).UUID == removed.UUID);
+	REQUIRE(plan.tomodify.size() == 2);
+	REQUIRE(plan.toadd.size() == 1);
+	REQUIRE(!plan.toadd.at(0).UUID.empty());
+	{
+		policy::PolicyManager manager;
+		REQUIRE(manager.Execute(plan));
+		REQUIRE(manager.Apply());
+	}
+	index.update(plan);
+
+	// the index is in sync with the registry
+	const auto reloaded = policy::getLoadedRules(HKEY_LOCAL_MACHINE);
+	REQUIRE(reloaded.size() == installed.size());
+	REQUIRE(index.size() == reloaded.size());
+	policy::policy_s p;
+	for (const auto& v : reloaded) {
+		REQUIRE(index.find(v.UUID, p));
+		REQUIRE(policy::samerule(p, v));
+	}
+	REQUIRE(!index.find(removed.UUID, p));
+	REQUIRE(index.find(wanted.at(1).UUID, p));
+	REQUIRE(p.sec == policy::securitylevel::Unrestricted);
+	REQUIRE(index.diff(wanted, "DisableInsecureLocations").toremove.empty());
+	const auto updatedgroup = index.group("DisableInsecureLocations");
+	REQUIRE(updatedgroup.size() == wanted.size());
+	REQUIRE(std::none_of(updatedgroup.begin(), updatedgroup.end(), [&removed](const policy::policy_s& v) { return v.UUID == removed.UUID; }));
+	REQUIRE(index.group("does not exist").empty());
+	REQUIRE(hive.OpenHandles() == 0);
+}
+
+TEST_CASE("getLoadedRule", "[policy][MemoryHive]") {
+	registry::MemoryHive hive;
+	registry::ScopedBackend backend(hive);
+	{
+		policy::PolicyManager manager;
+		REQUIRE(manager.SetPolicyDisableInsecureLocations(policy::UnsecureLocations(), policy::ExecutableExtensions()));
+		REQUIRE(manager.SetPolicyEnableOnlySecureLocations(policy::SecureLocations(), policy::ExecutableExtensions()));
+		REQUIRE(manager.Apply());
+	}
+	const auto rules = policy::getLoadedRules(HKEY_LOCAL_MACHINE);
+	REQUIRE(std::any_of(rules.begin(), rules.end(), [](const policy::policy_s& p) { return p.sec == policy::securitylevel::Unrestricted; }));
+	for (const auto& v : rules) {
+		policy::policy_s p;
+		REQUIRE(policy::getLoadedRule(HKEY_LOCAL_MACHINE, v.UUID, p));
+		REQUIRE(policy::samerule(p, v));
+		REQUIRE(p.UUID == v.UUID);
+	}
+	policy::policy_s p;
+	REQUIRE(!policy::getLoadedRule(HKEY_LOCAL_MACHINE, "{00000000-0000-0000-0000-000000000000}", p));
+	REQUIRE(!policy::getLoadedRule(HKEY_LOCAL_MACHINE, "", p));
+	REQUIRE(!policy::getLoadedRule(HKEY_LOCAL_MACHINE, "..\\..", p));
+	REQUIRE(hive.OpenHandles() == 0);
+}
+
+TEST_CASE("PolicyDiffUUIDFirst", "[policy][PolicyDiff][MemoryHive]") {
+	registry::MemoryHive hive;
+	registry::ScopedBackend backend(hive);
+	{
+		policy::PolicyManager manager;
+		REQUIRE(manager.SetPolicyDisableInsecureLocations(policy::UnsecureLocations(), policy::ExecutableExtensions()));
+		REQUIRE(manager.Apply());
+	}
+	const auto installed = policy::getLoadedRules(HKEY_LOCAL_MACHINE);
+	const policy::PolicyDiff index(installed);
+	std::vector<policy::policy_s> group;
+	std::copy_if(installed.begin(), installed.end(), std::back_inserter(group), [](const policy::policy_s& p) { return p.pol.name == "DisableInsecureLocations"; });
+	REQUIRE(group.size() >= 2);
+
+	// a copy without UUID comes before the rule with the UUID, it must not take the UUID of the installed rule
+	auto wanted = group;
+	auto copy = group.at(0);
+	copy.UUID.clear();
+	wanted.insert(wanted.begin(), copy);
+	const auto plan = index.diff(wanted, "DisableInsecureLocations");
+	REQUIRE(plan.toremove.empty());
+	REQUIRE(plan.tomodify.empty());
+	REQUIRE(plan.toadd.size() == 1);
+	REQUIRE(!plan.toadd.at(0).UUID.empty());
+	REQUIRE(plan.toadd.at(0).UUID != group.at(0).UUID);
+	{
+		policy::PolicyManager manager;
+		REQUIRE(manager.Execute(plan));
+		REQUIRE(manager.Apply());
+	}
+	REQUIRE(policy::getLoadedRules(HKEY_LOCAL_MACHINE).size() == installed.size() + 1);
+
+	// the same UUID twice, also with a different case
+	wanted = group;
+	wanted.push_back(group.at(1));
+	for (auto& c : wanted.back().UUID) {
+		c = static_cast<char>(std::tolower(c));
+	}
+	REQUIRE_THROWS_AS(index.diff(wanted, "DisableInsecureLocations"), std::runtime_error);
+	REQUIRE(hive.OpenHandles() == 0);
+}
+
+TEST_CASE("SetPolicies", "[policy][SetPolicies][MemoryHive]") {
+	registry::MemoryHive hive;
+	registry::ScopedBackend backend(hive);
+	const auto doubleext = combineext(policy::CommonExtensions(), policy::ExecutableExtensions());
+	std::vector<policy::policy_s> rules(doubleext.size());
+	for (std::size_t i = 0; i != rules.size(); ++i) {
+		rules[i].pol.name = "doubleext";
+		rules[i].pol.Description = u8"ä description";
+		rules[i].pol.ItemData = doubleext[i];
+		rules[i].sec = (i % 2 == 0) ? policy::securitylevel::Disallowed : policy::securitylevel::Unrestricted;
+		if (i % 3 == 0) {
+			rules[i].UUID = uid::to_string(uid::createUUID());
+		}
+	}
+	{
+		policy::PolicyManager manager;
+		REQUIRE(manager.SetPolicies(rules));
+		// not applied, the transaction is rolled back
+	}
+	REQUIRE(policy::getLoadedRules(HKEY_LOCAL_MACHINE).empty());
+	{
+		policy::PolicyManager manager;
+		REQUIRE(manager.SetPolicies(rules));
+		REQUIRE(manager.Apply());
+	}
+	const policy::PolicyDiff installed(policy::getLoadedRuleTable(HKEY_LOCAL_MACHINE));
+	REQUIRE(installed.size() == rules.size());
+	const auto plan = installed.diff(rules, "doubleext");
+	REQUIRE(plan.empty());
+	policy::policy_s p;
+	REQUIRE(installed.find(rules.at(3).UUID, p));
+	REQUIRE(p.sec == policy::securitylevel::Unrestricted);
+	REQUIRE(hive.OpenHandles() == 0);
+}
+
+TEST_CASE("SetPolicyDisableDoubleExtGenerator", "[policy][DoubleExt][MemoryHive]") {
+	registry::MemoryHive hive;
+	registry::ScopedBackend backend(hive);
+	const auto ext1 = policy::CommonExtensions();
+	const auto ext2 = policy::ExecutableExtensions();
+	{
+		policy::PolicyManager manager;
+		REQUIRE(manager.SetPolicyDisableDoubleExt(ext1, ext2));
+		REQUIRE(manager.Apply());
+	}
+	auto grouped = policy::groupbyname(policy::getLoadedRules(HKEY_LOCAL_MACHINE), true);
+	REQUIRE(grouped.size() == 1);
+	REQUIRE(grouped.at(0).size() == ext1.size() * ext2.size());
+	const auto doubleext = policy::removedoubleext(grouped);
+	REQUIRE(doubleext.size() == 1);
+	REQUIRE(doubleext.at(0).ext1.size() == uniquify(ext1).size());
+	REQUIRE(doubleext.at(0).ext2.size() == uniquify(ext2).size());
+	REQUIRE(doubleext.at(0).sec == policy::securitylevel::Disallowed);
+	REQUIRE(hive.OpenHandles() == 0);
+}
+
+TEST_CASE("Atom", "[policy][Atom]") {
+	const policy::Atom a1 = std::string("WinSec, disable double extensions");
+	const policy::Atom a2("WinSec, disable double extensions");
+	const policy::Atom other("other");
+	REQUIRE(a1 == a2);
+	REQUIRE(&a1.str() == &a2.str()); // stored once
+	REQUIRE(a1 != other);
+	REQUIRE(a1 == "WinSec, disable double extensions");
+	REQUIRE(std::string("other") == other);
+	REQUIRE((a1 < other) == (a1.str() < other.str()));
+	REQUIRE(!(a1 < a2));
+	REQUIRE(std::hash<policy::Atom>()(a1) == std::hash<policy::Atom>()(a2));
+
+	const policy::Atom empty;
+	REQUIRE(empty.empty());
+	REQUIRE(empty == policy::Atom(""));
+	REQUIRE(empty == std::string());
+
+	// can be used like a std::string
+	const std::string s = "[" + other + "] " + a1 + std::string(" | ") + other;
+	REQUIRE(s == "[other] WinSec, disable double extensions | other");
+	std::string appended = "name: ";
+	appended += other;
+	REQUIRE(appended == "name: other");
+	const std::string& ref = other;
+	REQUIRE(ref == "other");
+
+	// rules of a group share name and description
+	policy::policy_s p1;
+	p1.pol.name = "name";
+	policy::policy_s p2;
+	p2.pol.name = std::string("na") + "me";
+	REQUIRE(p1.pol.name == p2.pol.name);
+	REQUIRE(&p1.pol.name.str() == &p2.pol.name.str());
+}
+
+TEST_CASE("RuleTable", "[policy][RuleTable]") {
+	auto pols = make_policies(200, 7);
+	for (std::size_t i = 0; i != pols.size(); ++i) {
+		pols[i].sec = (i % 3 == 0) ? policy::securitylevel::Disallowed : policy::securitylevel::Unrestricted;
+		pols[i].pol.Description = (i % 2 == 0) ? "even" : "odd";
+		pols[i].UUID = std::to_string(i % 50); // duplicate UUIDs, so that the other columns are compared too
+	}
+	const policy::RuleTable table(pols);
+	REQUIRE(table.size() == pols.size());
+	REQUIRE(table.itemdata(5) == pols[5].pol.ItemData);
+	REQUIRE(table.name(5) == pols[5].pol.name);
+
+	const auto roundtrip = table.to_vector();
+	REQUIRE(roundtrip.size() == pols.size());
+	for (std::size_t i = 0; i != pols.size(); ++i) {
+		REQUIRE(policy::samerule(roundtrip[i], pols[i]));
+		REQUIRE(roundtrip[i].UUID == pols[i].UUID);
+	}
+
+	// same order of the vector based functions
+	auto sorted = pols;
+	std::sort(sorted.begin(), sorted.end(), policy::Compare_policy_s());
+	const auto view = table.to_vector(table.sorted());
+	for (std::size_t i = 0; i != pols.size(); ++i) {
+		REQUIRE(view[i].UUID == sorted[i].UUID);
+		REQUIRE(policy::samerule(view[i], sorted[i]));
+	}
+	const auto byrule = table.to_vector(table.sortedbyrule());
+	REQUIRE(std::is_sorted(byrule.begin(), byrule.end(), policy::CompareByRule()));
+
+	const auto groups = table.groupbyname();
+	const auto expected = policy::groupbyname(pols);
+	REQUIRE(groups.size() == expected.size());
+	for (std::size_t g = 0; g != groups.size(); ++g) {
+		REQUIRE(groups[g].size() == expected[g].size());
+		for (std::size_t i = 0; i != groups[g].size(); ++i) {
+			REQUIRE(table.itemdata(groups[g][i]) == expected[g][i].pol.ItemData);
+		}
+	}
+	REQUIRE(table.groupbyname(true).size() == policy::groupbyname(pols, true).size());
+
+	// diff, like the two set_difference passes on sorted vectors
+	auto wanted = pols;
+	wanted.erase(wanted.begin(), wanted.begin() + 10);
+	wanted.at(0).pol.Description = "changed";
+	wanted.push_back(pols.at(0));
+	wanted.back().UUID = "new";
+	const auto d = policy::RuleTable(wanted).diff(table);
+	REQUIRE(d.toadd.size() == 2);
+	REQUIRE(d.toremove.size() == 11);
+	REQUIRE(policy::RuleTable(pols).diff(table).toadd.empty());
+	REQUIRE(policy::RuleTable().diff(table).toremove.size() == table.size());
+}
+
+TEST_CASE("RuleTableLoaded", "[policy][RuleTable][MemoryHive]") {
+	registry::MemoryHive hive;
+	registry::ScopedBackend backend(hive);
+	{
+		policy::PolicyManager manager;
+		REQUIRE(manager.SetPolicyDisableDoubleExt(policy::CommonExtensions(), policy::ExecutableExtensions()));
+		REQUIRE(manager.SetPolicyDisableInsecureLocations(policy::UnsecureLocations(), policy::ExecutableExtensions()));
+		REQUIRE(manager.Apply());
+	}
+	// load -> group -> double-ext on the table gives the same result of the vector based functions
+	const auto table = policy::getLoadedRuleTable(HKEY_LOCAL_MACHINE);
+	auto pols = policy::getLoadedRules(HKEY_LOCAL_MACHINE);
+	REQUIRE(table.size() == pols.size());
+	for (std::size_t i = 0; i != pols.size(); ++i) {
+		REQUIRE(table.samerule(i, pols[i]));
+		REQUIRE(table.uuid(i) == pols[i].UUID);
+	}
+	auto groups = table.groupbyname(true); // the double-ext rules have no name
+	const auto doubleext = table.removedoubleext(groups);
+	auto expectedgroups = policy::groupbyname(std::move(pols), true);
+	const auto expected = policy::removedoubleext(expectedgroups);
+	REQUIRE(doubleext.size() == 1);
+	REQUIRE(doubleext.size() == expected.size());
+	REQUIRE(doubleext.at(0).ext1 == expected.at(0).ext1);
+	REQUIRE(doubleext.at(0).ext2 == expected.at(0).ext2);
+	REQUIRE(doubleext.at(0).description == expected.at(0).description);
+	REQUIRE(groups.size() == expectedgroups.size());
+	REQUIRE(table.to_vector(groups.at(0)).size() == expectedgroups.at(0).size());
+	REQUIRE(hive.OpenHandles() == 0);
+}
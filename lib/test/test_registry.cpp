@@ -18,19 +18,24 @@
 // local
 #include "settings.hpp"
 #include "uuid.hpp"
-#include "win_handles.hpp"
 
 // test
 #include "catch.hpp"
 
 // local
 #include "registry.hpp"
+#include "memoryhive.hpp"
+#include "registry_snapshot.hpp"
+
+#if defined(_WIN32)
+#include "win_handles.hpp"
 
 // windows
 #include <windows.h>
 #include <tchar.h>
 #include <Shellapi.h>
 #include <WinUser.h>
+#endif
 
 
 //std
@@ -40,6 +45,7 @@
 #include <regex>
 #include <array>
 
+#if defined(_WIN32)
 TEST_CASE("TestEnumKey", "[TestReg]") {
 	const auto reg = registry::OpenKey(HKEY_LOCAL_MACHINE, "SOFTWARE");
 
@@ -164,3 +170,117 @@ TEST_CASE("OpenRegedit", "[TestReg][hide]") {
 	HWND regeditMainHwnd = FindWindowW(L"RegEdit_RegEdit", nullptr);
 	REQUIRE(regeditMainHwnd != nullptr);
 }
+#endif
+
+TEST_CASE("TestMemoryHiveKeys", "[TestReg][MemoryHive]") {
+	registry::MemoryHive hive;
+	registry::ScopedBackend backend(hive);
+	{
+		const auto key = registry::CreateKey(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup\\b", KEY_WRITE);
+		REQUIRE(key);
+		registry::CreateKey(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup\\a", KEY_WRITE);
+		registry::CreateKey(HKEY_LOCAL_MACHINE, "SOFTWARE\\Soup\\C", KEY_WRITE);
+
+		const auto soup = registry::OpenKey(HKEY_LOCAL_MACHINE, "software\\SOUP");
+		const std::vector<std::string> expected = { "a", "b", "C" };
+		REQUIRE(registry::EnumKey(soup.get()) == expected);
+
+		REQUIRE(!registry::OpenKeyOptional(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup\\d"));
+		REQUIRE_THROWS(registry::OpenKey(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup\\d"));
+
+		REQUIRE(!registry::RemoveKey(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup", false)); // has subkeys
+		REQUIRE(registry::RemoveKey(soup.get(), "b", false));
+		REQUIRE(registry::EnumKey(soup.get()).size() == 2);
+		REQUIRE(registry::RemoveKey(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup"));
+		REQUIRE_THROWS(registry::EnumKey(soup.get())); // key has been deleted
+	}
+	REQUIRE(hive.OpenHandles() == 0);
+}
+
+TEST_CASE("TestMemoryHiveValues", "[TestReg][MemoryHive]") {
+	registry::MemoryHive hive;
+	registry::ScopedBackend backend(hive);
+
+	const auto key = registry::CreateKey(HKEY_CURRENT_USER, "SOFTWARE\\soup", KEY_WRITE);
+	REQUIRE(registry::SetValue(key.get(), "dword", 42));
+	REQUIRE(registry::SetValue(key.get(), "string", "value"));
+	REQUIRE(registry::SetValue(key.get(), "expand", "%TEMP%", registry::regtype::expand_sz));
+	const std::vector<std::string> multi = { "a", "bb", "ccc" };
+	REQUIRE(registry::SetValue(key.get(), "multi", multi));
+
+	REQUIRE(registry::QueryDWORD(key.get(), "DWORD") == 42);
+	REQUIRE(registry::QueryQWORD(key.get(), "dword") == 42);
+	REQUIRE(registry::QueryString(key.get(), "string") == "value");
+	REQUIRE(registry::QueryString(key.get(), "expand") == "%TEMP%");
+	REQUIRE(registry::QueryType(key.get(), "expand") == REG_EXPAND_SZ);
+	REQUIRE(registry::QueryMultiString(key.get(), "multi") == multi);
+	REQUIRE(registry::QueryAsString(key.get(), "dword") == "42");
+	REQUIRE_THROWS(registry::QueryString(key.get(), "dword"));
+	REQUIRE_THROWS(registry::QueryDWORD(key.get(), "string"));
+
+	REQUIRE(registry::SetValue(key.get(), "string", "other value"));
+	REQUIRE(registry::QueryString(key.get(), "string") == "other value");
+
+	REQUIRE(registry::RemoveValue(key.get(), "string"));
+	REQUIRE(!registry::RemoveValue(key.get(), "string"));
+	REQUIRE_THROWS(registry::QueryString(key.get(), "string"));
+}
+
+TEST_CASE("TestMemoryHiveTransaction", "[TestReg][MemoryHive]") {
+	registry::MemoryHive hive;
+	registry::ScopedBackend backend(hive);
+	{
+		auto trans = registry::CreateKeyTransacted(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup", KEY_WRITE);
+		const auto sub = registry::CreateKey(trans.key.get(), "sub", KEY_WRITE); // inherits the transaction
+		REQUIRE(registry::SetValue(sub.get(), "value", 1));
+		REQUIRE(registry::QueryDWORD(sub.get(), "value") == 1);
+		REQUIRE(!registry::OpenKeyOptional(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup\\sub"));
+		// transaction is not committed
+	}
+	REQUIRE(!registry::OpenKeyOptional(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup"));
+	{
+		auto trans = registry::CreateKeyTransacted(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup", KEY_WRITE);
+		const auto sub = registry::CreateKey(trans.key.get(), "sub", KEY_WRITE);
+		REQUIRE(registry::SetValue(sub.get(), "value", 1));
+		// changes outside of the transaction are not lost when committing
+		const auto other = registry::CreateKey(HKEY_LOCAL_MACHINE, "SOFTWARE\\other", KEY_WRITE);
+		REQUIRE(registry::CommitTransaction(trans.transaction.get()));
+	}
+	const auto sub = registry::OpenKey(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup\\sub");
+	REQUIRE(registry::QueryDWORD(sub.get(), "value") == 1);
+	REQUIRE(registry::OpenKeyOptional(HKEY_LOCAL_MACHINE, "SOFTWARE\\other"));
+}
+
+TEST_CASE("TestSnapshot", "[TestReg][MemoryHive]") {
+	registry::MemoryHive hive;
+	registry::ScopedBackend backend(hive);
+	{
+		const auto a = registry::CreateKey(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup\\a", KEY_WRITE);
+		REQUIRE(registry::SetValue(a.get(), "string", "value"));
+		REQUIRE(registry::SetValue(a.get(), "dword", 42));
+		const auto b = registry::CreateKey(HKEY_LOCAL_MACHINE, "SOFTWARE\\soup\\b\\c", KEY_WRITE);
+		REQUIRE(registry::SetValue(b.get(), "expand", std::string(1000, 'x'), registry::regtype::expand_sz));
+	}
+	REQUIRE(registry::Snapshot(HKEY_LOCAL_MACHINE, L"SOFTWARE\\nothing").empty());
+
+	const registry::Snapshot snapshot(HKEY_LOCAL_MACHINE, L"SOFTWARE\\soup");
+	REQUIRE(hive.OpenHandles() == 0);
+	REQUIRE(snapshot.keycount() == 4);
+	REQUIRE(snapshot.valuecount() == 3);
+	REQUIRE(snapshot.key(0).subkeys == 2);
+
+	const auto a = snapshot.findsubkey(0, L"A");
+	REQUIRE(a != registry::Snapshot::npos);
+	REQUIRE(snapshot.keyname(a) == "a");
+	REQUIRE(snapshot.QueryString(a, L"String") == "value");
+	REQUIRE(snapshot.QueryDWORD(a, L"dword") == 42);
+	REQUIRE_THROWS(snapshot.QueryString(a, L"dword"));
+	REQUIRE_THROWS(snapshot.QueryDWORD(a, L"missing"));
+
+	const auto b = snapshot.findsubkey(0, L"b");
+	REQUIRE(snapshot.findsubkey(0, L"bb") == registry::Snapshot::npos);
+	const auto c = snapshot.findsubkey(b, L"c");
+	REQUIRE(c != registry::Snapshot::npos);
+	REQUIRE(snapshot.key(c).parent == b);
+	REQUIRE(snapshot.QueryString(c, L"expand") == std::string(1000, 'x'));
+}
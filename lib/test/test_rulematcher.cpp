@@ -0,0 +1,126 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#include "../rulematcher.hpp"
+#include "../policy.hpp"
+
+// test
+#include "catch.hpp"
+
+//std
+#include <string>
+#include <vector>
+
+namespace {
+	policy::policy_s make_rule(const std::string& itemdata, const policy::securitylevel sec) {
+		policy::policy_s p;
+		p.pol.ItemData = itemdata;
+		p.sec = sec;
+		return p;
+	}
+}
+
+TEST_CASE("RuleMatcherNames", "[policy][RuleMatcher]") {
+	const std::vector<policy::policy_s> rules = {
+		make_rule("*.pdf.exe", policy::securitylevel::Disallowed),
+		make_rule("*.d?c.*", policy::securitylevel::Disallowed),
+		make_rule("evil.exe", policy::securitylevel::Disallowed),
+	};
+	const policy::RuleMatcher matcher(rules);
+	REQUIRE(matcher.size() == 3);
+
+	REQUIRE(matcher.Match("C:\\Users\\me\\invoice.PDF.exe") == 0);
+	REQUIRE(matcher.Match("C:/Users/me/invoice.pdf.exe") == 0);
+	REQUIRE(matcher.Match("C:\\Users\\me\\invoice.doc.scr") == 1);
+	REQUIRE(matcher.Match("\\\\share\\evil.exe") == 2);
+	REQUIRE(matcher.Match("C:\\Users\\me\\notevil.exe") == policy::RuleMatcher::npos);
+	REQUIRE(matcher.Match("C:\\x.pdf.exe\\file.txt") == policy::RuleMatcher::npos); // only the file name is considered
+	REQUIRE(matcher.Evaluate("C:\\Users\\me\\invoice.pdf") == policy::securitylevel::Unrestricted);
+	REQUIRE(matcher.IsBlocked("invoice.pdf.exe"));
+}
+
+TEST_CASE("RuleMatcherPaths", "[policy][RuleMatcher]") {
+	const std::vector<policy::policy_s> rules = {
+		make_rule("*:", policy::securitylevel::Disallowed),
+		make_rule("C:\\Windows\\", policy::securitylevel::Unrestricted),
+		make_rule("*:\\$Recycle.Bin", policy::securitylevel::Disallowed),
+		make_rule("%ProgramFiles%", policy::securitylevel::Unrestricted),
+		make_rule("C:\\Users\\*\\AppData", policy::securitylevel::Disallowed),
+	};
+	const policy::RuleMatcher matcher(rules, policy::securitylevel::Unrestricted, { { "PROGRAMFILES", "C:\\Program Files" } });
+
+	REQUIRE(matcher.Match("C:\\Windows\\notepad.exe") == 1);
+	REQUIRE(matcher.Match("c:\\windows") == 1);
+	REQUIRE(matcher.Match("C:\\WindowsApps\\app.exe") == 0); // not inside C:\Windows
+	REQUIRE(matcher.Match("D:\\$RECYCLE.BIN\\S-1-5\\file.exe") == 2);
+	REQUIRE(matcher.Match("C:\\Program Files\\soup\\soup.exe") == 3);
+	REQUIRE(matcher.Match("C:\\Users\\me\\AppData\\Local\\Temp\\a.exe") == 4);
+	REQUIRE(matcher.Match("C:\\Users\\me\\Desktop\\AppData\\a.exe") == 0); // '*' does not match '\'
+	REQUIRE(matcher.Match("\\\\server\\share\\a.exe") == policy::RuleMatcher::npos);
+
+	REQUIRE(matcher.IsBlocked("E:\\setup.exe"));
+	REQUIRE(!matcher.IsBlocked("C:\\Windows\\System32\\cmd.exe"));
+}
+
+TEST_CASE("RuleMatcherPrecedence", "[policy][RuleMatcher]") {
+	const std::vector<policy::policy_s> rules = {
+		make_rule("C:\\Tools", policy::securitylevel::Unrestricted),
+		make_rule("*.exe", policy::securitylevel::Disallowed),
+		make_rule("C:\\Tools\\*.exe", policy::securitylevel::Disallowed),
+		make_rule("C:\\Tools\\*.exe", policy::securitylevel::Unrestricted),
+		make_rule("", policy::securitylevel::Disallowed),
+	};
+	const policy::RuleMatcher matcher(rules);
+	REQUIRE(matcher.size() == 4); // empty rules are ignored
+
+	REQUIRE(matcher.Match("C:\\Tools\\readme.txt") == 0);
+	REQUIRE(matcher.Match("D:\\a.exe") == 1);
+	// more specific rule wins, with the same specificity Disallowed wins
+	REQUIRE(matcher.Match("C:\\Tools\\a.exe") == 2);
+	REQUIRE(matcher.Match("C:\\Tools\\sub\\a.exe") == 0);
+}
+
+TEST_CASE("RuleIndex", "[policy][RuleIndex]") {
+	auto temp = make_rule("%TEMP%", policy::securitylevel::Disallowed);
+	temp.UUID = "{11111111-1111-1111-1111-111111111111}";
+	auto windows = make_rule("C:\\Windows\\", policy::securitylevel::Unrestricted);
+	windows.UUID = "{22222222-2222-2222-2222-222222222222}";
+
+	policy::RuleIndex index({ temp, windows }, { { "Temp", "C:\\Users\\me\\AppData\\Local\\Temp" } });
+	REQUIRE(index.size() == 2);
+	REQUIRE(index.contains("%temp%\\"));
+	REQUIRE(index.contains("c:/users/me/appdata/local/temp"));
+	REQUIRE(index.contains("c:\\windows"));
+	REQUIRE(!index.contains("C:\\Windows\\System32"));
+	REQUIRE(index.find("%Temp%").size() == 1);
+	REQUIRE(index.find("%Temp%").at(0).UUID == temp.UUID);
+
+	const std::vector<policy::policy_s> imported = {
+		make_rule("C:\\Program Files", policy::securitylevel::Unrestricted),
+		make_rule("C:\\WINDOWS", policy::securitylevel::Disallowed),
+		make_rule("c:/program files/", policy::securitylevel::Disallowed),
+	};
+	REQUIRE(index.duplicates(imported) == std::vector<std::size_t>({ 1, 2 }));
+
+	REQUIRE(index.remove(windows));
+	REQUIRE(!index.remove(windows));
+	REQUIRE(!index.contains("C:\\Windows"));
+	index.add(imported[0]);
+	REQUIRE(index.duplicates(imported) == std::vector<std::size_t>({ 0, 2 }));
+	REQUIRE(index.size() == 2);
+}
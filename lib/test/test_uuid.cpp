@@ -21,14 +21,107 @@
 // test
 #include "catch.hpp"
 
-// windows
-#include <Windows.h>
-
 //std
 #include <string>
+#include <set>
+#include <unordered_set>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
 
 TEST_CASE("TestUUID", "[TestUUID]") {
 	const auto uid = uid::createUUID();
 	const auto strui = uid::to_string(uid);
 	int a = 1; (void)a;
 }
+
+TEST_CASE("BinaryUUID", "[TestUUID][BinaryUUID]") {
+	UUID guid;
+	guid.Data1 = 0x01234567;
+	guid.Data2 = 0x89AB;
+	guid.Data3 = 0xCDEF;
+	const BYTE data4[8] = { 0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10 };
+	std::copy(data4, data4 + 8, guid.Data4);
+
+	const uid::BinaryUUID u(guid);
+	REQUIRE(u.to_string() == "{01234567-89AB-CDEF-FEDC-BA9876543210}");
+	REQUIRE(uid::to_string(guid) == u.to_string());
+	REQUIRE(uid::BinaryUUID::from_string("{01234567-89ab-cdef-fedc-ba9876543210}") == u);
+	REQUIRE(uid::BinaryUUID::from_string("01234567-89AB-CDEF-FEDC-BA9876543210") == u);
+	const auto back = u.to_guid();
+	REQUIRE(back.Data1 == guid.Data1);
+	REQUIRE(back.Data2 == guid.Data2);
+	REQUIRE(back.Data3 == guid.Data3);
+	REQUIRE(std::equal(data4, data4 + 8, back.Data4));
+
+	const std::string invalid[] = {
+		"",
+		"{01234567-89AB-CDEF-FEDC-BA9876543210",
+		"(01234567-89AB-CDEF-FEDC-BA9876543210)",
+		"{01234567-89AB-CDEF-FEDC-BA987654321G}",
+		"{01234567-89AB-CDEF-FEDC-BA987654321 }",
+		"{01234567+89AB-CDEF-FEDC-BA9876543210}",
+		"{0123456789AB-CDEF-FEDC-BA9876543210}",
+		"{:1234567-89AB-CDEF-FEDC-BA9876543210}",
+		"{01234567-89AB-CDEF-FEDC-BA98765432@0}",
+		"{01234567-89AB-CDEF-FEDC-BA98765432\xC3" "0}",
+	};
+	for (const auto& s : invalid) {
+		uid::BinaryUUID out;
+		REQUIRE(!uid::BinaryUUID::parse(s.data(), s.size(), out));
+		REQUIRE_THROWS_AS(uid::BinaryUUID::from_string(s), std::runtime_error);
+	}
+
+	REQUIRE(uid::BinaryUUID().isnil());
+	REQUIRE(uid::BinaryUUID().to_string() == "{00000000-0000-0000-0000-000000000000}");
+}
+
+TEST_CASE("BinaryUUIDRandom", "[TestUUID][BinaryUUID]") {
+	std::set<uid::BinaryUUID> ordered;
+	std::unordered_set<uid::BinaryUUID> hashed;
+	std::set<std::string> strings;
+	for (int i = 0; i != 1000; ++i) {
+		const auto u = uid::BinaryUUID::random();
+		const auto s = u.to_string();
+		REQUIRE(s.size() == uid::BinaryUUID::stringsize);
+		REQUIRE(s[15] == '4'); // version
+		REQUIRE(std::string("89AB").find(s[20]) != std::string::npos); // variant
+		REQUIRE(uid::BinaryUUID::from_string(s) == u);
+		std::string lower = s;
+		std::transform(lower.begin(), lower.end(), lower.begin(), [](const char c) { return static_cast<char>(std::tolower(c)); });
+		REQUIRE(uid::BinaryUUID::from_string(lower) == u);
+		ordered.insert(u);
+		hashed.insert(u);
+		strings.insert(s);
+	}
+	REQUIRE(ordered.size() == 1000);
+	REQUIRE(hashed.size() == 1000);
+	// same order of the string representation
+	auto it = strings.begin();
+	for (const auto& u : ordered) {
+		REQUIRE(u.to_string() == *it++);
+	}
+
+	const auto guid = uid::createUUID();
+	REQUIRE(uid::BinaryUUID(guid).to_string() == uid::to_string(guid));
+}
+
+TEST_CASE("GenerateUUIDs", "[TestUUID][BinaryUUID]") {
+	const auto uuids = uid::generate(10000);
+	REQUIRE(uuids.size() == 10000);
+	const std::unordered_set<uid::BinaryUUID> unique(uuids.begin(), uuids.end());
+	REQUIRE(unique.size() == uuids.size());
+
+	std::string formatted(uuids.size() * uid::BinaryUUID::stringsize, '\0');
+	uid::format(uuids.data(), uuids.size(), &formatted[0]);
+	for (std::size_t i = 0; i != uuids.size(); ++i) {
+		const auto s = formatted.substr(i * uid::BinaryUUID::stringsize, uid::BinaryUUID::stringsize);
+		REQUIRE(s == uuids[i].to_string());
+		REQUIRE(s[15] == '4');
+	}
+
+	const auto strings = uid::generatestrings(100);
+	REQUIRE(strings.size() == 100);
+	REQUIRE(std::set<std::string>(strings.begin(), strings.end()).size() == 100);
+	REQUIRE(uid::generate(0).empty());
+}
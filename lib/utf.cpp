@@ -0,0 +1,282 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "utf.hpp"
+
+// std
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UTF_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace utf {
+
+	namespace {
+		// Out is a 16 or 32 bit unit, the sse2 code stores whole registers in it
+		template<class Out>
+		std::size_t ascii_to_units(const char* in, const std::size_t size, Out* out) {
+			std::size_t i = 0;
+#if defined(UTF_SSE2)
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 16 <= size; i += 16) {
+				const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				if (_mm_movemask_epi8(v) != 0) { // some byte has the high bit set
+					break;
+				}
+				const __m128i lo = _mm_unpacklo_epi8(v, zero);
+				const __m128i hi = _mm_unpackhi_epi8(v, zero);
+				if (sizeof(Out) == 2) {
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), lo);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), hi);
+				} else {
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi16(lo, zero));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4), _mm_unpackhi_epi16(lo, zero));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpacklo_epi16(hi, zero));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 12), _mm_unpackhi_epi16(hi, zero));
+				}
+			}
+#endif
+			for (; i != size && static_cast<unsigned char>(in[i]) < 0x80; ++i) {
+				out[i] = static_cast<Out>(in[i]);
+			}
+			return i;
+		}
+
+		// number of leading ascii units, copied to out
+		template<class In>
+		std::size_t units_to_ascii(const In* in, const std::size_t size, char* out) {
+			std::size_t i = 0;
+#if defined(UTF_SSE2)
+			const __m128i zero = _mm_setzero_si128();
+			constexpr std::size_t step = 16 / sizeof(In);
+			const __m128i nonascii = (sizeof(In) == 2) ? _mm_set1_epi16(static_cast<short>(0xFF80)) : _mm_set1_epi32(static_cast<int>(0xFFFFFF80));
+			for (; i + 2 * step <= size; i += 2 * step) {
+				const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				const __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + step));
+				const __m128i high = _mm_or_si128(_mm_and_si128(v1, nonascii), _mm_and_si128(v2, nonascii));
+				if (_mm_movemask_epi8(_mm_cmpeq_epi8(high, zero)) != 0xFFFF) {
+					break;
+				}
+				if (sizeof(In) == 2) {
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(v1, zero));
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i + step), _mm_packus_epi16(v2, zero));
+				} else {
+					const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(v1, v2), zero);
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), packed);
+				}
+			}
+#endif
+			for (; i != size && static_cast<std::uint32_t>(in[i]) < 0x80; ++i) {
+				out[i] = static_cast<char>(in[i]);
+			}
+			return i;
+		}
+
+		// decodes the non-ascii sequence starting at in[i], returns the code point or invalid, advances i
+		inline std::uint32_t decode_utf8(const char* in, const std::size_t size, std::size_t& i) {
+			const auto c = static_cast<unsigned char>(in[i]);
+			std::size_t need;
+			std::uint32_t cp;
+			std::uint32_t min;
+			if ((c & 0xE0) == 0xC0) {
+				need = 1; cp = c & 0x1Fu; min = 0x80;
+			} else if ((c & 0xF0) == 0xE0) {
+				need = 2; cp = c & 0x0Fu; min = 0x800;
+			} else if ((c & 0xF8) == 0xF0) {
+				need = 3; cp = c & 0x07u; min = 0x10000;
+			} else {
+				return static_cast<std::uint32_t>(-1);
+			}
+			if (size - i <= need) {
+				return static_cast<std::uint32_t>(-1);
+			}
+			for (std::size_t k = 1; k <= need; ++k) {
+				const auto b = static_cast<unsigned char>(in[i + k]);
+				if ((b & 0xC0) != 0x80) {
+					return static_cast<std::uint32_t>(-1);
+				}
+				cp = (cp << 6) | (b & 0x3Fu);
+			}
+			if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+				return static_cast<std::uint32_t>(-1);
+			}
+			i += need + 1;
+			return cp;
+		}
+
+		inline std::size_t encode_utf8(const std::uint32_t cp, char* out) {
+			if (cp < 0x80) {
+				out[0] = static_cast<char>(cp);
+				return 1;
+			}
+			if (cp < 0x800) {
+				out[0] = static_cast<char>(0xC0 | (cp >> 6));
+				out[1] = static_cast<char>(0x80 | (cp & 0x3F));
+				return 2;
+			}
+			if (cp < 0x10000) {
+				out[0] = static_cast<char>(0xE0 | (cp >> 12));
+				out[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+				out[2] = static_cast<char>(0x80 | (cp & 0x3F));
+				return 3;
+			}
+			out[0] = static_cast<char>(0xF0 | (cp >> 18));
+			out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+			out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+			out[3] = static_cast<char>(0x80 | (cp & 0x3F));
+			return 4;
+		}
+
+		template<class Out>
+		std::size_t from_utf8(const char* in, const std::size_t size, Out* out) {
+			std::size_t i = 0;
+			std::size_t o = 0;
+			while (i != size) {
+				const auto ascii = ascii_to_units(in + i, size - i, out + o);
+				i += ascii;
+				o += ascii;
+				if (i == size) {
+					break;
+				}
+				const auto cp = decode_utf8(in, size, i);
+				if (cp == static_cast<std::uint32_t>(-1)) {
+					return invalid;
+				}
+				if (sizeof(Out) == 4 || cp < 0x10000) {
+					out[o++] = static_cast<Out>(cp);
+				} else {
+					out[o++] = static_cast<Out>(0xD800 + ((cp - 0x10000) >> 10));
+					out[o++] = static_cast<Out>(0xDC00 + ((cp - 0x10000) & 0x3FF));
+				}
+			}
+			return o;
+		}
+
+		template<class In>
+		std::size_t utf16_units_to_utf8(const In* in, const std::size_t size, char* out) {
+			std::size_t i = 0;
+			std::size_t o = 0;
+			while (i != size) {
+				const auto ascii = units_to_ascii(in + i, size - i, out + o);
+				i += ascii;
+				o += ascii;
+				if (i == size) {
+					break;
+				}
+				std::uint32_t cp = static_cast<std::uint16_t>(in[i++]);
+				if (cp >= 0xD800 && cp <= 0xDBFF) {
+					if (i == size) {
+						return invalid;
+					}
+					const std::uint32_t low = static_cast<std::uint16_t>(in[i]);
+					if (low < 0xDC00 || low > 0xDFFF) {
+						return invalid;
+					}
+					++i;
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+				} else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+					return invalid;
+				}
+				o += encode_utf8(cp, out + o);
+			}
+			return o;
+		}
+
+		template<class In>
+		std::size_t utf32_units_to_utf8(const In* in, const std::size_t size, char* out) {
+			std::size_t i = 0;
+			std::size_t o = 0;
+			while (i != size) {
+				const auto ascii = units_to_ascii(in + i, size - i, out + o);
+				i += ascii;
+				o += ascii;
+				if (i == size) {
+					break;
+				}
+				const auto cp = static_cast<std::uint32_t>(in[i++]);
+				if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+					return invalid;
+				}
+				o += encode_utf8(cp, out + o);
+			}
+			return o;
+		}
+
+		template<std::size_t size>
+		struct wide;
+		template<>
+		struct wide<2> {
+			static std::size_t from_utf8(const char* in, const std::size_t n, wchar_t* out) { return utf::from_utf8(in, n, out); }
+			static std::size_t to_utf8(const wchar_t* in, const std::size_t n, char* out) { return utf16_units_to_utf8(in, n, out); }
+		};
+		template<>
+		struct wide<4> {
+			static std::size_t from_utf8(const char* in, const std::size_t n, wchar_t* out) { return utf::from_utf8(in, n, out); }
+			static std::size_t to_utf8(const wchar_t* in, const std::size_t n, char* out) { return utf32_units_to_utf8(in, n, out); }
+		};
+	}
+
+	std::size_t utf8_to_utf16(const char* in, const std::size_t size, char16_t* out) {
+		return from_utf8(in, size, out);
+	}
+
+	std::size_t utf8_to_utf32(const char* in, const std::size_t size, char32_t* out) {
+		return from_utf8(in, size, out);
+	}
+
+	std::size_t utf16_to_utf8(const char16_t* in, const std::size_t size, char* out) {
+		return utf16_units_to_utf8(in, size, out);
+	}
+
+	std::size_t utf32_to_utf8(const char32_t* in, const std::size_t size, char* out) {
+		return utf32_units_to_utf8(in, size, out);
+	}
+
+	std::size_t utf8_to_wide(const char* in, const std::size_t size, wchar_t* out) {
+		return wide<sizeof(wchar_t)>::from_utf8(in, size, out);
+	}
+
+	std::size_t wide_to_utf8(const wchar_t* in, const std::size_t size, char* out) {
+		return wide<sizeof(wchar_t)>::to_utf8(in, size, out);
+	}
+
+	void to_wide(const char* in, const std::size_t size, std::wstring& out) {
+		out.resize(max_wide_size(size));
+		const auto len = size == 0 ? 0 : utf8_to_wide(in, size, &out[0]);
+		if (len == invalid) {
+			out.clear();
+			throw std::runtime_error("error when converting to wstring, invalid utf-8");
+		}
+		out.resize(len);
+	}
+
+	void to_utf8(const wchar_t* in, const std::size_t size, std::string& out) {
+		out.resize(max_utf8_size_from_wide(size));
+		const auto len = size == 0 ? 0 : wide_to_utf8(in, size, &out[0]);
+		if (len == invalid) {
+			out.clear();
+			throw std::runtime_error("error when converting to string, invalid utf-16");
+		}
+		out.resize(len);
+	}
+}
@@ -0,0 +1,57 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// std
+#include <string>
+#include <cstddef>
+
+/// Validating conversions between utf-8, utf-16 and utf-32, independent from the windows api.
+/// - runs of ascii characters are converted 16 characters at a time (sse2, when available)
+/// - the caller provides the output buffer, use the max_* functions for its size
+/// - invalid input (overlong sequences, surrogates in utf-8 or utf-32, unpaired surrogates in utf-16, truncated sequences, values above U+10FFFF)
+///   is never replaced, the functions return utf::invalid instead
+namespace utf {
+
+	constexpr std::size_t invalid = static_cast<std::size_t>(-1);
+
+	/// a utf-8 sequence never produces more utf-16 (or utf-32) units than bytes
+	constexpr std::size_t max_utf16_size(const std::size_t utf8size) { return utf8size; }
+	constexpr std::size_t max_utf32_size(const std::size_t utf8size) { return utf8size; }
+	/// a utf-16 unit produces at most 3 bytes (a surrogate pair 4 bytes for 2 units), a utf-32 unit at most 4
+	constexpr std::size_t max_utf8_size_from_utf16(const std::size_t utf16size) { return 3 * utf16size; }
+	constexpr std::size_t max_utf8_size_from_utf32(const std::size_t utf32size) { return 4 * utf32size; }
+
+	/// return the number of units written in out, or invalid
+	std::size_t utf8_to_utf16(const char* in, const std::size_t size, char16_t* out);
+	std::size_t utf8_to_utf32(const char* in, const std::size_t size, char32_t* out);
+	std::size_t utf16_to_utf8(const char16_t* in, const std::size_t size, char* out);
+	std::size_t utf32_to_utf8(const char32_t* in, const std::size_t size, char* out);
+
+	/// wchar_t is utf-16 on windows, and utf-32 on other platforms
+	std::size_t utf8_to_wide(const char* in, const std::size_t size, wchar_t* out);
+	std::size_t wide_to_utf8(const wchar_t* in, const std::size_t size, char* out);
+	constexpr std::size_t max_wide_size(const std::size_t utf8size) { return utf8size; }
+	constexpr std::size_t max_utf8_size_from_wide(const std::size_t widesize) {
+		return sizeof(wchar_t) == 2 ? max_utf8_size_from_utf16(widesize) : max_utf8_size_from_utf32(widesize);
+	}
+
+	/// convert into out, reusing its memory, throws std::runtime_error on invalid input
+	void to_wide(const char* in, const std::size_t size, std::wstring& out);
+	void to_utf8(const wchar_t* in, const std::size_t size, std::string& out);
+}
@@ -0,0 +1,326 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "uuid.hpp"
+
+// local
+#include "win_types.hpp"
+
+// std
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <random>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#if defined(_WIN32)
+// windows
+#include <Windows.h>
+#include <bcrypt.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UUID_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace uid {
+
+	namespace {
+		// position of the hex digits groups in "{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}", without the leading brace
+		struct group {
+			std::size_t pos;
+			std::size_t size;
+		};
+		const group groups[] = { { 0, 8 },{ 9, 4 },{ 14, 4 },{ 19, 4 },{ 24, 12 } };
+
+		std::uint64_t load64(const std::uint8_t* p) {
+			std::uint64_t v;
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+
+		// 32 hex digits -> 16 bytes, returns false if a character is not a hex digit
+		bool decodehex(const char* hex, std::uint8_t* out) {
+#if defined(UUID_SSE2)
+			for (int half = 0; half != 2; ++half) {
+				const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + 16 * half));
+				// unsigned comparisons: x <= n is min(x, n) == x
+				const __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+				const __m128i isdigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+				const __m128i letter = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+				const __m128i isletter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+				if (_mm_movemask_epi8(_mm_or_si128(isdigit, isletter)) != 0xFFFF) {
+					return false;
+				}
+				const __m128i nibbles = _mm_or_si128(_mm_and_si128(isdigit, digit), _mm_andnot_si128(isdigit, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+				// every 16 bit lane contains two nibbles, the first character is in the low byte
+				const __m128i high = _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4);
+				const __m128i low = _mm_srli_epi16(nibbles, 8);
+				const __m128i packed = _mm_packus_epi16(_mm_or_si128(high, low), _mm_setzero_si128());
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + 8 * half), packed);
+			}
+			return true;
+#else
+			const auto value = [](const char c) -> int {
+				if (c >= '0' && c <= '9') { return c - '0'; }
+				if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+				if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+				return -1;
+			};
+			for (std::size_t i = 0; i != 16; ++i) {
+				const auto h = value(hex[2 * i]);
+				const auto l = value(hex[2 * i + 1]);
+				if (h < 0 || l < 0) {
+					return false;
+				}
+				out[i] = static_cast<std::uint8_t>(h << 4 | l);
+			}
+			return true;
+#endif
+		}
+
+		// 16 bytes -> 32 uppercase hex digits
+		void encodehex(const std::uint8_t* in, char* hex) {
+#if defined(UUID_SSE2)
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+			const __m128i mask = _mm_set1_epi8(0x0F);
+			const __m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+			const __m128i low = _mm_and_si128(v, mask);
+			const auto tochar = [](const __m128i n) {
+				// '0' + n, and 7 more for 'A'-'F'
+				const __m128i isletter = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+				return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), _mm_and_si128(isletter, _mm_set1_epi8(7)));
+			};
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(hex), tochar(_mm_unpacklo_epi8(high, low)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(hex + 16), tochar(_mm_unpackhi_epi8(high, low)));
+#else
+			const char digits[] = "0123456789ABCDEF";
+			for (std::size_t i = 0; i != 16; ++i) {
+				hex[2 * i] = digits[in[i] >> 4];
+				hex[2 * i + 1] = digits[in[i] & 0x0F];
+			}
+#endif
+		}
+
+#if defined(_WIN32)
+		void randombytes(std::uint8_t* out, const std::size_t size) {
+			if (size > (std::numeric_limits<ULONG>::max)()) {
+				throw std::runtime_error("too many random bytes requested");
+			}
+			const auto res = ::BCryptGenRandom(nullptr, out, static_cast<ULONG>(size), BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+			if (res != 0) { // STATUS_SUCCESS
+				throw std::runtime_error("unable to generate random bytes");
+			}
+		}
+#else
+		std::uint32_t rotl(const std::uint32_t v, const int c) {
+			return (v << c) | (v >> (32 - c));
+		}
+
+		void quarterround(std::uint32_t* x, const int a, const int b, const int c, const int d) {
+			x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 16);
+			x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 12);
+			x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 8);
+			x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 7);
+		}
+
+		// ChaCha20 keystream (RFC 7539 block function), the key is taken from std::random_device once per thread
+		// std::random_device alone would need a call (possibly a system call) for every 4 bytes
+		class chacha20 {
+			std::uint32_t state[16];
+		public:
+			chacha20() {
+				std::random_device rd;
+				state[0] = 0x61707865; state[1] = 0x3320646e; state[2] = 0x79622d32; state[3] = 0x6b206574;
+				for (int i = 4; i != 16; ++i) { // key and nonce
+					state[i] = static_cast<std::uint32_t>(rd());
+				}
+				state[12] = 0; // block counter
+			}
+
+			void fill(std::uint8_t* out, std::size_t size) {
+				std::uint32_t block[16];
+				while (size != 0) {
+					std::copy(state, state + 16, block);
+					for (int i = 0; i != 10; ++i) {
+						quarterround(block, 0, 4, 8, 12);
+						quarterround(block, 1, 5, 9, 13);
+						quarterround(block, 2, 6, 10, 14);
+						quarterround(block, 3, 7, 11, 15);
+						quarterround(block, 0, 5, 10, 15);
+						quarterround(block, 1, 6, 11, 12);
+						quarterround(block, 2, 7, 8, 13);
+						quarterround(block, 3, 4, 9, 14);
+					}
+					for (int i = 0; i != 16; ++i) {
+						block[i] += state[i];
+					}
+					const auto n = (std::min)(size, sizeof(block));
+					std::memcpy(out, block, n);
+					out += n;
+					size -= n;
+					if (++state[12] == 0) { // the nonce is used as upper part of the counter
+						++state[13];
+					}
+				}
+			}
+		};
+
+		void randombytes(std::uint8_t* out, const std::size_t size) {
+			static thread_local chacha20 rng;
+			rng.fill(out, size);
+		}
+#endif
+	}
+
+	constexpr std::size_t BinaryUUID::stringsize;
+
+	BinaryUUID::BinaryUUID(const UUID& guid) {
+		bytes[0] = static_cast<std::uint8_t>(guid.Data1 >> 24);
+		bytes[1] = static_cast<std::uint8_t>(guid.Data1 >> 16);
+		bytes[2] = static_cast<std::uint8_t>(guid.Data1 >> 8);
+		bytes[3] = static_cast<std::uint8_t>(guid.Data1);
+		bytes[4] = static_cast<std::uint8_t>(guid.Data2 >> 8);
+		bytes[5] = static_cast<std::uint8_t>(guid.Data2);
+		bytes[6] = static_cast<std::uint8_t>(guid.Data3 >> 8);
+		bytes[7] = static_cast<std::uint8_t>(guid.Data3);
+		std::memcpy(bytes + 8, guid.Data4, 8);
+	}
+
+	UUID BinaryUUID::to_guid() const {
+		UUID guid;
+		guid.Data1 = static_cast<DWORD>(static_cast<DWORD>(bytes[0]) << 24 | static_cast<DWORD>(bytes[1]) << 16 | static_cast<DWORD>(bytes[2]) << 8 | bytes[3]);
+		guid.Data2 = static_cast<WORD>(bytes[4] << 8 | bytes[5]);
+		guid.Data3 = static_cast<WORD>(bytes[6] << 8 | bytes[7]);
+		std::memcpy(guid.Data4, bytes + 8, 8);
+		return guid;
+	}
+
+	bool BinaryUUID::parse(const char* s, std::size_t size, BinaryUUID& out) {
+		if (size == stringsize) {
+			if (s[0] != '{' || s[stringsize - 1] != '}') {
+				return false;
+			}
+			++s;
+			size -= 2;
+		}
+		if (size != stringsize - 2 || s[8] != '-' || s[13] != '-' || s[18] != '-' || s[23] != '-') {
+			return false;
+		}
+		char hex[32];
+		char* h = hex;
+		for (const auto& g : groups) {
+			std::memcpy(h, s + g.pos, g.size);
+			h += g.size;
+		}
+		return decodehex(hex, out.bytes);
+	}
+
+	BinaryUUID BinaryUUID::from_string(const std::string& s) {
+		BinaryUUID toreturn;
+		if (!parse(s.data(), s.size(), toreturn)) {
+			throw std::runtime_error("invalid UUID " + s);
+		}
+		return toreturn;
+	}
+
+	void BinaryUUID::format(char* out) const {
+		char hex[32];
+		encodehex(bytes, hex);
+		out[0] = '{';
+		const char* h = hex;
+		for (const auto& g : groups) {
+			if (g.pos != 0) {
+				out[g.pos] = '-';
+			}
+			std::memcpy(out + 1 + g.pos, h, g.size);
+			h += g.size;
+		}
+		out[stringsize - 1] = '}';
+	}
+
+	std::string BinaryUUID::to_string() const {
+		std::string toreturn(stringsize, '\0');
+		format(&toreturn[0]);
+		return toreturn;
+	}
+
+	BinaryUUID BinaryUUID::random() {
+		BinaryUUID toreturn;
+		generate(&toreturn, 1);
+		return toreturn;
+	}
+
+	bool BinaryUUID::isnil() const {
+		return (load64(bytes) | load64(bytes + 8)) == 0;
+	}
+
+	std::size_t BinaryUUID::hash() const {
+		// random UUIDs are already uniformly distributed, still mix all bits for UUIDs that are not random
+		std::uint64_t h = load64(bytes) * 0x9E3779B97F4A7C15ull;
+		h ^= load64(bytes + 8) + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		return static_cast<std::size_t>(h);
+	}
+
+	bool operator==(const BinaryUUID& l, const BinaryUUID& r) {
+		return ((load64(l.bytes) ^ load64(r.bytes)) | (load64(l.bytes + 8) ^ load64(r.bytes + 8))) == 0;
+	}
+
+	bool operator<(const BinaryUUID& l, const BinaryUUID& r) {
+		return std::memcmp(l.bytes, r.bytes, 16) < 0;
+	}
+
+	void generate(BinaryUUID* out, const std::size_t n) {
+		static_assert(sizeof(BinaryUUID) == 16, "BinaryUUID should contain only the bytes");
+		if (n == 0) {
+			return;
+		}
+		randombytes(reinterpret_cast<std::uint8_t*>(out), n * sizeof(BinaryUUID));
+		for (std::size_t i = 0; i != n; ++i) {
+			out[i].bytes[6] = static_cast<std::uint8_t>((out[i].bytes[6] & 0x0F) | 0x40); // version
+			out[i].bytes[8] = static_cast<std::uint8_t>((out[i].bytes[8] & 0x3F) | 0x80); // variant
+		}
+	}
+
+	std::vector<BinaryUUID> generate(const std::size_t n) {
+		std::vector<BinaryUUID> toreturn(n);
+		generate(toreturn.data(), n);
+		return toreturn;
+	}
+
+	void format(const BinaryUUID* in, const std::size_t n, char* out) {
+		for (std::size_t i = 0; i != n; ++i) {
+			in[i].format(out + i * BinaryUUID::stringsize);
+		}
+	}
+
+	std::vector<std::string> generatestrings(const std::size_t n) {
+		const auto uuids = generate(n);
+		std::vector<std::string> toreturn(n, std::string(BinaryUUID::stringsize, '\0'));
+		for (std::size_t i = 0; i != n; ++i) {
+			uuids[i].format(&toreturn[i][0]);
+		}
+		return toreturn;
+	}
+}
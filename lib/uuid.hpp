@@ -19,18 +19,79 @@
 
 // local
 #include "common.hpp"
+#include "win_types.hpp"
 
+#if defined(_WIN32)
 // windows
 #include <Windows.h>
 #include <Objbase.h> // Objbase.h
+#endif
 
 //std
 #include <string>
+#include <vector>
 #include <stdexcept>
+#include <functional>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 
 namespace uid {
 
+	/// Portable 16 bytes UUID, stored in the same order of the string representation (Data1, Data2 and Data3 big endian)
+	/// - parse and format the "{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}" form (also without braces), with sse2 when available
+	/// - the order is the same of the (uppercase) string representation
+	/// - equality does not depend on the position of the first difference
+	class BinaryUUID {
+		std::uint8_t bytes[16] = {};
+	public:
+		static constexpr std::size_t stringsize = 38; // with braces
+
+		BinaryUUID() = default; // nil UUID
+		explicit BinaryUUID(const UUID& guid);
+		UUID to_guid() const;
+
+		/// returns false if s is not a valid UUID, accepts upper and lower case hex digits
+		static bool parse(const char* s, const std::size_t size, BinaryUUID& out);
+		/// throws std::runtime_error if s is not a valid UUID
+		static BinaryUUID from_string(const std::string& s);
+
+		/// writes stringsize characters (no terminating null), with uppercase hex digits, like StringFromGUID2
+		void format(char* out) const;
+		std::string to_string() const;
+
+		/// random (version 4) UUID
+		static BinaryUUID random();
+
+		/// from 16 bytes in the order of data()
+		static BinaryUUID from_bytes(const std::uint8_t* data) {
+			BinaryUUID toreturn;
+			std::memcpy(toreturn.bytes, data, sizeof(toreturn.bytes));
+			return toreturn;
+		}
+		const std::uint8_t* data() const { return bytes; }
+		bool isnil() const;
+		std::size_t hash() const;
+
+		friend bool operator==(const BinaryUUID& l, const BinaryUUID& r);
+		friend bool operator!=(const BinaryUUID& l, const BinaryUUID& r) { return !(l == r); }
+		friend bool operator<(const BinaryUUID& l, const BinaryUUID& r);
+
+		friend void generate(BinaryUUID* out, const std::size_t n);
+	};
+
+	/// fills out with n random (version 4) UUIDs, the random bytes of all UUIDs are requested at once
+	/// on windows from BCryptGenRandom, on other platforms from a ChaCha20 stream seeded (per thread) by std::random_device
+	void generate(BinaryUUID* out, const std::size_t n);
+	std::vector<BinaryUUID> generate(const std::size_t n);
+
+	/// writes n * BinaryUUID::stringsize characters, without separators
+	void format(const BinaryUUID* in, const std::size_t n, char* out);
+	/// n random UUIDs, in the format of to_string
+	std::vector<std::string> generatestrings(const std::size_t n);
+
+#if defined(_WIN32)
 	// UUID and GUID are the same thing
 	inline UUID createUUID() {
 		UUID uid;
@@ -40,16 +101,16 @@ namespace uid {
 		}
 		throw std::runtime_error("unable to create UUID");
 	}
+#else
+	// random (version 4) UUID
+	inline UUID createUUID() {
+		return BinaryUUID::random().to_guid();
+	}
+#endif
 
+	// same format of StringFromGUID2, without converting from wide characters
 	inline std::string to_string(const UUID& uid) {
-		constexpr int maxsize = 60;
-		OLECHAR szGuid[maxsize + 1] = { 0 };
-		const auto nCount = ::StringFromGUID2(uid, szGuid, maxsize);
-		if (nCount <= 0 || nCount > maxsize) {
-			throw std::runtime_error("unable to convert UUID to string");
-		}
-		const std::wstring res(szGuid, static_cast<size_t>(nCount-1)); // -1 since it is the '\0'
-		return ws2s(res);
+		return BinaryUUID(uid).to_string();
 	}
 
 	class MyUUID{
@@ -67,3 +128,10 @@ namespace uid {
 	};
 
 }
+
+namespace std {
+	template<>
+	struct hash<uid::BinaryUUID> {
+		std::size_t operator()(const uid::BinaryUUID& u) const { return u.hash(); }
+	};
+}
@@ -17,6 +17,8 @@
 
 #pragma once
 
+// RAII_HKEY is defined in registry.hpp, since registry keys are closed through the registry backend
+
 // windows
 #include <Windows.h>
 #include <Winuser.h>
@@ -31,13 +33,6 @@
 #include <string>
 
 namespace details{
-	struct sKeyDeleter {
-		typedef HKEY pointer;
-		void operator()(const HKEY& hkey) const noexcept {
-			const auto res = ::RegCloseKey(hkey); (void)res; assert(res == ERROR_SUCCESS);
-		}
-	};
-
 	struct sKeyUnloader {
 		std::wstring key;
 		void operator()(const HKEY& hkey) const noexcept {
@@ -52,6 +47,13 @@ namespace details{
 		}
 	};
 
+	struct sLocalFree{
+		typedef HLOCAL pointer;
+		void operator()(const HLOCAL& h) const noexcept {
+			const auto res = ::LocalFree(h); (void)res; assert(res == nullptr);
+		}
+	};
+
 	struct sFreeLibrary{
 		typedef HMODULE pointer;
 		void operator()(const HMODULE& h) const noexcept {
@@ -103,10 +105,10 @@ namespace details{
 }
 
 using RAII_HANDLE      = std::unique_ptr<HANDLE,     details::sCloseHandle>;
+using RAII_LOCALMEM    = std::unique_ptr<HLOCAL,     details::sLocalFree>;
 
 
 using RAII_HINSTANCE   = std::unique_ptr<HINSTANCE,  details::sFreeLibrary>;
-using RAII_HKEY        = std::unique_ptr<HKEY,       details::sKeyDeleter>;
 using RAII_LOADHKEY    = std::unique_ptr<HKEY,       details::sKeyUnloader>;
 using RAII_HMODULE     = std::unique_ptr<HMODULE,    details::sFreeLibrary>;
 
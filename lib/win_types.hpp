@@ -0,0 +1,108 @@
+/*
+	Copyright (C) 2016 Federico Kircheis
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Subset of the windows types and constants used by the registry and policy code.
+// On windows it simply includes the system headers, on other platforms it provides
+// compatible definitions, so that the library can be built against the in-memory registry (see memoryhive.hpp)
+
+#if defined(_WIN32)
+
+// windows
+#include <Windows.h>
+#include <winreg.h>
+#include <WinDNS.h> // qword
+
+#else
+
+// cstd
+#include <cstdint>
+
+typedef std::uint8_t   BYTE;
+typedef std::uint16_t  WORD;
+typedef std::uint32_t  DWORD;
+typedef std::int32_t   LONG;
+typedef std::uint64_t  QWORD;
+typedef std::uintptr_t ULONG_PTR;
+typedef DWORD          ACCESS_MASK;
+typedef ACCESS_MASK    REGSAM;
+typedef BYTE*          LPBYTE;
+typedef void*          HANDLE;
+
+struct HKEY__;
+typedef HKEY__* HKEY;
+
+// UUID and GUID are the same thing
+struct GUID {
+	DWORD Data1;
+	WORD  Data2;
+	WORD  Data3;
+	BYTE  Data4[8];
+};
+typedef GUID UUID;
+
+#define INVALID_HANDLE_VALUE ((HANDLE)(ULONG_PTR)-1)
+
+#define HKEY_CLASSES_ROOT     ((HKEY)(ULONG_PTR)((LONG)0x80000000))
+#define HKEY_CURRENT_USER     ((HKEY)(ULONG_PTR)((LONG)0x80000001))
+#define HKEY_LOCAL_MACHINE    ((HKEY)(ULONG_PTR)((LONG)0x80000002))
+#define HKEY_USERS            ((HKEY)(ULONG_PTR)((LONG)0x80000003))
+#define HKEY_CURRENT_CONFIG   ((HKEY)(ULONG_PTR)((LONG)0x80000005))
+
+// error codes
+constexpr LONG ERROR_SUCCESS                = 0;
+constexpr LONG ERROR_FILE_NOT_FOUND         = 2;
+constexpr LONG ERROR_PATH_NOT_FOUND         = 3;
+constexpr LONG ERROR_ACCESS_DENIED          = 5;
+constexpr LONG ERROR_INVALID_HANDLE         = 6;
+constexpr LONG ERROR_INVALID_DATA           = 13;
+constexpr LONG ERROR_OUTOFMEMORY            = 14;
+constexpr LONG ERROR_INVALID_PARAMETER      = 87;
+constexpr LONG ERROR_INSUFFICIENT_BUFFER    = 122;
+constexpr LONG ERROR_MORE_DATA              = 234;
+constexpr LONG ERROR_NO_MORE_ITEMS          = 259;
+constexpr LONG ERROR_KEY_DELETED            = 1018;
+constexpr LONG ERROR_TRANSACTION_NOT_ACTIVE = 6701;
+
+// access rights
+constexpr REGSAM KEY_QUERY_VALUE        = 0x0001;
+constexpr REGSAM KEY_SET_VALUE          = 0x0002;
+constexpr REGSAM KEY_CREATE_SUB_KEY     = 0x0004;
+constexpr REGSAM KEY_ENUMERATE_SUB_KEYS = 0x0008;
+constexpr REGSAM KEY_NOTIFY             = 0x0010;
+constexpr REGSAM KEY_CREATE_LINK        = 0x0020;
+constexpr REGSAM KEY_WOW64_64KEY        = 0x0100;
+constexpr REGSAM KEY_WOW64_32KEY        = 0x0200;
+constexpr REGSAM KEY_READ               = 0x20019;
+constexpr REGSAM KEY_WRITE              = 0x20006;
+constexpr REGSAM KEY_ALL_ACCESS         = 0xF003F;
+
+// options
+constexpr DWORD REG_OPTION_NON_VOLATILE = 0x0000;
+constexpr DWORD REG_OPTION_VOLATILE     = 0x0001;
+
+// value types
+constexpr DWORD REG_NONE      = 0;
+constexpr DWORD REG_SZ        = 1;
+constexpr DWORD REG_EXPAND_SZ = 2;
+constexpr DWORD REG_BINARY    = 3;
+constexpr DWORD REG_DWORD     = 4;
+constexpr DWORD REG_MULTI_SZ  = 7;
+constexpr DWORD REG_QWORD     = 11;
+
+#endif